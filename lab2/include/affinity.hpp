@@ -0,0 +1,21 @@
+#pragma once
+#include <string_view>
+#include <tuple>
+#include <vector>
+
+#include <pthread.h>
+
+#include "error.hpp"
+
+// CPU and NUMA placement of threads. Memory a thread touches first is
+// allocated on its own node, so a thread pinned before it allocates its
+// buffers keeps them local.
+class Affinity {
+public:
+	// "0-3,8,10-11", the format taskset and cpusets use
+	static auto parse(std::string_view list) -> std::tuple<std::vector<int>, Error>;
+	// an empty list leaves the thread where it is
+	static auto pin(const std::vector<int>& cpus, pthread_t thread = pthread_self()) -> Error;
+	// -1 if the kernel does not report one
+	static auto nodeOf(int cpu) -> int;
+};
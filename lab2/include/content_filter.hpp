@@ -0,0 +1,80 @@
+#pragma once
+#include <memory>
+#include <string>
+#include <string_view>
+#include <tuple>
+#include <unordered_map>
+#include <variant>
+#include <vector>
+
+#include "error.hpp"
+
+// Predicate over the fields of a JSON payload, such as
+//   temperature > 30 && (unit == "C" || !calibrated)
+// Fields are dotted paths into nested objects, array elements are numbered
+// from 0. Comparisons take a number, a string, true, false or null on the
+// right; a missing field or a mismatched type makes a comparison false.
+// The expression is compiled once into postfix form and the compiled filter
+// is shared by every subscription that uses it.
+class ContentFilter {
+public:
+	using Value = std::variant<std::monostate, bool, double, std::string>;
+
+	// a payload's fields by dotted path, a message is parsed at most once
+	class Document {
+	public:
+		struct PathHash {
+			using is_transparent = void;
+			auto operator()(std::string_view path) const -> size_t;
+		};
+		using Fields = std::unordered_map<std::string, Value, PathHash, std::equal_to<>>;
+
+		// false if the payload is not a JSON object
+		auto parse(std::string_view payload) -> bool;
+		auto find(std::string_view path) const -> const Value*;
+	private:
+		Fields fields;
+	};
+
+	// caches each filter's verdict on one message and parses the payload on first use
+	class Evaluator {
+	public:
+		Evaluator(std::string_view payload);
+
+		auto passes(const ContentFilter& filter) -> bool;
+	private:
+		std::string_view payload;
+		bool parsed = false;
+		bool valid = false;
+		Document document;
+		std::vector<std::pair<const ContentFilter*, bool>> verdicts;
+	};
+
+	static auto compile(std::string_view expression) -> std::tuple<std::shared_ptr<const ContentFilter>, Error>;
+
+	auto expression() const -> std::string_view;
+	auto evaluate(const Document& document) const -> bool;
+private:
+	enum class Op {
+		Equal,
+		NotEqual,
+		Less,
+		LessEqual,
+		Greater,
+		GreaterEqual,
+		And,
+		Or,
+		Not,
+	};
+
+	struct Instruction {
+		Op op;
+		std::string path;
+		Value literal;
+	};
+
+	class Parser;
+
+	std::string source;
+	std::vector<Instruction> program;
+};
@@ -0,0 +1,76 @@
+#pragma once
+#include <atomic>
+#include <memory>
+#include <mutex>
+#include <ostream>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "error.hpp"
+#include "notifier.hpp"
+#include "spsc_ring.hpp"
+
+// Trace output of the connection threads, written by a thread of its own so
+// a slow terminal or pipe never holds up a session. Every thread that logs
+// gets a ring of its own on first use; the writer drains all of them every
+// few milliseconds, or as soon as one fills up, and writes what it found
+// with one call. Lines of one thread keep
+// their order, lines of different threads come out in the order the writer
+// got to them.
+class Logger {
+public:
+	Logger(std::ostream& output);
+	~Logger();
+
+	Logger(const Logger&) = delete;
+	auto operator=(const Logger&) -> Logger& = delete;
+
+	auto open() -> Error;
+	// any thread, a full ring makes the caller wait for the writer
+	auto write(std::string line) -> void;
+	// parts are formatted like operator<< would and ended with a newline
+	template<typename... Parts>
+	auto print(const Parts&... parts) -> void {
+		// kept per thread, constructing a stream costs more than formatting a packet
+		thread_local std::ostringstream line;
+		line.str({});
+		(line << ... << parts) << '\n';
+		write(line.str());
+	}
+	// writes out everything logged so far and stops the writer, later lines go out directly
+	auto close() -> void;
+private:
+	static constexpr size_t ringCapacity = 1024;
+
+	struct Producer {
+		Producer() : ring(ringCapacity) {}
+
+		SpscRing<std::string> ring;
+		// set by the thread on exit, once its ring is drained it is dropped
+		std::atomic<bool> retired = false;
+	};
+
+	struct Local {
+		~Local();
+
+		const Logger* owner = nullptr;
+		std::shared_ptr<Producer> producer;
+	};
+
+	auto local() -> Producer&;
+	auto run() -> void;
+	auto drain() -> void;
+
+	static thread_local Local current;
+
+	std::ostream& output;
+	Notifier notifier;
+	std::mutex producersMutex;
+	std::vector<std::shared_ptr<Producer>> producers;
+	// lines go straight to output unless the writer runs
+	std::atomic<bool> accepting = false;
+	std::atomic<bool> stopping = false;
+	std::thread writer;
+};
@@ -1,34 +1,351 @@
 #pragma once
+#include "affinity.hpp"
+#include "arena.hpp"
+#include "buffered_reader.hpp"
+#include "content_filter.hpp"
+#include "logger.hpp"
 #include "mqtt.hpp"
+#include "offline_queue.hpp"
+#include "outbox.hpp"
+#include "slab_pool.hpp"
+#include "token_bucket.hpp"
+#include "topic_log.hpp"
+#include "unix_domain_socket.hpp"
 #include "unix_tcp_socket.hpp"
+#include "write_ahead_log.hpp"
 
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <list>
+#include <map>
+#include <memory>
+#include <optional>
 #include <set>
 #include <thread>
 #include <unordered_map>
+#include <unordered_set>
 
 class MqttBroker {
 public:
+	struct Config {
+		uint16_t port = 1883;
+		// running brokers accept hot-upgrade requests on this path
+		std::string upgradePath = "/tmp/mqtt-broker.sock";
+		// zero means unlimited, excess connections wait in the listen backlog
+		size_t maxConnections = 0;
+		size_t acceptBatch = 64;
+		// new CONNECTs admitted per second, zero disables admission control
+		double connectRate = 0.0;
+		double connectBurst = 0.0;
+		// publishes above this many bytes are spliced between sockets, zero disables
+		size_t largePayloadThreshold = 0;
+		// larger packets drop their connection before anything is allocated for them, zero disables;
+		// spliced publishes only count their headers
+		size_t maxPacketSize = 16 * 1024 * 1024;
+		// persistent sessions keep this many bytes per client in memory while it is offline,
+		// the rest goes to segment files in offlineDirectory
+		size_t offlineMemoryLimit = 1024 * 1024;
+		std::string offlineDirectory = "/tmp/mqtt-broker-sessions";
+		size_t offlineSegmentSize = 16 * 1024 * 1024;
+		// replay on reconnect tops the outbox up to this many bytes at a time
+		size_t replayWindow = 256 * 1024;
+		// QoS 1+ publishes are acknowledged once logged here, persistent sessions are rebuilt from it;
+		// empty disables the log
+		std::string walDirectory = "/tmp/mqtt-broker-wal";
+		size_t walSegmentSize = 64 * 1024 * 1024;
+		std::chrono::microseconds walCommitDelay{0};
+		size_t walCommitBytes = 1024 * 1024;
+		// publishes matching these filters are kept for retentionPeriod and can be
+		// re-read by subscribing to $replay/<offset|@unix-ms|-seconds>/<filter>
+		std::vector<std::string> retentionFilters;
+		std::string retentionDirectory = "/tmp/mqtt-broker-logs";
+		std::chrono::seconds retentionPeriod{3600};
+		size_t retentionSegmentSize = 64 * 1024 * 1024;
+		size_t retentionIndexInterval = 4096;
+		// per connection publish limits, zero disables, a client over its limit has its reads paused;
+		// bursts of zero mean one second's worth
+		double clientPublishRate = 0.0;
+		double clientPublishBurst = 0.0;
+		double clientByteRate = 0.0;
+		double clientByteBurst = 0.0;
+		// limits shared by everything published under a filter, bursts are one second's worth
+		struct TopicLimit {
+			std::string filter;
+			double publishRate;
+			double byteRate;
+		};
+		std::vector<TopicLimit> topicLimits;
+		// a consumer's backlog is what its outbox holds plus what the socket has not sent yet,
+		// every threshold can be disabled with zero
+		std::chrono::milliseconds consumerCheckInterval{1000};
+		size_t consumerWarnBytes = 1024 * 1024;
+		size_t consumerConflateBytes = 0;
+		size_t consumerDisconnectBytes = 0;
+		std::chrono::milliseconds consumerMaxAge{0};
+		// the worst consumers are published retained to $SYS/broker/consumers/worst
+		size_t consumerReportCount = 5;
+		// keeps at most this much unsent data in each client's socket so control packets queued
+		// in the outbox are not stuck behind a full send buffer, zero leaves the kernel default
+		size_t notSentLowWatermark = 0;
+		// peer brokers this one keeps a link to; only topics the other side has subscribers for
+		// cross a link, interest travels as SUBSCRIBE and UNSUBSCRIBE. Two brokers that list each
+		// other share one link, and a ring of links delivers each publish once
+		struct Bridge {
+			std::string address;
+			uint16_t port;
+		};
+		std::vector<Bridge> bridges;
+		// announced to peers, a peer announcing this broker's own name is refused as a loop;
+		// empty means hostname:port
+		std::string bridgeName;
+		uint16_t bridgeKeepAlive = 60;
+		// CPU placement, empty lists leave it to the scheduler. Service threads are the accept loop,
+		// the monitor, bridges and the upgrade listener. A connection and its sender run on the NUMA
+		// node of the CPU its packets arrive on when that CPU is listed, round robin otherwise.
+		std::vector<int> serviceCpus;
+		std::vector<int> connectionCpus;
+		std::vector<int> logCpus;
+	};
+
+	MqttBroker() = default;
+	MqttBroker(Config config);
+
 	auto serve() -> void;
+	// takes the listener, clients and state over from the broker running on config.upgradePath
+	auto takeOver() -> Error;
 private:
-	auto handleClient(UnixTcpSocket client) -> void;
-	auto handleSubscription(UnixTcpSocket client, const Mqtt::Message& message) -> void;
-	auto handlePublish(const Mqtt::Message& message, const Bytes& messageBytes) -> void;
+	struct Session;
+	struct LogReplay;
+
+	// crosses bridge links with every publish: the broker it was first published to and that
+	// broker's count, so a copy that comes around a ring of links again can be recognized
+	struct Stamp {
+		uint64_t origin;
+		uint64_t sequence;
+	};
+
+	auto handleClient(UnixTcpSocket client, bool resumed) -> void;
+	auto handleConnect(BufferedReader& client) -> bool;
+	auto acceptClient(UnixTcpSocket client, const Mqtt::ConnectHeader& connect, bool persistent) -> void;
+	auto handleSession(BufferedReader& reader) -> void;
+	auto handleSubscription(UnixTcpSocket client, Outbox& outbox, const Mqtt::Message& message) -> void;
+	// nothing published over a bridge is forwarded back to the bridge it came from,
+	// stamp is only known up front for publishes that arrived over one
+	auto handlePublish(std::shared_ptr<Outbox> outbox, const std::shared_ptr<Session>& origin, 
+			const Mqtt::Message& message, BytesView messageBytes, std::optional<Stamp> stamp) -> void;
+	// record is logged before acknowledging, nullopt acknowledges right away
+	auto acknowledge(std::shared_ptr<Outbox> outbox, const Mqtt::Message& message, std::optional<BytesView> record) 
+		-> void;
+	auto forwardLargePublish(BufferedReader& client, const std::shared_ptr<Session>& origin, 
+			const Mqtt::Message& message, std::optional<Stamp> stamp) -> Error;
 	auto handleUnsubscribe(UnixTcpSocket client, const Mqtt::Message& message) -> void;
-	auto handlePingreq(UnixTcpSocket client) -> void;
+	auto handlePingreq(Outbox& outbox) -> void;
+	auto handlePubrel(Outbox& outbox, const Mqtt::Message& message) -> void;
 	auto handleDisconnect(UnixTcpSocket client) -> void;
 
-	auto unsubscribeClient(UnixTcpSocket client) -> void;
+	auto spawnClient(UnixTcpSocket client, bool resumed) -> void;
+	// pins the calling connection thread before it allocates anything
+	auto placeConnection(UnixTcpSocket client) -> void;
+	auto awaitCapacity() -> void;
+	auto removeClient(UnixTcpSocket client) -> void;
 
-	struct Subscription {
+	auto monitorConsumers() -> void;
+	auto checkConsumers() -> void;
+	// slab pool statistics, published retained alongside the consumer report
+	auto reportMemory() -> void;
+	// delivers a broker generated message to its subscribers
+	auto publishSystem(std::string_view topic, std::string_view payload, bool retained) -> void;
+
+	// false if woken up for a handoff or once the deadline passed
+	auto awaitReadable(int fd, TokenBucket::Clock::time_point deadline = TokenBucket::Clock::time_point::max()) -> bool;
+	// false if woken up for a handoff before the delay ran out
+	auto awaitDelay(TokenBucket::Clock::duration delay) -> bool;
+	auto park() -> void;
+	auto listenForUpgrades() -> void;
+	auto handOff(UnixDomainSocket successor) -> Error;
+	auto serializeState() -> std::tuple<Bytes, std::vector<int>>;
+	auto deserializeState(BytesView bytes, const std::vector<int>& descriptors) -> Error;
+
+	// recover is false after a handoff, whose state is newer than anything in the log
+	auto openLog(bool recover) -> Error;
+	auto openTopicLogs() -> Error;
+	// null if request does not name an offset and a retained filter
+	auto prepareLogReplay(std::shared_ptr<Session> session, std::string_view request, Mqtt::QosLevel level) 
+		-> std::shared_ptr<LogReplay>;
+	auto spawnLogReplay(std::shared_ptr<LogReplay> replay) -> void;
+	auto replayLog(std::shared_ptr<LogReplay> replay, std::shared_ptr<Outbox> outbox) -> void;
+	// a persistent session's subscriptions and whether it is online, clientsMutex must be held
+	auto logSession(const Session& session) -> void;
+	auto logForgotten(const Session& session) -> void;
+	auto checkpointRecords() -> std::vector<Bytes>;
+	// online collects the sessions connected at the point the log has been replayed to
+	auto recoverRecord(BytesView record, std::unordered_set<std::string>& online) -> void;
+	auto recoverSession(BytesView record, std::unordered_set<std::string>& online) -> void;
+
+	auto runBridge(Config::Bridge bridge) -> void;
+	// returns the link and the name the peer announced
+	auto connectBridge(const Config::Bridge& bridge) -> std::tuple<UnixTcpSocket, std::string, Error>;
+	// true if a link this broker dialed to the peer named identifier is up and wins over one it dials in
+	auto keepsDialedLink(std::string_view identifier) -> bool;
+	// takes the stamp off a publish that arrived over a bridge, false if it has been seen before
+	auto unstamp(Mqtt::Message& message) -> std::tuple<Stamp, bool>;
+	auto nextStamp() -> Stamp;
+	// PUBLISH to bridgeHello that names this broker
+	auto encodeHello() const -> Bytes;
+	// message as sent over bridge links, its topic prefixed by the stamp
+	static auto stamped(const Mqtt::Message& message, Stamp stamp) -> Mqtt::Message;
+	static auto originOf(std::string_view bridgeName) -> uint64_t;
+	// sends every bridge the filters subscribed on this side of it, clientsMutex must be held
+	auto advertiseInterest() -> void;
+
+	auto makeSession(std::string_view identifier, bool persistent) -> std::shared_ptr<Session>;
+	auto discardSession(const std::shared_ptr<Session>& session) -> void;
+	auto spawnReplay(std::shared_ptr<Session> session) -> void;
+	auto replayOffline(std::shared_ptr<Session> session, std::shared_ptr<Outbox> outbox) -> void;
+
+	// lets decoded topics be looked up without materializing a std::string
+	struct TopicHash {
+		using is_transparent = void;
+		auto operator()(std::string_view topic) const -> size_t;
+	};
+
+	template<typename T>
+	using TopicMap = std::unordered_map<std::string, T, TopicHash, std::equal_to<>>;
+
+	// outlives its connection when the client asked for a persistent session,
+	// every field is guarded by clientsMutex
+	struct Session {
+		std::string identifier;
+		bool persistent;
+		// null while the client is offline
+		std::shared_ptr<Outbox> outbox;
+		UnixTcpSocket socket;
+		// set while queued messages are replayed, new ones queue up behind them
+		bool replaying = false;
+		std::unique_ptr<OfflineQueue> queue;
+		// the peer is another broker, filters it has been sent a SUBSCRIBE for and at which level
+		bool bridge = false;
+		std::map<std::string, Mqtt::QosLevel, std::less<>> advertised;
+		// this broker dialed the link's current connection, to the bridge configured as address:port
+		bool dialed = false;
+		std::string route;
+		uint16_t nextId = 1;
+
+		auto deliver(const Outbox::Packet& packet, Mqtt::QosLevel level) -> void;
+	};
+
+	struct Client {
 		UnixTcpSocket socket;
+		std::string identifier;
+		uint16_t keepAlive;
+		std::shared_ptr<Outbox> outbox;
+		std::shared_ptr<Session> session;
+		// over consumerWarnBytes at the last check
+		bool slow = false;
+	};
+
+	struct Subscription {
+		std::shared_ptr<Session> session;
 		Mqtt::QosLevel level;
+		// null unless the filter carried a condition on the payload
+		std::shared_ptr<const ContentFilter> condition;
 
 		auto operator<(const Subscription& other) const -> bool;
 		auto operator==(const Subscription& other) const -> bool;
 	};
 
-	std::unordered_map<std::string, std::set<Subscription>> subscriptions;
-	std::unordered_map<std::string, Bytes> retain;
+	// walked for every publish, nodes come from the slab pool to sit close together
+	using SubscriptionSet = std::set<Subscription, std::less<Subscription>, SlabAllocator<Subscription>>;
+	// a session's subscriptions by filter, as written to the log
+	using SessionFilters = std::vector<std::pair<std::string_view, const Subscription*>>;
+
+	auto sessionBytes(const Session& session, const SessionFilters& filters) -> Bytes;
+
+	static constexpr std::string_view replayPrefix = "$replay/";
+	// "sensors/#?temperature > 30" subscribes to sensors/# for JSON payloads the condition holds for
+	static constexpr char conditionSeparator = '?';
+	// client identifier prefix of bridge links, followed by the name of the broker on the other end
+	static constexpr std::string_view bridgePrefix = "$bridge/";
+	// first packet on an accepted bridge link, its payload names the accepting broker
+	static constexpr std::string_view bridgeHello = "$bridge/hello";
+
+	// a $replay subscription still streaming history, it turns into a plain
+	// subscription to filter once it catches up with the log
+	struct LogReplay {
+		std::shared_ptr<Session> session;
+		std::string filter;
+		Mqtt::QosLevel level;
+		TopicLog* log;
+		uint64_t offset;
+	};
+
+	struct TopicLimiter {
+		TopicLimiter(const Config::TopicLimit& limit);
+
+		std::string filter;
+		TokenBucket publishes;
+		TokenBucket bytes;
+	};
+
+	// filters are matched once per topic and connection
+	using LimiterCache = TopicMap<std::vector<TopicLimiter*>>;
+
+	// charges a publish of size bytes to every limit it falls under, returns how long to stop reading
+	auto throttle(TokenBucket& publishes, TokenBucket& bytes, LimiterCache& cache, std::string_view topic, size_t size) 
+		-> TokenBucket::Clock::duration;
+
+	auto subscribe(const std::shared_ptr<Session>& session, std::string_view filter, Mqtt::QosLevel level,
+			std::shared_ptr<const ContentFilter> condition = nullptr) -> void;
+	// subscriptions with the same condition share one compiled filter, clientsMutex must be held
+	auto compileCondition(std::string_view expression) -> std::tuple<std::shared_ptr<const ContentFilter>, Error>;
+	// visits every subscriber set whose filter matches topic, clientsMutex must be held;
+	// levels, when the decoder already found them, spare splitting the topic per wildcard filter
+	auto forEachSubscription(std::string_view topic, const std::function<void(const SubscriptionSet&)>& visit,
+			const Mqtt::TopicLevels* levels = nullptr) -> void;
+
+	Config config;
+	UnixTcpSocket listener = UnixTcpSocket::fromDescriptor(-1);
+
+	std::map<UnixTcpSocket, std::shared_ptr<Client>> clients;
+	std::unordered_map<std::string, std::shared_ptr<Session>> sessions;
+	TopicMap<SubscriptionSet> subscriptions;
+	TopicMap<std::weak_ptr<const ContentFilter>> conditions;
+	// subscribed filters with wildcards other than the plain "#"
+	std::set<std::string, std::less<>> wildcardFilters;
+	std::list<std::shared_ptr<LogReplay>> logReplays;
+	std::vector<std::unique_ptr<TopicLog>> topicLogs;
+	TopicMap<Outbox::Packet> retain;
 	std::mutex clientsMutex;
 	std::mutex retainMutex;
+	TokenBucket admission;
+	std::deque<TopicLimiter> topicLimiters;
+	// every listed connection CPU mapped to the listed CPUs on its node
+	std::unordered_map<int, std::vector<int>> connectionPlacement;
+	std::atomic<size_t> nextPlacement = 0;
+	std::unique_ptr<WriteAheadLog> wal;
+	// every packet a session reads is traced here
+	Logger logger{std::cout};
+	// connected bridge sessions
+	std::set<std::shared_ptr<Session>> bridgeSessions;
+	// publishes that arrived over bridges, the most recent per origin broker
+	struct RecentStamps {
+		std::unordered_set<uint64_t> sequences;
+		std::deque<uint64_t> order;
+	};
+	std::unordered_map<uint64_t, RecentStamps> recentStamps;
+	std::mutex stampsMutex;
+	uint64_t bridgeOrigin = 0;
+	std::atomic<uint64_t> bridgeSequence = 0;
+
+	// hot-upgrade bookkeeping, every serving thread parks at a packet boundary while draining
+	int wakeFd = -1;
+	// written under handoffMutex, readers that only poll it may skip the lock
+	std::atomic<bool> draining = false;
+	size_t running = 0;
+	size_t parked = 0;
+	size_t connections = 0;
+	std::mutex handoffMutex;
+	std::condition_variable handoffCondition;
 };
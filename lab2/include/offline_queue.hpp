@@ -0,0 +1,53 @@
+#pragma once
+#include <deque>
+#include <string>
+#include <vector>
+
+#include "common.hpp"
+#include "outbox.hpp"
+
+// Messages held for a persistent session while its client is away. The
+// oldest ones stay in memory up to memoryLimit bytes, everything beyond
+// that is appended to numbered segment files and read back in order.
+class OfflineQueue {
+public:
+	OfflineQueue(std::string_view directory, std::string_view name, size_t memoryLimit, size_t segmentSize);
+	~OfflineQueue();
+
+	OfflineQueue(const OfflineQueue&) = delete;
+	auto operator=(const OfflineQueue&) -> OfflineQueue& = delete;
+
+	auto push(Outbox::Packet packet) -> Error;
+	// returns at least one packet if any are queued, and at most maxBytes beyond that
+	auto pop(size_t maxBytes) -> std::tuple<std::vector<Outbox::Packet>, Error>;
+	auto empty() const -> bool;
+	// everything queued, oldest first, left in place
+	auto packets() const -> std::tuple<std::vector<Outbox::Packet>, Error>;
+	// drops everything, including segment files
+	auto clear() -> void;
+
+	auto serialize(Bytes& bytes) const -> void;
+	auto deserialize(BytesView bytes, size_t& offset) -> Error;
+private:
+	auto spill(const Bytes& packet) -> Error;
+	auto readSegment() -> std::tuple<Outbox::Packet, Error>;
+	auto segmentPath(uint32_t sequence) const -> std::string;
+	auto closeFiles() -> void;
+
+	std::string prefix;
+	size_t memoryLimit;
+	size_t segmentSize;
+
+	std::deque<Outbox::Packet> memory;
+	size_t memoryBytes = 0;
+
+	// segments firstSegment..lastSegment exist while onDisk is set
+	bool onDisk = false;
+	uint32_t firstSegment = 0;
+	uint32_t lastSegment = 0;
+	size_t readOffset = 0;
+	// bytes written to each of them, the last one's is where the next packet goes
+	std::deque<size_t> segmentLengths;
+	int readFd = -1;
+	int writeFd = -1;
+};
@@ -0,0 +1,80 @@
+#pragma once
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "common.hpp"
+#include "unix_tcp_socket.hpp"
+
+// Per-connection sender. Producers queue encoded packets, which may be
+// shared between many subscribers, and a dedicated thread writes whatever
+// has piled up with a single writev. Control packets have their own lane
+// that is always written first, bulk traffic goes out in bounded batches so
+// a control packet never waits behind more than one of them.
+class Outbox {
+public:
+	using Packet = std::shared_ptr<const Bytes>;
+	using Clock = std::chrono::steady_clock;
+
+	struct Stats {
+		size_t packets;
+		size_t bytes;
+		// time the oldest packet not yet fully written has been waiting
+		Clock::duration oldest;
+		size_t unsent;
+	};
+
+	// the shared state and vector header come from the slab pool in one block
+	static auto share(Bytes bytes) -> Packet;
+
+	Outbox(UnixTcpSocket socket);
+	~Outbox();
+
+	Outbox(const Outbox&) = delete;
+	auto operator=(const Outbox&) -> Outbox& = delete;
+
+	auto push(Packet packet) -> void;
+	auto push(const std::vector<Packet>& packets) -> void;
+	// acknowledgements and other protocol responses, overtake queued publishes
+	auto pushControl(Packet packet) -> void;
+	// true once everything queued is written or the outbox closed, false on timeout
+	auto waitUntilEmpty(std::chrono::milliseconds timeout) -> bool;
+	// false if still at or above the given number of unwritten bytes after timeout, or closed
+	auto waitUntilBelow(size_t bytes, std::chrono::milliseconds timeout) -> bool;
+	// hands the socket to the caller once everything queued so far is written,
+	// packets pushed in the meantime wait until release(); false if closed or timed out
+	auto acquire(std::chrono::milliseconds timeout) -> bool;
+	auto release() -> void;
+	auto descriptor() const -> int;
+	auto stats() -> Stats;
+	// drops every queued QoS 0 PUBLISH that a later queued one to the same topic supersedes,
+	// returns how many were dropped
+	auto conflate() -> size_t;
+	// aborts pending writes, the socket itself is left open
+	auto close() -> void;
+private:
+	auto stop(bool abort) -> void;
+	auto run() -> void;
+	auto writeAll(const std::vector<Packet>& batch) -> Error;
+
+	UnixTcpSocket socket;
+	std::deque<Packet> queue;
+	std::deque<Packet> control;
+	// when each queued packet was pushed, parallel to queue
+	std::deque<Clock::time_point> queuedAt;
+	Clock::time_point writingSince;
+	std::vector<iovec> vectors;
+	// queued plus currently being written
+	size_t pendingBytes = 0;
+	bool writing = false;
+	bool leased = false;
+	bool closed = false;
+	std::mutex mutex;
+	std::mutex joinMutex;
+	std::condition_variable condition;
+	std::thread sender;
+};
@@ -0,0 +1,24 @@
+#pragma once
+#include <chrono>
+#include <mutex>
+
+class TokenBucket {
+public:
+	using Clock = std::chrono::steady_clock;
+
+	// a rate of zero disables the bucket, every take succeeds
+	TokenBucket(double rate = 0.0, double burst = 0.0);
+
+	auto tryTake(double tokens = 1.0) -> bool;
+	// always takes, going into debt if needed, and returns how long until the debt is repaid
+	auto reserve(double tokens) -> Clock::duration;
+	auto enabled() const -> bool;
+private:
+	auto refill(Clock::time_point now) -> void;
+
+	double rate;
+	double burst;
+	double tokens;
+	Clock::time_point last;
+	std::mutex mutex;
+};
@@ -0,0 +1,96 @@
+#pragma once
+#include <chrono>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include "common.hpp"
+
+// Retention log for one topic filter. Every matching PUBLISH gets the next
+// offset and is appended to the active segment file; a sparse index of
+// (offset, timestamp, position) entries is kept every indexInterval bytes
+// so a read can start near any offset or time. Reads hand out views into a
+// read-only mapping of the segment, which outlives the segment for as long
+// as a view needs it. Segments older than the retention period are deleted
+// whole.
+class TopicLog {
+public:
+	using Clock = std::chrono::system_clock;
+
+	// packets as they lie in the segments, valid for as long as the mappings are held
+	struct Records {
+		std::vector<BytesView> packets;
+		std::vector<std::shared_ptr<const void>> mappings;
+	};
+
+	TopicLog(std::string filter, std::string_view directory, size_t segmentSize, 
+			size_t indexInterval, std::chrono::seconds retention);
+	~TopicLog();
+
+	TopicLog(const TopicLog&) = delete;
+	auto operator=(const TopicLog&) -> TopicLog& = delete;
+
+	// picks up segments written by earlier runs
+	auto open() -> Error;
+	auto filter() const -> std::string_view;
+
+	auto append(BytesView packet) -> Error;
+	// records from offset on, at least one if any exist and at most maxBytes beyond that,
+	// along with the offset to continue from
+	auto read(uint64_t offset, size_t maxBytes) -> std::tuple<Records, uint64_t, Error>;
+	// the first offset stored at or after time
+	auto offsetAt(Clock::time_point time) -> uint64_t;
+	auto endOffset() -> uint64_t;
+	// deletes the segments past the retention period, the active one always stays
+	auto expire() -> void;
+private:
+	struct IndexEntry {
+		uint64_t offset;
+		int64_t timestamp;
+		uint64_t position;
+	};
+
+	struct Mapping {
+		Mapping(const Byte* data, size_t size);
+		~Mapping();
+
+		Mapping(const Mapping&) = delete;
+		auto operator=(const Mapping&) -> Mapping& = delete;
+
+		const Byte* data;
+		size_t size;
+	};
+
+	struct Segment {
+		std::string path;
+		int fd = -1;
+		int indexFd = -1;
+		uint64_t baseOffset = 0;
+		uint64_t nextOffset = 0;
+		int64_t lastTimestamp = 0;
+		size_t size = 0;
+		std::vector<IndexEntry> index;
+		// replaced by a larger one as the segment grows
+		std::shared_ptr<const Mapping> map;
+	};
+
+	auto openSegment(uint64_t baseOffset, bool create) -> Error;
+	auto scan(Segment& segment, size_t position) -> void;
+	auto mapSegment(Segment& segment) -> Error;
+	auto closeSegment(Segment& segment, bool remove) -> void;
+	auto addIndexEntry(Segment& segment, const IndexEntry& entry) -> void;
+	// mutex must be held
+	auto dropExpired() -> void;
+	auto segmentPath(uint64_t baseOffset) const -> std::string;
+
+	std::string name;
+	std::string directory;
+	size_t segmentSize;
+	size_t indexInterval;
+	std::chrono::seconds retention;
+
+	std::deque<Segment> segments;
+	std::mutex mutex;
+};
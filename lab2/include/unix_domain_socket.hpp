@@ -0,0 +1,23 @@
+#pragma once
+#include <string_view>
+#include <tuple>
+#include <vector>
+
+#include "common.hpp"
+#include "error.hpp"
+
+class UnixDomainSocket {
+public:
+	static auto create() -> std::tuple<UnixDomainSocket, Error>;
+
+	auto connect(std::string_view path) -> Error;
+	auto listen(std::string_view path) -> Error;
+	auto accept() -> std::tuple<UnixDomainSocket, Error>;
+	auto read(size_t howManyBytes) const -> std::tuple<Bytes, Error>;
+	auto write(const BytesView bytes) const -> Error;
+	auto sendDescriptors(const std::vector<int>& descriptors) const -> Error;
+	auto receiveDescriptors(size_t howMany) const -> std::tuple<std::vector<int>, Error>;
+	auto close() -> void;
+private:
+	int fd;
+};
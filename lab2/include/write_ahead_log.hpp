@@ -0,0 +1,61 @@
+#pragma once
+#include <chrono>
+#include <condition_variable>
+#include <functional>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "common.hpp"
+
+// Append-only log with group commit. Records from every connection pile up
+// in one buffer while the previous batch is being synced, then go out with a
+// single write and fdatasync. A record's completion runs once it is durable.
+class WriteAheadLog {
+public:
+	using Completion = std::function<void(Error)>;
+	using Recovery = std::function<void(BytesView)>;
+	// records restated at the head of every new segment so the older ones can be dropped
+	using Checkpoint = std::function<std::vector<Bytes>()>;
+
+	// a batch is committed once commitBytes have piled up or its oldest record waited commitDelay
+	WriteAheadLog(std::string directory, size_t segmentSize, std::chrono::microseconds commitDelay, size_t commitBytes);
+	~WriteAheadLog();
+
+	WriteAheadLog(const WriteAheadLog&) = delete;
+	auto operator=(const WriteAheadLog&) -> WriteAheadLog& = delete;
+
+	// replays every intact record left by earlier runs, then starts a fresh segment
+	auto open(const Recovery& recover, Checkpoint checkpoint) -> Error;
+	auto append(BytesView record, Completion done) -> void;
+	// blocks until everything appended so far is durable
+	auto flush() -> void;
+	// restricts the commit thread to cpus
+	auto pin(const std::vector<int>& cpus) -> Error;
+private:
+	auto run() -> void;
+	auto commit(const Bytes& batch) -> Error;
+	auto startSegment() -> Error;
+	auto segmentPath(uint32_t sequence) const -> std::string;
+
+	std::string directory;
+	size_t segmentSize;
+	std::chrono::microseconds commitDelay;
+	size_t commitBytes;
+	Checkpoint checkpoint;
+
+	int fd = -1;
+	uint32_t sequence = 0;
+	size_t segmentOffset = 0;
+
+	// framed records and their completions waiting for the next commit
+	Bytes pending;
+	std::vector<Completion> completions;
+	std::chrono::steady_clock::time_point oldest;
+	bool committing = false;
+	bool closed = false;
+	std::mutex mutex;
+	std::condition_variable condition;
+	std::thread committer;
+};
@@ -0,0 +1,95 @@
+#include "affinity.hpp"
+
+#include <charconv>
+#include <filesystem>
+#include <string>
+
+#include <sched.h>
+
+auto Affinity::parse(std::string_view list) -> std::tuple<std::vector<int>, Error> {
+	std::vector<int> cpus;
+
+	while(!list.empty()) {
+		auto end = list.find(',');
+		auto range = list.substr(0, end);
+		auto dash = range.find('-');
+
+		int first = 0;
+		int last = 0;
+		auto firstText = range.substr(0, dash);
+		auto [firstEnd, firstErr] = std::from_chars(firstText.data(), firstText.data() + firstText.size(), first);
+		if(firstErr != std::errc() || firstEnd != firstText.data() + firstText.size()) {
+			return {
+				{},
+				"Malformed CPU list",
+			};
+		}
+
+		last = first;
+		if(dash != std::string_view::npos) {
+			auto lastText = range.substr(dash + 1);
+			auto [lastEnd, lastErr] = std::from_chars(lastText.data(), lastText.data() + lastText.size(), last);
+			if(lastErr != std::errc() || lastEnd != lastText.data() + lastText.size() || last < first) {
+				return {
+					{},
+					"Malformed CPU list",
+				};
+			}
+		}
+
+		if(last >= CPU_SETSIZE) {
+			return {
+				{},
+				"CPU number out of range",
+			};
+		}
+
+		for(int cpu = first; cpu <= last; cpu++) {
+			cpus.push_back(cpu);
+		}
+
+		if(end == std::string_view::npos) {
+			break;
+		}
+		list.remove_prefix(end + 1);
+	}
+
+	return {
+		cpus,
+		nullptr,
+	};
+}
+
+auto Affinity::pin(const std::vector<int>& cpus, pthread_t thread) -> Error {
+	if(cpus.empty()) {
+		return nullptr;
+	}
+
+	cpu_set_t set;
+	CPU_ZERO(&set);
+	for(int cpu : cpus) {
+		CPU_SET(cpu, &set);
+	}
+
+	if(pthread_setaffinity_np(thread, sizeof(set), &set) != 0) {
+		return "Could not set thread affinity";
+	}
+
+	return nullptr;
+}
+
+auto Affinity::nodeOf(int cpu) -> int {
+	// sysfs links every CPU to its node as cpuN/nodeM
+	std::error_code ec;
+	std::filesystem::directory_iterator it("/sys/devices/system/cpu/cpu" + std::to_string(cpu), ec);
+	for(; !ec && it != std::filesystem::directory_iterator(); it.increment(ec)) {
+		auto name = it->path().filename().string();
+		int node;
+		if(name.starts_with("node") 
+				&& std::from_chars(name.data() + 4, name.data() + name.size(), node).ec == std::errc()) {
+			return node;
+		}
+	}
+
+	return -1;
+}
@@ -0,0 +1,444 @@
+#include "content_filter.hpp"
+
+#include <cctype>
+#include <charconv>
+#include <cstdint>
+
+// nesting deeper than this is rejected, both in payloads and in expressions
+constexpr size_t maxDepth = 32;
+// the evaluation stack is a 64 bit word
+constexpr size_t maxStack = 64;
+
+static auto skipSpace(std::string_view text, size_t& offset) -> void {
+	while(offset < text.size() && (text[offset] == ' ' || text[offset] == '\t'
+			|| text[offset] == '\n' || text[offset] == '\r')) {
+		offset++;
+	}
+}
+
+static auto appendUtf8(std::string& out, uint32_t codepoint) -> void {
+	if(codepoint < 0x80) {
+		out += static_cast<char>(codepoint);
+	} else if(codepoint < 0x800) {
+		out += static_cast<char>(0xc0 | codepoint >> 6);
+		out += static_cast<char>(0x80 | (codepoint & 0x3f));
+	} else {
+		out += static_cast<char>(0xe0 | codepoint >> 12);
+		out += static_cast<char>(0x80 | (codepoint >> 6 & 0x3f));
+		out += static_cast<char>(0x80 | (codepoint & 0x3f));
+	}
+}
+
+// a JSON string starting at the opening quote, offset ends up past the closing one
+static auto parseString(std::string_view text, size_t& offset, std::string& out) -> bool {
+	offset++;
+	while(offset < text.size()) {
+		char c = text[offset++];
+		if(c == '"') {
+			return true;
+		} else if(c != '\\') {
+			out += c;
+			continue;
+		}
+
+		if(offset >= text.size()) {
+			return false;
+		}
+
+		switch(char escaped = text[offset++]) {
+			case 'b': out += '\b'; break;
+			case 'f': out += '\f'; break;
+			case 'n': out += '\n'; break;
+			case 'r': out += '\r'; break;
+			case 't': out += '\t'; break;
+			case 'u': {
+				uint32_t codepoint = 0;
+				auto [end, ec] = std::from_chars(text.data() + offset,
+						text.data() + std::min(offset + 4, text.size()), codepoint, 16);
+				if(ec != std::errc() || end != text.data() + offset + 4) {
+					return false;
+				}
+				offset += 4;
+				appendUtf8(out, codepoint);
+				break;
+			}
+			default:
+				out += escaped;
+				break;
+		}
+	}
+	return false;
+}
+
+static auto parseNumber(std::string_view text, size_t& offset, double& out) -> bool {
+	auto [end, ec] = std::from_chars(text.data() + offset, text.data() + text.size(), out);
+	if(ec != std::errc()) {
+		return false;
+	}
+	offset = end - text.data();
+	return true;
+}
+
+static auto parseKeyword(std::string_view text, size_t& offset, ContentFilter::Value& out) -> bool {
+	auto rest = text.substr(offset);
+	if(rest.starts_with("true")) {
+		out = true;
+		offset += 4;
+	} else if(rest.starts_with("false")) {
+		out = false;
+		offset += 5;
+	} else if(rest.starts_with("null")) {
+		out = std::monostate{};
+		offset += 4;
+	} else {
+		return false;
+	}
+	return true;
+}
+
+// flattens the value at offset into fields, objects and arrays contribute one field per leaf
+static auto parseValue(std::string_view text, size_t& offset, std::string& path, size_t depth,
+		ContentFilter::Document::Fields& fields) -> bool {
+	skipSpace(text, offset);
+	if(offset >= text.size() || depth > maxDepth) {
+		return false;
+	}
+
+	char c = text[offset];
+	if(c == '{' || c == '[') {
+		bool object = c == '{';
+		char close = object ? '}' : ']';
+		size_t prefix = path.size();
+		size_t index = 0;
+
+		offset++;
+		skipSpace(text, offset);
+		if(offset < text.size() && text[offset] == close) {
+			offset++;
+			return true;
+		}
+
+		while(true) {
+			if(prefix > 0) {
+				path += '.';
+			}
+
+			if(object) {
+				skipSpace(text, offset);
+				if(offset >= text.size() || text[offset] != '"' || !parseString(text, offset, path)) {
+					return false;
+				}
+				skipSpace(text, offset);
+				if(offset >= text.size() || text[offset++] != ':') {
+					return false;
+				}
+			} else {
+				path += std::to_string(index++);
+			}
+
+			if(!parseValue(text, offset, path, depth + 1, fields)) {
+				return false;
+			}
+			path.resize(prefix);
+
+			skipSpace(text, offset);
+			if(offset >= text.size()) {
+				return false;
+			} else if(text[offset] == close) {
+				offset++;
+				return true;
+			} else if(text[offset++] != ',') {
+				return false;
+			}
+		}
+	}
+
+	ContentFilter::Value value;
+	if(c == '"') {
+		std::string string;
+		if(!parseString(text, offset, string)) {
+			return false;
+		}
+		value = std::move(string);
+	} else if(c == '-' || (c >= '0' && c <= '9')) {
+		double number;
+		if(!parseNumber(text, offset, number)) {
+			return false;
+		}
+		value = number;
+	} else if(!parseKeyword(text, offset, value)) {
+		return false;
+	}
+
+	fields.insert_or_assign(path, std::move(value));
+	return true;
+}
+
+auto ContentFilter::Document::parse(std::string_view payload) -> bool {
+	fields.clear();
+
+	size_t offset = 0;
+	skipSpace(payload, offset);
+	if(offset >= payload.size() || payload[offset] != '{') {
+		return false;
+	}
+
+	std::string path;
+	if(!parseValue(payload, offset, path, 0, fields)) {
+		return false;
+	}
+
+	skipSpace(payload, offset);
+	return offset == payload.size();
+}
+
+auto ContentFilter::Document::PathHash::operator()(std::string_view path) const -> size_t {
+	return std::hash<std::string_view>()(path);
+}
+
+auto ContentFilter::Document::find(std::string_view path) const -> const Value* {
+	auto it = fields.find(path);
+	return it != fields.end() ? &it->second : nullptr;
+}
+
+ContentFilter::Evaluator::Evaluator(std::string_view payload) : payload(payload) {}
+
+auto ContentFilter::Evaluator::passes(const ContentFilter& filter) -> bool {
+	for(const auto& [seen, verdict] : verdicts) {
+		if(seen == &filter) {
+			return verdict;
+		}
+	}
+
+	if(!parsed) {
+		valid = document.parse(payload);
+		parsed = true;
+	}
+
+	// a payload that is not JSON passes no filter
+	bool verdict = valid && filter.evaluate(document);
+	verdicts.emplace_back(&filter, verdict);
+	return verdict;
+}
+
+// recursive descent, emits instructions in postfix order
+class ContentFilter::Parser {
+public:
+	Parser(std::string_view text, std::vector<Instruction>& program) : text(text), program(program) {}
+
+	auto parse() -> Error {
+		if(auto err = parseOr(0); err) {
+			return err;
+		}
+		skipSpace(text, offset);
+		return offset == text.size() ? nullptr : "Unexpected text after filter expression";
+	}
+private:
+	auto consume(std::string_view token) -> bool {
+		skipSpace(text, offset);
+		if(text.substr(offset).starts_with(token)) {
+			offset += token.size();
+			return true;
+		}
+		return false;
+	}
+
+	auto parseOr(size_t depth) -> Error {
+		if(auto err = parseAnd(depth); err) {
+			return err;
+		}
+		while(consume("||")) {
+			if(auto err = parseAnd(depth); err) {
+				return err;
+			}
+			program.push_back({.op = Op::Or});
+		}
+		return nullptr;
+	}
+
+	auto parseAnd(size_t depth) -> Error {
+		if(auto err = parseUnary(depth); err) {
+			return err;
+		}
+		while(consume("&&")) {
+			if(auto err = parseUnary(depth); err) {
+				return err;
+			}
+			program.push_back({.op = Op::And});
+		}
+		return nullptr;
+	}
+
+	auto parseUnary(size_t depth) -> Error {
+		if(depth > maxDepth) {
+			return "Filter expression nested too deeply";
+		}
+
+		if(consume("!")) {
+			if(auto err = parseUnary(depth + 1); err) {
+				return err;
+			}
+			program.push_back({.op = Op::Not});
+			return nullptr;
+		}
+
+		if(consume("(")) {
+			if(auto err = parseOr(depth + 1); err) {
+				return err;
+			}
+			return consume(")") ? nullptr : "Filter expression is missing a closing parenthesis";
+		}
+
+		return parseComparison();
+	}
+
+	auto parseComparison() -> Error {
+		skipSpace(text, offset);
+		size_t start = offset;
+		while(offset < text.size() && (std::isalnum(static_cast<unsigned char>(text[offset]))
+				|| text[offset] == '_' || text[offset] == '.' || text[offset] == '-')) {
+			offset++;
+		}
+		if(offset == start) {
+			return "Filter comparison is missing its field";
+		}
+
+		Instruction instruction = {
+			.path = std::string(text.substr(start, offset - start)),
+		};
+
+		// longer operators first so "<=" is not read as "<"
+		if(consume("==")) {
+			instruction.op = Op::Equal;
+		} else if(consume("!=")) {
+			instruction.op = Op::NotEqual;
+		} else if(consume("<=")) {
+			instruction.op = Op::LessEqual;
+		} else if(consume(">=")) {
+			instruction.op = Op::GreaterEqual;
+		} else if(consume("<")) {
+			instruction.op = Op::Less;
+		} else if(consume(">")) {
+			instruction.op = Op::Greater;
+		} else {
+			return "Filter comparison is missing its operator";
+		}
+
+		skipSpace(text, offset);
+		if(offset >= text.size()) {
+			return "Filter comparison is missing its value";
+		} else if(text[offset] == '"') {
+			std::string string;
+			if(!parseString(text, offset, string)) {
+				return "Unterminated string in filter expression";
+			}
+			instruction.literal = std::move(string);
+		} else if(text[offset] == '-' || std::isdigit(static_cast<unsigned char>(text[offset]))) {
+			double number;
+			if(!parseNumber(text, offset, number)) {
+				return "Malformed number in filter expression";
+			}
+			instruction.literal = number;
+		} else if(!parseKeyword(text, offset, instruction.literal)) {
+			return "Filter comparison is missing its value";
+		}
+
+		program.push_back(std::move(instruction));
+		return nullptr;
+	}
+
+	std::string_view text;
+	std::vector<Instruction>& program;
+	size_t offset = 0;
+};
+
+auto ContentFilter::compile(std::string_view expression)
+		-> std::tuple<std::shared_ptr<const ContentFilter>, Error> {
+	auto filter = std::make_shared<ContentFilter>();
+	filter->source = std::string(expression);
+
+	Parser parser(expression, filter->program);
+	if(auto err = parser.parse(); err) {
+		return {
+			nullptr,
+			err,
+		};
+	}
+
+	size_t depth = 0;
+	for(const auto& instruction : filter->program) {
+		if(instruction.op == Op::And || instruction.op == Op::Or) {
+			depth--;
+		} else if(instruction.op != Op::Not) {
+			depth++;
+		}
+
+		if(depth > maxStack) {
+			return {
+				nullptr,
+				"Filter expression has too many comparisons",
+			};
+		}
+	}
+
+	return {
+		filter,
+		nullptr,
+	};
+}
+
+auto ContentFilter::expression() const -> std::string_view {
+	return source;
+}
+
+// 0 less, 1 equal, 2 greater, 3 unequal but unordered, -1 missing or of another type
+static auto compare(const ContentFilter::Value* field, const ContentFilter::Value& literal) -> int {
+	if(field == nullptr || field->index() != literal.index()) {
+		return -1;
+	} else if(auto number = std::get_if<double>(field); number) {
+		auto other = std::get<double>(literal);
+		return *number < other ? 0 : (*number == other ? 1 : 2);
+	} else if(auto string = std::get_if<std::string>(field); string) {
+		auto order = string->compare(std::get<std::string>(literal));
+		return order < 0 ? 0 : (order == 0 ? 1 : 2);
+	} else if(auto flag = std::get_if<bool>(field); flag) {
+		return *flag == std::get<bool>(literal) ? 1 : 3;
+	}
+	// both null
+	return 1;
+}
+
+auto ContentFilter::evaluate(const Document& document) const -> bool {
+	uint64_t stack = 0;
+
+	for(const auto& instruction : program) {
+		switch(instruction.op) {
+			case Op::And:
+				stack = (stack >> 1) & (stack | ~uint64_t(1));
+				break;
+			case Op::Or:
+				stack = (stack >> 1) | (stack & 1);
+				break;
+			case Op::Not:
+				stack ^= 1;
+				break;
+			default: {
+				int order = compare(document.find(instruction.path), instruction.literal);
+				bool result = false;
+				switch(instruction.op) {
+					case Op::Equal: result = order == 1; break;
+					case Op::NotEqual: result = order == 0 || order == 2 || order == 3; break;
+					case Op::Less: result = order == 0; break;
+					case Op::LessEqual: result = order == 0 || order == 1; break;
+					case Op::Greater: result = order == 2; break;
+					case Op::GreaterEqual: result = order == 2 || order == 1; break;
+					default: break;
+				}
+				stack = stack << 1 | result;
+				break;
+			}
+		}
+	}
+
+	return stack & 1;
+}
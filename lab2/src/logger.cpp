@@ -0,0 +1,122 @@
+#include "logger.hpp"
+
+#include <poll.h>
+
+// how long a line may wait for the writer unless its ring fills up first
+constexpr int drainInterval = 10;
+
+thread_local Logger::Local Logger::current;
+
+Logger::Local::~Local() {
+	if(producer) {
+		producer->retired.store(true, std::memory_order_release);
+	}
+}
+
+Logger::Logger(std::ostream& output) : output(output) {}
+
+Logger::~Logger() {
+	close();
+}
+
+auto Logger::open() -> Error {
+	if(auto err = notifier.open(); err) {
+		return err;
+	}
+
+	writer = std::thread(&Logger::run, this);
+	accepting.store(true, std::memory_order_release);
+	return nullptr;
+}
+
+auto Logger::write(std::string line) -> void {
+	if(!accepting.load(std::memory_order_acquire)) {
+		output << line;
+		return;
+	}
+
+	auto& producer = local();
+	while(!producer.ring.tryPush(std::move(line))) {
+		if(stopping.load(std::memory_order_relaxed)) {
+			output << line;
+			return;
+		}
+		notifier.notify();
+		std::this_thread::yield();
+	}
+}
+
+auto Logger::close() -> void {
+	if(!writer.joinable()) {
+		return;
+	}
+
+	accepting.store(false);
+	stopping.store(true);
+	notifier.notify();
+	writer.join();
+}
+
+auto Logger::local() -> Producer& {
+	if(current.owner != this) {
+		auto producer = std::make_shared<Producer>();
+		producersMutex.lock();
+		producers.push_back(producer);
+		producersMutex.unlock();
+
+		if(current.producer) {
+			current.producer->retired.store(true, std::memory_order_release);
+		}
+		current.owner = this;
+		current.producer = std::move(producer);
+	}
+	return *current.producer;
+}
+
+auto Logger::run() -> void {
+	pollfd fd = {
+		.fd = notifier.descriptor(),
+		.events = POLLIN,
+	};
+
+	while(true) {
+		bool stopped = stopping.load();
+		drain();
+		if(stopped) {
+			return;
+		}
+
+		if(poll(&fd, 1, drainInterval) > 0) {
+			notifier.acknowledge();
+		}
+	}
+}
+
+auto Logger::drain() -> void {
+	producersMutex.lock();
+	auto active = producers;
+	producersMutex.unlock();
+
+	std::string batch;
+	bool anyRetired = false;
+	for(auto& producer : active) {
+		// read before draining, so a retired ring is known to hold its last line already
+		bool retired = producer->retired.load(std::memory_order_acquire);
+		producer->ring.popBatch([&batch](std::string&& line) {
+			batch += line;
+		});
+		anyRetired = anyRetired || retired;
+	}
+
+	if(anyRetired) {
+		producersMutex.lock();
+		std::erase_if(producers, [](const std::shared_ptr<Producer>& producer) {
+			return producer->retired.load(std::memory_order_acquire) && producer->ring.empty();
+		});
+		producersMutex.unlock();
+	}
+
+	if(!batch.empty()) {
+		output.write(batch.data(), batch.size());
+	}
+}
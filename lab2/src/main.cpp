@@ -1,5 +1,129 @@
 #include "mqtt_broker.hpp"
 
-auto main() -> int {
-	MqttBroker().serve();
+#include <csignal>
+#include <string>
+#include <string_view>
+
+auto main(int argc, char** argv) -> int {
+	MqttBroker::Config config;
+	bool upgrade = false;
+
+	for(int i = 1; i < argc; i++) {
+		auto arg = std::string_view(argv[i]);
+		if(arg == "--upgrade") {
+			upgrade = true;
+		} else if(arg == "--port" && i + 1 < argc) {
+			config.port = static_cast<uint16_t>(std::stoul(argv[++i]));
+		} else if(arg == "--upgrade-path" && i + 1 < argc) {
+			config.upgradePath = argv[++i];
+		} else if(arg == "--max-connections" && i + 1 < argc) {
+			config.maxConnections = std::stoul(argv[++i]);
+		} else if(arg == "--accept-batch" && i + 1 < argc) {
+			config.acceptBatch = std::stoul(argv[++i]);
+		} else if(arg == "--connect-rate" && i + 1 < argc) {
+			config.connectRate = std::stod(argv[++i]);
+		} else if(arg == "--connect-burst" && i + 1 < argc) {
+			config.connectBurst = std::stod(argv[++i]);
+		} else if(arg == "--large-payload-threshold" && i + 1 < argc) {
+			config.largePayloadThreshold = std::stoul(argv[++i]);
+		} else if(arg == "--max-packet-size" && i + 1 < argc) {
+			config.maxPacketSize = std::stoul(argv[++i]);
+		} else if(arg == "--offline-memory" && i + 1 < argc) {
+			config.offlineMemoryLimit = std::stoul(argv[++i]);
+		} else if(arg == "--offline-directory" && i + 1 < argc) {
+			config.offlineDirectory = argv[++i];
+		} else if(arg == "--offline-segment-size" && i + 1 < argc) {
+			config.offlineSegmentSize = std::stoul(argv[++i]);
+		} else if(arg == "--replay-window" && i + 1 < argc) {
+			config.replayWindow = std::stoul(argv[++i]);
+		} else if(arg == "--wal-directory" && i + 1 < argc) {
+			config.walDirectory = argv[++i];
+		} else if(arg == "--wal-segment-size" && i + 1 < argc) {
+			config.walSegmentSize = std::stoul(argv[++i]);
+		} else if(arg == "--wal-commit-delay" && i + 1 < argc) {
+			config.walCommitDelay = std::chrono::microseconds(std::stoul(argv[++i]));
+		} else if(arg == "--wal-commit-bytes" && i + 1 < argc) {
+			config.walCommitBytes = std::stoul(argv[++i]);
+		} else if(arg == "--retention-filter" && i + 1 < argc) {
+			config.retentionFilters.push_back(argv[++i]);
+		} else if(arg == "--retention-directory" && i + 1 < argc) {
+			config.retentionDirectory = argv[++i];
+		} else if(arg == "--retention-period" && i + 1 < argc) {
+			config.retentionPeriod = std::chrono::seconds(std::stoul(argv[++i]));
+		} else if(arg == "--retention-segment-size" && i + 1 < argc) {
+			config.retentionSegmentSize = std::stoul(argv[++i]);
+		} else if(arg == "--retention-index-interval" && i + 1 < argc) {
+			config.retentionIndexInterval = std::stoul(argv[++i]);
+		} else if(arg == "--client-publish-rate" && i + 1 < argc) {
+			config.clientPublishRate = std::stod(argv[++i]);
+		} else if(arg == "--client-publish-burst" && i + 1 < argc) {
+			config.clientPublishBurst = std::stod(argv[++i]);
+		} else if(arg == "--client-byte-rate" && i + 1 < argc) {
+			config.clientByteRate = std::stod(argv[++i]);
+		} else if(arg == "--client-byte-burst" && i + 1 < argc) {
+			config.clientByteBurst = std::stod(argv[++i]);
+		} else if(arg == "--topic-limit" && i + 3 < argc) {
+			config.topicLimits.push_back({
+				.filter = argv[i + 1],
+				.publishRate = std::stod(argv[i + 2]),
+				.byteRate = std::stod(argv[i + 3]),
+			});
+			i += 3;
+		} else if(arg == "--consumer-check-interval" && i + 1 < argc) {
+			config.consumerCheckInterval = std::chrono::milliseconds(std::stoul(argv[++i]));
+		} else if(arg == "--consumer-warn-bytes" && i + 1 < argc) {
+			config.consumerWarnBytes = std::stoul(argv[++i]);
+		} else if(arg == "--consumer-conflate-bytes" && i + 1 < argc) {
+			config.consumerConflateBytes = std::stoul(argv[++i]);
+		} else if(arg == "--consumer-disconnect-bytes" && i + 1 < argc) {
+			config.consumerDisconnectBytes = std::stoul(argv[++i]);
+		} else if(arg == "--consumer-max-age" && i + 1 < argc) {
+			config.consumerMaxAge = std::chrono::milliseconds(std::stoul(argv[++i]));
+		} else if(arg == "--consumer-report-count" && i + 1 < argc) {
+			config.consumerReportCount = std::stoul(argv[++i]);
+		} else if(arg == "--not-sent-lowat" && i + 1 < argc) {
+			config.notSentLowWatermark = std::stoul(argv[++i]);
+		} else if(arg == "--bridge" && i + 2 < argc) {
+			auto address = argv[++i];
+			config.bridges.push_back({
+				.address = address,
+				.port = static_cast<uint16_t>(std::stoul(argv[++i])),
+			});
+		} else if(arg == "--bridge-name" && i + 1 < argc) {
+			config.bridgeName = argv[++i];
+		} else if((arg == "--service-cpus" || arg == "--connection-cpus" || arg == "--log-cpus") && i + 1 < argc) {
+			auto [cpus, err] = Affinity::parse(argv[++i]);
+			validate(err);
+			auto& target = arg == "--service-cpus" ? config.serviceCpus 
+				: arg == "--connection-cpus" ? config.connectionCpus : config.logCpus;
+			target = cpus;
+		} else if(arg == "--bridge-keep-alive" && i + 1 < argc) {
+			config.bridgeKeepAlive = static_cast<uint16_t>(std::stoul(argv[++i]));
+		} else {
+			std::cerr << "Usage: " << argv[0] << " [--upgrade] [--port n] [--upgrade-path path]"
+				<< " [--max-connections n] [--accept-batch n] [--connect-rate n] [--connect-burst n]"
+				<< " [--large-payload-threshold bytes] [--max-packet-size bytes] [--offline-memory bytes] [--offline-directory path]"
+				<< " [--offline-segment-size bytes] [--replay-window bytes] [--wal-directory path]"
+				<< " [--wal-segment-size bytes] [--wal-commit-delay us] [--wal-commit-bytes bytes]"
+				<< " [--retention-filter filter]... [--retention-directory path] [--retention-period seconds]"
+				<< " [--retention-segment-size bytes] [--retention-index-interval bytes]"
+				<< " [--client-publish-rate n] [--client-publish-burst n] [--client-byte-rate n] [--client-byte-burst n]"
+				<< " [--topic-limit filter publishes bytes]... [--consumer-check-interval ms]"
+				<< " [--consumer-warn-bytes n] [--consumer-conflate-bytes n] [--consumer-disconnect-bytes n]"
+				<< " [--consumer-max-age ms] [--consumer-report-count n]"
+				<< " [--not-sent-lowat bytes] [--bridge address port]... [--bridge-name name]"
+				<< " [--bridge-keep-alive seconds] [--service-cpus list] [--connection-cpus list]"
+				<< " [--log-cpus list]\n";
+			return EXIT_FAILURE;
+		}
+	}
+
+	// a subscriber hanging up mid write must fail the write, not end the process
+	std::signal(SIGPIPE, SIG_IGN);
+
+	MqttBroker broker(config);
+	if(upgrade) {
+		validate(broker.takeOver());
+	}
+	broker.serve();
 }
@@ -0,0 +1,404 @@
+#include "mqtt_broker.hpp"
+
+#include <algorithm>
+#include <charconv>
+#include <cinttypes>
+
+// Bridges: links between brokers at different sites. A link is an ordinary
+// MQTT connection whose client identifier starts with $bridge/, and either end
+// sends the other a SUBSCRIBE for every filter subscribed on its side and an
+// UNSUBSCRIBE once nobody is left, so a publish only crosses a link when the
+// far side wants it. Forwarded publishes are queued in the link's outbox like
+// any subscriber's: they leave in large coalesced writes and never wait for
+// acknowledgements, so the link's round trip time does not limit throughput.
+//
+// The accepting end answers the CONNACK with a hello naming itself, so both
+// ends know a link by the name of the broker on the other end. Two brokers
+// that list each other end up with one link, the one dialed by the smaller
+// name. Nothing is sent back over the link it arrived on, which is enough on
+// a tree; for anything else every publish crosses links stamped with the
+// broker it was first published to and that broker's count, and a broker
+// drops the copies it has already seen and its own coming back. In a ring
+// interest can outlive the last subscriber, since every broker on it keeps
+// advertising what the others advertised to it; the traffic that draws is
+// still delivered once.
+
+using namespace std::chrono_literals;
+
+constexpr auto minBackoff = 1s;
+constexpr auto maxBackoff = 60s;
+constexpr auto livenessInterval = 1s;
+// copies of one publish come around a ring within this many publishes from the same origin
+constexpr size_t recentStampCount = 64 * 1024;
+// stamped topics start with origin and sequence as 16 hex digits each and a slash
+constexpr size_t stampLength = 2 * 16 + 1;
+
+auto MqttBroker::runBridge(Config::Bridge bridge) -> void {
+	auto route = bridge.address + ":" + std::to_string(bridge.port);
+	// known once the peer introduced itself
+	std::string identifier;
+	TokenBucket::Clock::duration backoff = minBackoff;
+	// pings go out at half the keep-alive the peer was promised
+	auto pingInterval = std::chrono::seconds(std::max<uint16_t>(config.bridgeKeepAlive, 2) / 2);
+
+	Mqtt::Message ping = {
+		.type = Mqtt::Pingreq,
+		.level = Mqtt::Lv0,
+		.duplicate = false,
+		.retain = false,
+		.content = {},
+	};
+	auto pingPacket = Outbox::share(Mqtt::encode(ping));
+
+	while(true) {
+		// a link handed over by the previous broker process, or one the peer dialed, is adopted rather than dialed
+		std::shared_ptr<Outbox> outbox;
+		clientsMutex.lock();
+		for(const auto& session : bridgeSessions) {
+			if(session->identifier == identifier || session->route == route) {
+				session->route = route;
+				identifier = session->identifier;
+				outbox = session->outbox;
+				break;
+			}
+		}
+		clientsMutex.unlock();
+
+		if(!outbox) {
+			auto [client, name, err] = connectBridge(bridge);
+			if(err) {
+				std::cerr << "Bridge to " << route << ": " << err << '\n';
+				if(!awaitDelay(backoff)) {
+					park();
+				}
+				backoff = std::min<TokenBucket::Clock::duration>(backoff * 2, maxBackoff);
+				continue;
+			}
+			backoff = minBackoff;
+			identifier = std::string(bridgePrefix) + name;
+
+			if(config.notSentLowWatermark > 0) {
+				client.setNotSentLowWatermark(config.notSentLowWatermark);
+			}
+
+			std::shared_ptr<Outbox> previous;
+			clientsMutex.lock();
+			auto& session = sessions[identifier];
+			// of two links between the same brokers the one dialed by the smaller name stays
+			if(session && session->outbox && (session->dialed || name < config.bridgeName)) {
+				session->route = route;
+				outbox = session->outbox;
+				clientsMutex.unlock();
+
+				client.close();
+				std::cout << "Bridge to " << route << " shares the link with " << name << '\n';
+			} else {
+				if(session) {
+					previous = session->outbox;
+					discardSession(session);
+				}
+
+				outbox = std::make_shared<Outbox>(client);
+				session = makeSession(identifier, false);
+				session->outbox = outbox;
+				session->socket = client;
+				session->dialed = true;
+				session->route = route;
+				bridgeSessions.insert(session);
+
+				clients[client] = std::make_shared<Client>(Client{
+					.socket = client,
+					.identifier = identifier,
+					.keepAlive = config.bridgeKeepAlive,
+					.outbox = outbox,
+					.session = session,
+				});
+
+				advertiseInterest();
+				clientsMutex.unlock();
+
+				if(previous) {
+					previous->close();
+				}
+
+				std::cout << "Bridged to " << route << ", " << name << '\n';
+				// the peer's traffic is served like any client's
+				spawnClient(client, true);
+			}
+		}
+
+		auto lastPing = TokenBucket::Clock::now();
+		while(true) {
+			if(!awaitDelay(livenessInterval)) {
+				park();
+				continue;
+			}
+
+			// the link's session thread drops it once nothing, not even a PINGRESP, arrived for
+			// one and a half keep-alive periods, the link is dialed anew from here
+			clientsMutex.lock();
+			auto it = sessions.find(identifier);
+			bool alive = it != sessions.end() && it->second->outbox == outbox;
+			clientsMutex.unlock();
+
+			if(!alive) {
+				std::cerr << "Bridge to " << route << " lost\n";
+				break;
+			}
+
+			// a link the peer dialed is pinged by the peer, pinging it from here as well does no harm
+			if(TokenBucket::Clock::now() - lastPing >= pingInterval) {
+				outbox->pushControl(pingPacket);
+				lastPing = TokenBucket::Clock::now();
+			}
+		}
+	}
+}
+
+auto MqttBroker::connectBridge(const Config::Bridge& bridge) -> std::tuple<UnixTcpSocket, std::string, Error> {
+	auto [client, err] = UnixTcpSocket::create();
+	if(err) {
+		return {
+			client,
+			{},
+			err,
+		};
+	}
+
+	auto fail = [&](Error err) -> std::tuple<UnixTcpSocket, std::string, Error> {
+		client.close();
+		return {
+			client,
+			{},
+			err,
+		};
+	};
+
+	if(err = client.connect(bridge.address, bridge.port); err) {
+		return fail(err);
+	}
+
+	auto identifier = std::string(bridgePrefix) + config.bridgeName;
+	Mqtt::Message connect = {
+		.type = Mqtt::Connect,
+		.level = Mqtt::Lv0,
+		.duplicate = false,
+		.retain = false,
+		.content = Mqtt::ConnectHeader{
+			.protocol = "MQTT",
+			.identifier = std::pmr::string(identifier),
+			.keepAlive = config.bridgeKeepAlive,
+			.version = 4,
+			.flags = Mqtt::CleanSession,
+		},
+	};
+
+	if(err = client.writeAll(Mqtt::encode(connect)); err) {
+		return fail(err);
+	}
+
+	// a peer that takes longer than a keep-alive period and a half to answer counts as gone
+	auto expiry = TokenBucket::Clock::now() + std::chrono::milliseconds(std::max<uint16_t>(config.bridgeKeepAlive, 1) * 1500);
+	if(!awaitReadable(client.descriptor(), expiry)) {
+		return fail(TokenBucket::Clock::now() < expiry ? "Interrupted by a handoff" : "Peer did not answer in time");
+	}
+
+	// a session thread of its own reads on after the hello, nothing past it may be taken here
+	BufferedReader reader(client, 0);
+	auto [message, messageBytes, decodeErr] = Mqtt::decode(reader, std::pmr::get_default_resource(), 0, config.maxPacketSize);
+	if(decodeErr) {
+		return fail(decodeErr);
+	}
+
+	auto connack = std::get_if<Mqtt::ConnackHeader>(&message.content);
+	if(message.type != Mqtt::Connack || connack == nullptr) {
+		return fail("Peer did not answer with a CONNACK");
+	} else if(connack->code != 0x00) {
+		std::cerr << "CONNACK code " << static_cast<int>(connack->code) << '\n';
+		return fail("Peer refused the bridge");
+	}
+
+	auto [hello, helloBytes, helloErr] = Mqtt::decode(reader, std::pmr::get_default_resource(), 0, config.maxPacketSize);
+	if(helloErr) {
+		return fail(helloErr);
+	}
+
+	auto publish = std::get_if<Mqtt::PublishHeader>(&hello.content);
+	if(hello.type != Mqtt::Publish || publish == nullptr || publish->topic != bridgeHello || publish->payload.empty()) {
+		return fail("Peer did not introduce itself");
+	} else if(std::string_view(publish->payload) == config.bridgeName) {
+		return fail("Bridge leads back to this broker");
+	}
+
+	return {
+		client,
+		std::string(publish->payload),
+		nullptr,
+	};
+}
+
+auto MqttBroker::keepsDialedLink(std::string_view identifier) -> bool {
+	std::lock_guard lock(clientsMutex);
+	auto it = sessions.find(std::string(identifier));
+	return it != sessions.end() && it->second->outbox && it->second->dialed
+		&& std::string_view(config.bridgeName) < identifier.substr(bridgePrefix.size());
+}
+
+auto MqttBroker::encodeHello() const -> Bytes {
+	Mqtt::Message hello = {
+		.type = Mqtt::Publish,
+		.level = Mqtt::Lv0,
+		.duplicate = false,
+		.retain = false,
+	};
+	hello.content.emplace<Mqtt::PublishHeader>(Mqtt::PublishHeader{
+		.topic = std::pmr::string(bridgeHello),
+		.payload = std::pmr::string(config.bridgeName),
+	});
+	return Mqtt::encode(hello);
+}
+
+// FNV-1a, every broker has to arrive at the same value for a name
+auto MqttBroker::originOf(std::string_view bridgeName) -> uint64_t {
+	uint64_t hash = 0xcbf29ce484222325;
+	for(unsigned char c : bridgeName) {
+		hash ^= c;
+		hash *= 0x100000001b3;
+	}
+	return hash;
+}
+
+auto MqttBroker::nextStamp() -> Stamp {
+	return {
+		.origin = bridgeOrigin,
+		.sequence = bridgeSequence.fetch_add(1, std::memory_order_relaxed),
+	};
+}
+
+auto MqttBroker::stamped(const Mqtt::Message& message, Stamp stamp) -> Mqtt::Message {
+	auto copy = message;
+	auto& publish = std::get<Mqtt::PublishHeader>(copy.content);
+
+	char digits[stampLength + 1];
+	snprintf(digits, sizeof digits, "%016" PRIx64 "%016" PRIx64 "/", stamp.origin, stamp.sequence);
+	publish.topic.insert(0, digits, stampLength);
+	publish.topic.insert(0, bridgePrefix);
+	return copy;
+}
+
+auto MqttBroker::unstamp(Mqtt::Message& message) -> std::tuple<Stamp, bool> {
+	auto& publish = std::get<Mqtt::PublishHeader>(message.content);
+	std::string_view topic = publish.topic;
+
+	Stamp stamp = {};
+	bool valid = topic.starts_with(bridgePrefix) && topic.size() > bridgePrefix.size() + stampLength
+		&& topic[bridgePrefix.size() + stampLength - 1] == '/';
+	if(valid) {
+		auto digits = topic.data() + bridgePrefix.size();
+		auto [originEnd, originEc] = std::from_chars(digits, digits + 16, stamp.origin, 16);
+		auto [sequenceEnd, sequenceEc] = std::from_chars(digits + 16, digits + 32, stamp.sequence, 16);
+		valid = originEc == std::errc() && originEnd == digits + 16 
+			&& sequenceEc == std::errc() && sequenceEnd == digits + 32;
+	}
+
+	// a peer that does not stamp its publishes is treated like a client of this broker
+	if(!valid) {
+		return {
+			nextStamp(),
+			true,
+		};
+	}
+
+	publish.topic.erase(0, bridgePrefix.size() + stampLength);
+	if(auto err = Mqtt::validateTopic(publish.topic, false, &publish.levels); err || stamp.origin == bridgeOrigin) {
+		return {
+			stamp,
+			false,
+		};
+	}
+
+	std::lock_guard lock(stampsMutex);
+	auto& recent = recentStamps[stamp.origin];
+	if(!recent.sequences.insert(stamp.sequence).second) {
+		return {
+			stamp,
+			false,
+		};
+	}
+
+	recent.order.push_back(stamp.sequence);
+	if(recent.order.size() > recentStampCount) {
+		recent.sequences.erase(recent.order.front());
+		recent.order.pop_front();
+	}
+
+	return {
+		stamp,
+		true,
+	};
+}
+
+auto MqttBroker::advertiseInterest() -> void {
+	for(const auto& bridge : bridgeSessions) {
+		// everything subscribed on this side of the link, minus the link's own subscriptions;
+		// $ topics belong to the broker that publishes them and never cross
+		std::map<std::string_view, Mqtt::QosLevel> wanted;
+		for(const auto& [filter, set] : subscriptions) {
+			if(filter.starts_with('$')) {
+				continue;
+			}
+
+			for(const auto& sub : set) {
+				if(sub.session != bridge) {
+					auto [it, inserted] = wanted.emplace(filter, sub.level);
+					it->second = std::max(it->second, sub.level);
+				}
+			}
+		}
+
+		Mqtt::SubscribeHeader subscribe = {};
+		for(const auto& [filter, level] : wanted) {
+			auto it = bridge->advertised.find(filter);
+			if(it == bridge->advertised.end() || it->second != level) {
+				subscribe.topics.emplace_back(filter);
+				subscribe.levels.push_back(level);
+				bridge->advertised.insert_or_assign(std::string(filter), level);
+			}
+		}
+
+		Mqtt::UnsubscribeHeader unsubscribe = {};
+		for(auto it = bridge->advertised.begin(); it != bridge->advertised.end();) {
+			if(wanted.contains(it->first)) {
+				it++;
+				continue;
+			}
+
+			unsubscribe.topics.emplace_back(it->first);
+			it = bridge->advertised.erase(it);
+		}
+
+		if(!subscribe.topics.empty()) {
+			subscribe.id = bridge->nextId;
+			bridge->nextId = bridge->nextId % 65535 + 1;
+			bridge->outbox->pushControl(Outbox::share(Mqtt::encode({
+				.type = Mqtt::Subscribe,
+				.level = Mqtt::Lv1,
+				.duplicate = false,
+				.retain = false,
+				.content = std::move(subscribe),
+			})));
+		}
+
+		if(!unsubscribe.topics.empty()) {
+			unsubscribe.id = bridge->nextId;
+			bridge->nextId = bridge->nextId % 65535 + 1;
+			bridge->outbox->pushControl(Outbox::share(Mqtt::encode({
+				.type = Mqtt::Unsubscribe,
+				.level = Mqtt::Lv1,
+				.duplicate = false,
+				.retain = false,
+				.content = std::move(unsubscribe),
+			})));
+		}
+	}
+}
@@ -1,125 +1,560 @@
 #include "mqtt_broker.hpp"
 
+#include <chrono>
+#include <filesystem>
 #include <thread>
 
+#include <poll.h>
+#include <sys/eventfd.h>
+#include <unistd.h>
+
 #include "mqtt.hpp"
 #include "unix_tcp_socket.hpp"
 
+MqttBroker::MqttBroker(Config config) 
+	: config(config), admission(config.connectRate, config.connectBurst) {
+	for(const auto& limit : config.topicLimits) {
+		topicLimiters.emplace_back(limit);
+	}
+
+	for(int cpu : config.connectionCpus) {
+		int node = Affinity::nodeOf(cpu);
+		for(int other : config.connectionCpus) {
+			if(other == cpu || (node >= 0 && Affinity::nodeOf(other) == node)) {
+				connectionPlacement[cpu].push_back(other);
+			}
+		}
+	}
+
+	if(this->config.bridgeName.empty()) {
+		char host[256] = {};
+		gethostname(host, sizeof(host) - 1);
+		this->config.bridgeName = std::string(host) + ":" + std::to_string(config.port);
+	}
+
+	// a restarted broker must not reuse the sequence numbers peers still remember
+	bridgeOrigin = originOf(this->config.bridgeName);
+	bridgeSequence = std::chrono::duration_cast<std::chrono::nanoseconds>(
+			std::chrono::system_clock::now().time_since_epoch()).count();
+}
+
+// shorter than the handoff waits for every thread to park
+constexpr auto handoffGrace = std::chrono::seconds(5);
+
 auto MqttBroker::serve() -> void {
-	auto [listener, err ] = UnixTcpSocket::create();
-	validate(err);
+	// threads started from here inherit the mask, connections move themselves afterwards
+	if(auto err = Affinity::pin(config.serviceCpus); err) {
+		std::cerr << err << '\n';
+	}
+
+	if(listener.descriptor() < 0) {
+		auto [socket, err] = UnixTcpSocket::create();
+		validate(err);
+		listener = socket;
+
+		//https://mqtt.org/faq/
+		err = listener.listen(config.port);
+		validate(err);
+	}
 
-	//https://mqtt.org/faq/
-	err = listener.listen(1883);
-	validate(err);
+	validate(listener.setNonBlocking(true));
+
+	// recovered sessions may spill their queues right away
+	std::error_code ec;
+	std::filesystem::create_directories(config.offlineDirectory, ec);
+	if(ec) {
+		std::cerr << "Offline queues cannot spill to disk: " << ec.message() << '\n';
+	}
+
+	if(!wal) {
+		validate(openLog(true));
+	}
+	validate(logger.open());
+
+	if(topicLogs.empty()) {
+		validate(openTopicLogs());
+	}
+
+	if(wakeFd < 0) {
+		wakeFd = eventfd(0, EFD_CLOEXEC);
+	}
+
+	std::thread upgradeThread(&MqttBroker::listenForUpgrades, this);
+	upgradeThread.detach();
+
+	handoffMutex.lock();
+	running++;
+	handoffMutex.unlock();
+	std::thread monitorThread(&MqttBroker::monitorConsumers, this);
+	monitorThread.detach();
+
+	for(const auto& bridge : config.bridges) {
+		handoffMutex.lock();
+		running++;
+		handoffMutex.unlock();
+		std::thread bridgeThread(&MqttBroker::runBridge, this, bridge);
+		bridgeThread.detach();
+	}
+
+	handoffMutex.lock();
+	running++;
+	handoffMutex.unlock();
 
 	while(true) {
-		auto [client, err] = listener.accept();
+		awaitCapacity();
+
+		if(!awaitReadable(listener.descriptor())) {
+			park();
+			continue;
+		}
+
+		size_t batch = config.acceptBatch;
+		if(config.maxConnections > 0) {
+			handoffMutex.lock();
+			batch = std::min(batch, config.maxConnections - std::min(connections, config.maxConnections));
+			handoffMutex.unlock();
+		}
+
+		auto [accepted, err] = listener.acceptBatch(batch);
 		if(err) {
 			std::cerr << err << '\n';
-		} else {
-			std::thread thread(&MqttBroker::handleClient, this, client);
-			thread.detach();
+		}
+
+		for(auto client : accepted) {
+			spawnClient(client, false);
 		}
 	}
 }
 
-auto MqttBroker::handleClient(UnixTcpSocket client) -> void {
-	auto [message, messageBytes, error] = Mqtt::decode(client);
+auto MqttBroker::awaitCapacity() -> void {
+	if(config.maxConnections == 0) {
+		return;
+	}
+
+	// leaving connections in the backlog lets the kernel push back on reconnect storms
+	std::unique_lock lock(handoffMutex);
+	handoffCondition.wait(lock, [this]() {
+		return draining || connections < config.maxConnections;
+	});
+}
+
+auto MqttBroker::spawnClient(UnixTcpSocket client, bool resumed) -> void {
+	handoffMutex.lock();
+	running++;
+	connections++;
+	handoffMutex.unlock();
+
+	std::thread thread(&MqttBroker::handleClient, this, client, resumed);
+	thread.detach();
+}
+
+auto MqttBroker::handleClient(UnixTcpSocket client, bool resumed) -> void {
+	placeConnection(client);
+
+	// the session goes on reading wherever the CONNECT ended, buffered bytes included;
+	// a peer that stops mid packet or before its CONNECT is dropped rather than hold up a handoff
+	BufferedReader reader(client);
+	reader.interruptBy(wakeFd, handoffGrace);
+	if(resumed || handleConnect(reader)) {
+		handleSession(reader);
+	}
+
+	handoffMutex.lock();
+	running--;
+	connections--;
+	handoffMutex.unlock();
+	handoffCondition.notify_all();
+}
+
+auto MqttBroker::placeConnection(UnixTcpSocket client) -> void {
+	if(config.connectionCpus.empty()) {
+		return;
+	}
+
+	// the node whose CPU handles the socket's receive path already holds its packets
+	auto it = connectionPlacement.find(client.incomingCpu());
+	if(it == connectionPlacement.end()) {
+		int cpu = config.connectionCpus[nextPlacement++ % config.connectionCpus.size()];
+		it = connectionPlacement.find(cpu);
+	}
+
+	if(auto err = Affinity::pin(it->second); err) {
+		std::cerr << err << '\n';
+	}
+}
+
+auto MqttBroker::handleConnect(BufferedReader& reader) -> bool {
+	auto client = reader.socket();
+	auto [message, messageBytes, error] = Mqtt::decode(reader, std::pmr::get_default_resource(), 0, config.maxPacketSize);
 	if(error) {
 		std::cerr << error << '\n';
-		return;
+		client.close();
+		return false;
 	}
 
-	if(auto connect = std::get_if<Mqtt::ConnectHeader>(&message.content); connect) {
-		
-		Mqtt::Message response = {
-			.type = Mqtt::Connack,
-			.level = Mqtt::Lv0,
-			.duplicate = false,
-			.retain = false,
-		};
+	auto connect = std::get_if<Mqtt::ConnectHeader>(&message.content);
+	if(connect == nullptr || message.type != Mqtt::Connect) {
+		std::cerr << "Malformed client connection attempt\n";
+		client.close();
+		return false;
+	}
 
-		if(connect->protocol != "MQTT") {
-			// unknown protocol
-			response.content = Mqtt::ConnackHeader{
-				.code = 0x02,
-			};
-		} else if(connect->version != 4) {
-			// unknown protocol version
-			response.content = Mqtt::ConnackHeader{
-				.code = 0x01,
-			};
-		} else {
-			// success
-			std::cout << "New client: " << message << '\n';
-			response.content = Mqtt::ConnackHeader{
-				.code = 0x00,
-			};
-		}
+	Mqtt::Message response = {
+		.type = Mqtt::Connack,
+		.level = Mqtt::Lv0,
+		.duplicate = false,
+		.retain = false,
+	};
 
+	bool persistent = !(connect->flags & Mqtt::CleanSession);
+	if(!admission.tryTake()) {
+		// server unavailable, the client retries with its own backoff
+		response.content = Mqtt::ConnackHeader{
+			.code = 0x03,
+		};
+	} else if(connect->protocol != "MQTT") {
+		// unknown protocol
+		response.content = Mqtt::ConnackHeader{
+			.code = 0x02,
+		};
+	} else if(connect->version != 4) {
+		// unknown protocol version
+		response.content = Mqtt::ConnackHeader{
+			.code = 0x01,
+		};
+	} else if(connect->identifier.empty() && persistent) {
+		// identifier rejected, a persistent session has to be found again by name
+		response.content = Mqtt::ConnackHeader{
+			.code = 0x02,
+		};
+	} else if(connect->identifier.starts_with(bridgePrefix) 
+			&& std::string_view(connect->identifier).substr(bridgePrefix.size()) == config.bridgeName) {
+		// a bridge that leads back to this broker
+		std::cerr << "Refused a bridge from this broker to itself\n";
+		response.content = Mqtt::ConnackHeader{
+			.code = 0x02,
+		};
+	} else if(connect->identifier.starts_with(bridgePrefix) && keepsDialedLink(connect->identifier)) {
+		// this broker's own link to the peer stays, the peer learns who answered and adopts that one
+		response.content = Mqtt::ConnackHeader{
+			.code = 0x00,
+		};
 		auto bytes = Mqtt::encode(response);
-		client.write(bytes);
+		auto hello = encodeHello();
+		bytes.insert(bytes.end(), hello.begin(), hello.end());
+		client.writeAll(bytes);
+		client.close();
+		return false;
 	} else {
-		std::cerr << "Malformed client connection attempt\n";
-		return;
+		logger.print("New client: ", message);
+		acceptClient(client, *connect, persistent);
+		return true;
+	}
+
+	client.writeAll(Mqtt::encode(response));
+	client.close();
+	return false;
+}
+
+auto MqttBroker::acceptClient(UnixTcpSocket client, const Mqtt::ConnectHeader& connect, bool persistent) -> void {
+	if(config.notSentLowWatermark > 0) {
+		if(auto err = client.setNotSentLowWatermark(config.notSentLowWatermark); err) {
+			std::cerr << err << '\n';
+		}
+	}
+
+	auto outbox = std::make_shared<Outbox>(client);
+	auto identifier = connect.identifier.empty() 
+		? "anonymous-" + std::to_string(client.descriptor()) : std::string(connect.identifier);
+
+	std::shared_ptr<Outbox> previous;
+	clientsMutex.lock();
+
+	auto& session = sessions[identifier];
+	if(session && session->outbox) {
+		// a second connection with the same identifier takes the session over
+		previous = session->outbox;
+	}
+
+	bool present = persistent && session && session->persistent;
+	if(!present) {
+		if(session) {
+			logForgotten(*session);
+			discardSession(session);
+		}
+		session = makeSession(identifier, persistent);
+	}
+
+	session->outbox = outbox;
+	session->socket = client;
+	session->replaying = present && !session->queue->empty();
+	if(session->bridge) {
+		session->advertised.clear();
+		bridgeSessions.insert(session);
+	}
+	logSession(*session);
+
+	clients[client] = std::make_shared<Client>(Client{
+		.socket = client,
+		.identifier = identifier,
+		.keepAlive = connect.keepAlive,
+		.outbox = outbox,
+		.session = session,
+	});
+
+	Mqtt::Message response = {
+		.type = Mqtt::Connack,
+		.level = Mqtt::Lv0,
+		.duplicate = false,
+		.retain = false,
+		.content = Mqtt::ConnackHeader{
+			.code = 0x00,
+			.sessionPresent = present,
+		},
 	};
 
+	// the control lane is written first, so nothing routed to a resumed session can overtake the CONNACK
+	outbox->pushControl(Outbox::share(Mqtt::encode(response)));
+	if(session->bridge) {
+		outbox->pushControl(Outbox::share(encodeHello()));
+	}
+	if(session->replaying) {
+		spawnReplay(session);
+	}
+
+	// a new bridge learns what this side wants, a replaced session may have taken subscriptions with it
+	advertiseInterest();
+
+	clientsMutex.unlock();
+
+	if(previous) {
+		previous->close();
+	}
+}
+
+// reads a payload nobody is going to get past
+static auto skipPayload(BufferedReader& reader, size_t length) -> Error {
+	Byte scratch[4096];
+	while(length > 0) {
+		auto chunk = std::min(length, sizeof scratch);
+		if(auto err = reader.readExact(scratch, chunk); err) {
+			return err;
+		}
+		length -= chunk;
+	}
+	return nullptr;
+}
+
+auto MqttBroker::handleSession(BufferedReader& reader) -> void {
+	// everything decoded from one packet lives here until the packet is dispatched
+	Arena arena;
+	auto client = reader.socket();
+
+	clientsMutex.lock();
+	auto outbox = clients[client]->outbox;
+	auto session = clients[client]->session;
+	// a client silent for one and a half keep-alive periods is gone, zero turns the check off
+	auto keepAlive = std::chrono::milliseconds(clients[client]->keepAlive * 1500);
+	clientsMutex.unlock();
+	auto lastPacket = TokenBucket::Clock::now();
+
+	// bursts default to one second's worth
+	TokenBucket publishLimit(config.clientPublishRate, 
+			config.clientPublishBurst > 0.0 ? config.clientPublishBurst : config.clientPublishRate);
+	TokenBucket byteLimit(config.clientByteRate, 
+			config.clientByteBurst > 0.0 ? config.clientByteBurst : config.clientByteRate);
+	LimiterCache limiterCache;
+
 	while(true) {
+		arena.reset();
+
+		// bytes read ahead exist only in this thread, so it parks once they are used up;
+		// while a handoff waits nothing more is read than the packet under way needs
+		if(reader.buffered().size() == 0) {
+			reader.setBlockSize(BufferedReader::defaultBlockSize);
+			auto expiry = keepAlive.count() > 0 ? lastPacket + keepAlive : TokenBucket::Clock::time_point::max();
+			if(!awaitReadable(client.descriptor(), expiry)) {
+				if(TokenBucket::Clock::now() < expiry) {
+					park();
+					continue;
+				}
+
+				std::cerr << "Keep-alive expired, disconnecting " << session->identifier << '\n';
+				removeClient(client);
+				client.close();
+				return;
+			}
+		} else if(draining.load(std::memory_order_relaxed)) {
+			reader.setBlockSize(0);
+		}
 
-		std::tie(message, messageBytes, error) = Mqtt::decode(client);
+		auto [message, messageBytes, error] = Mqtt::decode(reader, &arena, config.largePayloadThreshold, config.maxPacketSize);
 		if(error) {
 			std::cerr << "Message decoding failed: " << error << '\n';
-			continue;
+			removeClient(client);
+			client.close();
+			return;
 		}
 
-		std::cout << message << '\n';
+		logger.print(message);
+		lastPacket = TokenBucket::Clock::now();
 
+		TokenBucket::Clock::duration pause{};
 		switch(message.type) {
 			case Mqtt::Type::Subscribe:
-				handleSubscription(client, message);
+				handleSubscription(client, *outbox, message);
 				break;
-			case Mqtt::Publish:
-				handlePublish(message, messageBytes);
+			case Mqtt::Publish: {
+				// spliced payloads never reach user space and cannot be logged, so a publish
+				// that is only acknowledged once it is durable is read in whole after all
+				if(auto publish = std::get_if<Mqtt::PublishHeader>(&message.content); publish 
+						&& publish->pendingPayload > 0 && wal && message.level > Mqtt::Lv0) {
+					size_t headerLength = messageBytes.size();
+					messageBytes.resize(headerLength + publish->pendingPayload);
+					error = reader.readExact(messageBytes.data() + headerLength, publish->pendingPayload);
+					if(!error) {
+						std::tie(message, error) = Mqtt::decode(BytesView(messageBytes.data(), messageBytes.size()), 
+								&arena);
+					}
+				}
+
+				auto publish = std::get_if<Mqtt::PublishHeader>(&message.content);
+				if(error || publish == nullptr) {
+					break;
+				}
+
+				// whatever the publish is stored as has to be free of the stamp
+				std::optional<Stamp> stamp;
+				BytesView publishBytes(messageBytes.data(), messageBytes.size());
+				Bytes unstamped;
+				if(session->bridge) {
+					auto [arrived, fresh] = unstamp(message);
+					if(!fresh) {
+						// a copy that came around a ring of links, acknowledged without a second look
+						error = skipPayload(reader, publish->pendingPayload);
+						acknowledge(outbox, message, std::nullopt);
+						break;
+					}
+					stamp = arrived;
+					if(publish->pendingPayload == 0) {
+						unstamped = Mqtt::encode(message);
+						publishBytes = unstamped;
+					}
+				}
+
+				pause = throttle(publishLimit, byteLimit, limiterCache, publish->topic, 
+						publishBytes.size() + publish->pendingPayload);
+
+				if(publish->pendingPayload > 0) {
+					error = forwardLargePublish(reader, session, message, stamp);
+					// only QoS 0 or an unlogged broker gets here, the acknowledgement claims receipt and nothing more
+					if(!error) {
+						acknowledge(outbox, message, std::nullopt);
+					}
+				} else {
+					handlePublish(outbox, session, message, publishBytes, stamp);
+				}
 				break;
+			}
 			case Mqtt::Unsubscribe:
 				handleUnsubscribe(client, message);
 				break;
 			case Mqtt::Pingreq:
-				handlePingreq(client);
+				handlePingreq(*outbox);
+				break;
+			case Mqtt::Pubrel:
+				handlePubrel(*outbox, message);
+				break;
+			case Mqtt::Puback:
+			case Mqtt::Pubrec:
+			case Mqtt::Pubcomp:
+				// deliveries are not tracked, acknowledgements from subscribers need no answer
+				break;
+			case Mqtt::Connack:
+			case Mqtt::Suback:
+			case Mqtt::Unsuback:
+			case Mqtt::Pingresp:
+				// only bridges send these, in answer to what this broker sent them
 				break;
 			case Mqtt::Disconnect:
 				handleDisconnect(client);
 				return;
 			default:
 				std::cerr << "Unsupported...\n";
+				removeClient(client);
 				client.close();
 				return;
 		}
+
+		if(error) {
+			std::cerr << "Forwarding failed: " << error << '\n';
+			removeClient(client);
+			client.close();
+			return;
+		}
+
+		// while reads are paused the socket buffer fills and TCP pushes back on the publisher
+		// a handoff cut the pause short; packets already read ahead exist only here, so they are
+		// drained first and the loop parks once the buffer is empty
+		if(pause > TokenBucket::Clock::duration::zero() && !awaitDelay(pause) && reader.buffered().size() == 0) {
+			park();
+		}
 	}
 }
 
-auto MqttBroker::handleSubscription(UnixTcpSocket client, const Mqtt::Message& message) -> void {
+auto MqttBroker::handleSubscription(UnixTcpSocket client, Outbox& outbox, const Mqtt::Message& message) -> void {
 	auto sub = std::get_if<Mqtt::SubscribeHeader>(&message.content);
+	if(sub == nullptr) {
+		return;
+	}
+
 	Mqtt::SubackHeader suback = {
 		.id = sub->id,
 	};
 	suback.payload.resize(sub->levels.size(), 0x00);
+	std::vector<std::shared_ptr<LogReplay>> replays;
+	// filters that now have retained messages to send, with their conditions
+	std::vector<std::pair<std::string_view, std::shared_ptr<const ContentFilter>>> filters;
 
 	clientsMutex.lock();
 
-	if(sub == nullptr) {
-		clientsMutex.unlock();
-		return;
-	}
-
+	auto session = clients[client]->session;
 	for(size_t i = 0; i < sub->topics.size(); i++) {
-		subscriptions[sub->topics[i]].insert({
-			.socket = client,
-			.level = sub->levels[i],
-		});
+		std::string_view topic = sub->topics[i];
+		if(topic.starts_with(replayPrefix)) {
+			auto replay = prepareLogReplay(session, topic.substr(replayPrefix.size()), sub->levels[i]);
+			if(replay) {
+				replays.push_back(replay);
+			} else {
+				suback.payload[i] = 0x80;
+			}
+			continue;
+		}
+
+		std::shared_ptr<const ContentFilter> condition;
+		if(auto separator = topic.find(conditionSeparator); separator != std::string_view::npos) {
+			Error err = nullptr;
+			std::tie(condition, err) = compileCondition(topic.substr(separator + 1));
+			if(err) {
+				std::cerr << "Subscription to " << topic << " refused: " << err << '\n';
+				suback.payload[i] = 0x80;
+				continue;
+			}
+			topic = topic.substr(0, separator);
+		}
+
+		if(auto err = Mqtt::validateFilter(topic); err) {
+			std::cerr << "Subscription to " << topic << " refused: " << err << '\n';
+			suback.payload[i] = 0x80;
+			continue;
+		}
+
+		subscribe(session, topic, sub->levels[i], condition);
+		filters.emplace_back(topic, condition);
 	}
 
+	logSession(*session);
+	advertiseInterest();
 	clientsMutex.unlock();
 
 	Mqtt::Message response = {
@@ -130,27 +565,128 @@ auto MqttBroker::handleSubscription(UnixTcpSocket client, const Mqtt::Message& m
 		.content = suback,
 	};
 
-	auto bytes = Mqtt::encode(response);
-	auto [_, err] = client.write(bytes);
-	if(err) {
-		std::cerr << err << '\n';
-	}
+	// the SUBACK takes the control lane, so it always precedes the retained messages
+	outbox.pushControl(Outbox::share(Mqtt::encode(response)));
+
+	std::vector<Outbox::Packet> packets;
+	auto send = [&](const Outbox::Packet& packet, const std::shared_ptr<const ContentFilter>& condition) {
+		if(condition) {
+			auto [payload, err] = Mqtt::peekPayload(*packet);
+			if(err || !ContentFilter::Evaluator(payload).passes(*condition)) {
+				return;
+			}
+		}
+		packets.push_back(packet);
+	};
 
 	retainMutex.lock();
-	for(const auto& topic : sub->topics) {
-		if(topic == "#") {
-			for(const auto& pair : retain) {
-				client.write(pair.second);
+	for(const auto& [topic, condition] : filters) {
+		if(topic == "#" && !condition) {
+			// like every first-level wildcard it skips $ topics
+			for(const auto& [retained, packet] : retain) {
+				if(!retained.starts_with('$')) {
+					packets.push_back(packet);
+				}
 			}
 			break;
-		} else {
-			client.write(retain[topic]);
+		} else if(Mqtt::isWildcard(topic)) {
+			for(const auto& [retained, packet] : retain) {
+				if(Mqtt::matches(topic, retained)) {
+					send(packet, condition);
+				}
+			}
+		} else if(auto it = retain.find(topic); it != retain.end()) {
+			send(it->second, condition);
 		}
 	}
 	retainMutex.unlock();
+
+	// a bridge forwards them on, stamped like every publish crossing it
+	if(session->bridge) {
+		for(auto& packet : packets) {
+			if(auto [retained, err] = Mqtt::decode(*packet); !err) {
+				packet = Outbox::share(Mqtt::encode(stamped(retained, nextStamp())));
+			}
+		}
+	}
+
+	outbox.push(packets);
+
+	// history streams only after the SUBACK is queued
+	for(auto& replay : replays) {
+		spawnLogReplay(replay);
+	}
 }
 
-auto MqttBroker::handlePublish(const Mqtt::Message& message, const Bytes& messageBytes) -> void {
+auto MqttBroker::subscribe(const std::shared_ptr<Session>& session, std::string_view filter, Mqtt::QosLevel level,
+		std::shared_ptr<const ContentFilter> condition) -> void {
+	// subscribing again replaces the level and condition
+	auto& set = subscriptions[std::string(filter)];
+	set.erase({session});
+	set.insert({
+		.session = session,
+		.level = level,
+		.condition = std::move(condition),
+	});
+
+	if(filter != "#" && Mqtt::isWildcard(filter)) {
+		wildcardFilters.emplace(filter);
+	}
+}
+
+auto MqttBroker::compileCondition(std::string_view expression) 
+		-> std::tuple<std::shared_ptr<const ContentFilter>, Error> {
+	auto it = conditions.find(expression);
+	if(it != conditions.end()) {
+		if(auto shared = it->second.lock(); shared) {
+			return {
+				shared,
+				nullptr,
+			};
+		}
+	}
+
+	auto [filter, err] = ContentFilter::compile(expression);
+	if(err) {
+		return {
+			nullptr,
+			err,
+		};
+	}
+
+	if(it != conditions.end()) {
+		it->second = filter;
+	} else {
+		conditions.emplace(std::string(expression), filter);
+	}
+
+	return {
+		filter,
+		nullptr,
+	};
+}
+
+auto MqttBroker::forEachSubscription(std::string_view topic, 
+		const std::function<void(const SubscriptionSet&)>& visit, const Mqtt::TopicLevels* levels) -> void {
+	if(auto it = subscriptions.find(topic); it != subscriptions.end()) {
+		visit(it->second);
+	}
+	if(auto it = subscriptions.find(std::string_view("#")); it != subscriptions.end() 
+			&& !topic.starts_with('$')) {
+		visit(it->second);
+	}
+
+	for(const auto& filter : wildcardFilters) {
+		if(levels ? Mqtt::matches(filter, topic, *levels) : Mqtt::matches(filter, topic)) {
+			if(auto it = subscriptions.find(std::string_view(filter)); it != subscriptions.end()) {
+				visit(it->second);
+			}
+		}
+	}
+}
+
+auto MqttBroker::handlePublish(std::shared_ptr<Outbox> outbox, const std::shared_ptr<Session>& origin, 
+		const Mqtt::Message& message, BytesView messageBytes, std::optional<Stamp> stamp) -> void {
 	auto publish = std::get_if<Mqtt::PublishHeader>(&message.content);
 	if(publish == nullptr) {
 		return;
@@ -158,32 +694,65 @@ auto MqttBroker::handlePublish(const Mqtt::Message& message, const Bytes& messag
 
 	if(message.retain) {
 		retainMutex.lock();
-		retain.emplace(publish->topic, messageBytes);
+		// an empty payload clears the retained message
+		if(publish->payload.empty()) {
+			if(auto it = retain.find(std::string_view(publish->topic)); it != retain.end()) {
+				retain.erase(it);
+			}
+		} else {
+			retain.insert_or_assign(std::string(publish->topic), 
+					Outbox::share(Bytes(messageBytes.begin(), messageBytes.end())));
+		}
 		retainMutex.unlock();
 	}
 
-	auto bytes = Mqtt::encode(message);
-	auto doPublish = [&](const std::set<Subscription>& set) {
-		for(const auto& sub : set) {
-			auto [_, err] = sub.socket.write(bytes);
-			if(err) {
+	// encoded once, every subscriber's outbox shares the same buffer
+	auto packet = Outbox::share(Mqtt::encode(message));
+
+	clientsMutex.lock();
+
+	// appended under the same lock as the fan-out so a replay catching up cannot miss or repeat one
+	for(auto& log : topicLogs) {
+		if(Mqtt::matches(log->filter(), publish->topic)) {
+			if(auto err = log->append(*packet); err) {
 				std::cerr << err << '\n';
 			}
 		}
-	};
+	}
 
-	clientsMutex.lock();
+	// conditions are evaluated once per message and compiled filter, not per subscriber
+	ContentFilter::Evaluator evaluator(publish->payload);
 
-	{
-		auto& subscribers = subscriptions[publish->topic];
-		doPublish(subscribers);
-	}
-	{
-		auto& subscribers = subscriptions["#"];
-		doPublish(subscribers);
-	}
+	// bridges share one stamped copy, made once the first of them turns up
+	Outbox::Packet bridged;
+
+	forEachSubscription(publish->topic, [&](const SubscriptionSet& set) {
+		for(const auto& sub : set) {
+			if(origin->bridge && sub.session == origin) {
+				continue;
+			} else if(sub.condition && !evaluator.passes(*sub.condition)) {
+				continue;
+			}
+
+			if(!sub.session->bridge) {
+				sub.session->deliver(packet, std::min(message.level, sub.level));
+				continue;
+			}
+
+			if(!bridged) {
+				if(!stamp) {
+					stamp = nextStamp();
+				}
+				bridged = Outbox::share(Mqtt::encode(stamped(message, *stamp)));
+			}
+			sub.session->deliver(bridged, std::min(message.level, sub.level));
+		}
+	}, &publish->levels);
 
 	clientsMutex.unlock();
+
+	// logged after the retained update and the fan-out so a checkpoint taken meanwhile already includes both
+	acknowledge(std::move(outbox), message, messageBytes);
 }
 
 auto MqttBroker::handleUnsubscribe(UnixTcpSocket client, const Mqtt::Message& message) -> void {
@@ -194,19 +763,33 @@ auto MqttBroker::handleUnsubscribe(UnixTcpSocket client, const Mqtt::Message& me
 
 	clientsMutex.lock();
 
+	auto session = clients[client]->session;
+	auto outbox = clients[client]->outbox;
 	for(const auto& topic : unsub->topics) {
-		auto it = subscriptions.find(topic);
+		auto it = subscriptions.find(std::string_view(topic));
 		if(it != subscriptions.end()) {
-			if(it->second.contains({client})) {
-				it->second.erase({client});
-			}
+			it->second.erase({session});
 		}
 	}
 
+	logSession(*session);
+	advertiseInterest();
 	clientsMutex.unlock();
+
+	Mqtt::Message response = {
+		.type = Mqtt::Unsuback,
+		.level = Mqtt::Lv0,
+		.duplicate = false,
+		.retain = false,
+		.content = Mqtt::AckHeader{
+			.id = unsub->id,
+		},
+	};
+
+	outbox->pushControl(Outbox::share(Mqtt::encode(response)));
 }
 
-auto MqttBroker::handlePingreq(UnixTcpSocket client) -> void {
+auto MqttBroker::handlePingreq(Outbox& outbox) -> void {
 	Mqtt::Message response = {
 		.type = Mqtt::Pingresp,
 		.level = Mqtt::Lv0,
@@ -215,32 +798,130 @@ auto MqttBroker::handlePingreq(UnixTcpSocket client) -> void {
 		.content = {},
 	};
 
-	auto bytes = Mqtt::encode(response);
-	auto [_, err] = client.write(bytes);
-	if(err) {
-		std::cerr << "Ping error: " << err << '\n';
+	outbox.pushControl(Outbox::share(Mqtt::encode(response)));
+}
+
+auto MqttBroker::handlePubrel(Outbox& outbox, const Mqtt::Message& message) -> void {
+	auto pubrel = std::get_if<Mqtt::AckHeader>(&message.content);
+	if(pubrel == nullptr) {
+		return;
 	}
+
+	Mqtt::Message response = {
+		.type = Mqtt::Pubcomp,
+		.level = Mqtt::Lv0,
+		.duplicate = false,
+		.retain = false,
+		.content = Mqtt::AckHeader{
+			.id = pubrel->id,
+		},
+	};
+
+	outbox.pushControl(Outbox::share(Mqtt::encode(response)));
+}
+
+auto MqttBroker::TopicHash::operator()(std::string_view topic) const -> size_t {
+	return std::hash<std::string_view>()(topic);
 }
 
 auto MqttBroker::Subscription::operator<(const Subscription& other) const -> bool {
-	return socket < other.socket;
+	return session < other.session;
 }
 
 auto MqttBroker::Subscription::operator==(const Subscription& other) const -> bool {
-	return socket == other.socket;
+	return session == other.session;
 }
 
 auto MqttBroker::handleDisconnect(UnixTcpSocket client) -> void {
-	unsubscribeClient(client);
+	removeClient(client);
 	client.close();
 }
 
-auto MqttBroker::unsubscribeClient(UnixTcpSocket client) -> void {
+auto MqttBroker::removeClient(UnixTcpSocket client) -> void {
+	std::shared_ptr<Client> removed;
 	clientsMutex.lock();
-	for(auto& pair : subscriptions) {
-		if(pair.second.contains({client})) {
-			pair.second.erase({client});
+	if(auto it = clients.find(client); it != clients.end()) {
+		removed = it->second;
+		clients.erase(it);
+
+		// a newer connection may have taken the session over already
+		auto session = removed->session;
+		if(session->outbox == removed->outbox) {
+			session->outbox = nullptr;
+			session->replaying = false;
+			bridgeSessions.erase(session);
+			logSession(*session);
+
+			if(!session->persistent) {
+				discardSession(session);
+				if(auto found = sessions.find(session->identifier); found != sessions.end() && found->second == session) {
+					sessions.erase(found);
+				}
+			}
 		}
+
+		advertiseInterest();
 	}
 	clientsMutex.unlock();
+
+	// the sender must be gone before the descriptor can be closed and reused
+	if(removed) {
+		removed->outbox->close();
+	}
+}
+
+auto MqttBroker::awaitDelay(TokenBucket::Clock::duration delay) -> bool {
+	pollfd fds[] = {
+		{
+			.fd = wakeFd,
+			.events = POLLIN,
+		},
+	};
+
+	auto deadline = TokenBucket::Clock::now() + delay;
+	while(true) {
+		auto remaining = std::chrono::ceil<std::chrono::milliseconds>(deadline - TokenBucket::Clock::now());
+		if(remaining.count() <= 0) {
+			return true;
+		}
+
+		int result = poll(fds, 1, remaining.count());
+		if(result < 0 && errno == EINTR) {
+			continue;
+		} else if(result > 0) {
+			return false;
+		}
+	}
+}
+
+auto MqttBroker::awaitReadable(int fd, TokenBucket::Clock::time_point deadline) -> bool {
+	pollfd fds[] = {
+		{
+			.fd = fd,
+			.events = POLLIN,
+		},
+		{
+			.fd = wakeFd,
+			.events = POLLIN,
+		},
+	};
+
+	while(true) {
+		int timeout = -1;
+		if(deadline != TokenBucket::Clock::time_point::max()) {
+			auto remaining = std::chrono::ceil<std::chrono::milliseconds>(deadline - TokenBucket::Clock::now());
+			if(remaining.count() <= 0) {
+				return false;
+			}
+			timeout = remaining.count();
+		}
+
+		int result = poll(fds, 2, timeout);
+		if((result < 0 && errno == EINTR) || result == 0) {
+			continue;
+		}
+
+		// pending client data stays in the kernel for the successor to read
+		return !(fds[1].revents & POLLIN);
+	}
 }
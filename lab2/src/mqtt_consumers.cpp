@@ -0,0 +1,184 @@
+#include "mqtt_broker.hpp"
+
+#include <algorithm>
+#include <sstream>
+
+// Slow consumer detection. Every check interval each connection's backlog,
+// the bytes in its outbox plus those its socket has not sent, is compared
+// against the thresholds: past consumerWarnBytes it is logged once, past
+// consumerConflateBytes queued publishes superseded by a newer one on the
+// same topic are dropped, and past consumerDisconnectBytes or with a packet
+// older than consumerMaxAge the connection is closed. The worst consumers
+// are published retained to $SYS/broker/consumers/worst, the slab pool's
+// size classes to $SYS/broker/memory/slabs. Topic logs drop their expired
+// segments on the same schedule.
+
+constexpr std::string_view worstConsumersTopic = "$SYS/broker/consumers/worst";
+constexpr std::string_view slabsTopic = "$SYS/broker/memory/slabs";
+
+// client identifiers are arbitrary UTF-8, quotes, backslashes and control characters need escaping in JSON
+static auto appendJsonString(std::ostringstream& out, std::string_view string) -> void {
+	constexpr std::string_view hex = "0123456789abcdef";
+	out << '"';
+	for(unsigned char character : string) {
+		if(character == '"' || character == '\\') {
+			out << '\\' << character;
+		} else if(character < 0x20) {
+			out << "\\u00" << hex[character >> 4] << hex[character & 0xf];
+		} else {
+			out << character;
+		}
+	}
+	out << '"';
+}
+
+struct ConsumerReport {
+	std::string identifier;
+	Outbox::Stats stats;
+
+	auto backlog() const -> size_t {
+		return stats.bytes + stats.unsent;
+	}
+};
+
+auto MqttBroker::monitorConsumers() -> void {
+	while(true) {
+		if(!awaitDelay(config.consumerCheckInterval)) {
+			park();
+			continue;
+		}
+
+		checkConsumers();
+		reportMemory();
+		// a log nobody publishes to would otherwise keep its old segments forever
+		for(auto& log : topicLogs) {
+			log->expire();
+		}
+	}
+}
+
+auto MqttBroker::checkConsumers() -> void {
+	std::vector<std::shared_ptr<Client>> snapshot;
+	clientsMutex.lock();
+	for(const auto& [socket, client] : clients) {
+		snapshot.push_back(client);
+	}
+	clientsMutex.unlock();
+
+	std::vector<ConsumerReport> reports;
+	for(const auto& client : snapshot) {
+		ConsumerReport report = {
+			.identifier = client->identifier,
+			.stats = client->outbox->stats(),
+		};
+
+		bool slow = config.consumerWarnBytes > 0 && report.backlog() >= config.consumerWarnBytes;
+		if(slow != client->slow) {
+			client->slow = slow;
+			std::cerr << "Consumer " << report.identifier << (slow ? " is falling behind, " : " caught up, ")
+				<< report.stats.packets << " packets, " << report.backlog() << " bytes behind\n";
+		}
+
+		if(config.consumerConflateBytes > 0 && report.backlog() >= config.consumerConflateBytes) {
+			if(auto dropped = client->outbox->conflate(); dropped > 0) {
+				std::cerr << "Conflated " << dropped << " publishes for " << report.identifier << '\n';
+				report.stats = client->outbox->stats();
+			}
+		}
+
+		bool tooFar = config.consumerDisconnectBytes > 0 && report.backlog() >= config.consumerDisconnectBytes;
+		bool tooOld = config.consumerMaxAge.count() > 0 && report.stats.oldest >= config.consumerMaxAge;
+		if(tooFar || tooOld) {
+			// the reader sees the shutdown socket and removes the client as usual
+			std::cerr << "Disconnecting slow consumer " << report.identifier << '\n';
+			client->outbox->close();
+		}
+
+		reports.push_back(std::move(report));
+	}
+
+	if(config.consumerReportCount == 0) {
+		return;
+	}
+
+	auto count = std::min(config.consumerReportCount, reports.size());
+	std::partial_sort(reports.begin(), reports.begin() + count, reports.end(), [](const auto& lhs, const auto& rhs) {
+		return lhs.backlog() > rhs.backlog();
+	});
+
+	std::ostringstream payload;
+	payload << '[';
+	for(size_t i = 0; i < count; i++) {
+		const auto& report = reports[i];
+		auto oldest = std::chrono::duration_cast<std::chrono::milliseconds>(report.stats.oldest);
+		payload << (i > 0 ? "," : "") << "{\"client\":";
+		appendJsonString(payload, report.identifier);
+		payload << ",\"packets\":" << report.stats.packets
+			<< ",\"queuedBytes\":" << report.stats.bytes
+			<< ",\"unsentBytes\":" << report.stats.unsent
+			<< ",\"oldestMs\":" << oldest.count() << '}';
+	}
+	payload << ']';
+
+	publishSystem(worstConsumersTopic, payload.str(), true);
+}
+
+auto MqttBroker::reportMemory() -> void {
+	auto stats = SlabPool::instance().stats();
+
+	std::ostringstream payload;
+	payload << "{\"slabBytes\":" << stats.slabBytes
+		<< ",\"upstreamAllocations\":" << stats.upstreamAllocations
+		<< ",\"classes\":[";
+	bool first = true;
+	for(const auto& entry : stats.classes) {
+		if(entry.blocks == 0) {
+			continue;
+		}
+		payload << (first ? "" : ",") << "{\"blockSize\":" << entry.blockSize
+			<< ",\"blocks\":" << entry.blocks
+			// counters of different threads are read at slightly different times
+			<< ",\"inUse\":" << entry.allocations - std::min(entry.allocations, entry.deallocations)
+			<< ",\"allocations\":" << entry.allocations << '}';
+		first = false;
+	}
+	payload << "]}";
+
+	publishSystem(slabsTopic, payload.str(), true);
+}
+
+auto MqttBroker::publishSystem(std::string_view topic, std::string_view payload, bool retained) -> void {
+	Mqtt::Message message = {
+		.type = Mqtt::Publish,
+		.level = Mqtt::Lv0,
+		.duplicate = false,
+		.retain = retained,
+	};
+	message.content.emplace<Mqtt::PublishHeader>(Mqtt::PublishHeader{
+		.topic = std::pmr::string(topic),
+		.payload = std::pmr::string(payload),
+		.id = 0,
+		.pendingPayload = 0,
+	});
+
+	auto packet = Outbox::share(Mqtt::encode(message));
+
+	if(retained) {
+		retainMutex.lock();
+		retain.insert_or_assign(std::string(topic), packet);
+		retainMutex.unlock();
+	}
+
+	ContentFilter::Evaluator evaluator(payload);
+
+	clientsMutex.lock();
+	forEachSubscription(topic, [&](const SubscriptionSet& set) {
+		for(const auto& sub : set) {
+			if(sub.condition && !evaluator.passes(*sub.condition)) {
+				continue;
+			}
+			sub.session->deliver(packet, Mqtt::Lv0);
+		}
+	});
+	clientsMutex.unlock();
+}
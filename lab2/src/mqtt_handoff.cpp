@@ -0,0 +1,599 @@
+#include "mqtt_broker.hpp"
+
+#include <algorithm>
+
+#include <sys/eventfd.h>
+#include <unistd.h>
+
+// Hot upgrade: a freshly started broker connects to config.upgradePath, the
+// running broker parks all of its threads at packet boundaries and passes the
+// listener, every client socket and the routing state over. Clients never
+// see the socket close.
+
+constexpr uint32_t handoffMagic = 0x4d51484f; // "MQHO"
+constexpr uint32_t handoffVersion = 6;
+constexpr Byte handoffAck = 0x06;
+// a thread that does not park, or a client that reads nothing, for this long would hold every other one parked
+constexpr auto drainTimeout = std::chrono::seconds(10);
+
+static auto appendInt(Bytes& bytes, uint32_t value) -> void {
+	auto valueBytes = AsBigEndianBytes(value);
+	bytes.insert(bytes.end(), valueBytes.begin(), valueBytes.end());
+}
+
+static auto appendString(Bytes& bytes, std::string_view string) -> void {
+	appendInt(bytes, string.size());
+	bytes.insert(bytes.end(), string.begin(), string.end());
+}
+
+static auto readInt(BytesView bytes, size_t& offset) -> std::tuple<uint32_t, Error> {
+	if(bytes.size() < offset + sizeof(uint32_t)) {
+		return {
+			0,
+			"Handoff state truncated",
+		};
+	}
+
+	auto view = BytesView(bytes.begin() + offset, bytes.begin() + offset + sizeof(uint32_t));
+	offset += sizeof(uint32_t);
+	return fromBigEndianBytes<uint32_t>(view);
+}
+
+static auto readString(BytesView bytes, size_t& offset) -> std::tuple<std::string, Error> {
+	auto [length, err] = readInt(bytes, offset);
+	if(err) {
+		return {
+			{},
+			err,
+		};
+	}
+
+	if(bytes.size() < offset + length) {
+		return {
+			{},
+			"Handoff state truncated",
+		};
+	}
+
+	std::string string(bytes.begin() + offset, bytes.begin() + offset + length);
+	offset += length;
+	return {
+		string,
+		nullptr,
+	};
+}
+
+auto MqttBroker::park() -> void {
+	std::unique_lock lock(handoffMutex);
+	parked++;
+	handoffCondition.notify_all();
+	handoffCondition.wait(lock, [this]() {
+		return !draining;
+	});
+	parked--;
+}
+
+auto MqttBroker::listenForUpgrades() -> void {
+	auto [socket, err] = UnixDomainSocket::create();
+	if(!err) {
+		err = socket.listen(config.upgradePath);
+	}
+
+	if(err) {
+		std::cerr << "Hot upgrade disabled: " << err << '\n';
+		return;
+	}
+
+	while(true) {
+		auto [successor, err] = socket.accept();
+		if(err) {
+			std::cerr << err << '\n';
+			continue;
+		}
+
+		std::cout << "Handing off to new broker process\n";
+		err = handOff(successor);
+		successor.close();
+
+		if(!err) {
+			logger.close();
+			std::cout.flush();
+			std::_Exit(EXIT_SUCCESS);
+		}
+
+		std::cerr << "Hot upgrade failed, resuming: " << err << '\n';
+	}
+}
+
+auto MqttBroker::handOff(UnixDomainSocket successor) -> Error {
+	Error err = nullptr;
+	{
+		std::unique_lock lock(handoffMutex);
+		draining = true;
+		uint64_t one = 1;
+		::write(wakeFd, &one, sizeof one);
+		handoffCondition.notify_all();
+		// readers stuck mid packet give up after their grace, which is shorter than this
+		if(!handoffCondition.wait_for(lock, drainTimeout, [this]() {
+			return parked == running;
+		})) {
+			err = "Threads did not park in time";
+		}
+	}
+
+	// nothing produces packets while parked, let pending acknowledgements and every sender run dry
+	if(wal && !err) {
+		wal->flush();
+	}
+
+	auto deadline = std::chrono::steady_clock::now() + drainTimeout;
+	clientsMutex.lock();
+	for(auto it = clients.begin(); !err && it != clients.end(); ++it) {
+		auto left = std::chrono::duration_cast<std::chrono::milliseconds>(deadline - std::chrono::steady_clock::now());
+		if(!it->second->outbox->waitUntilEmpty(std::max(left, std::chrono::milliseconds(0)))) {
+			err = "Outboxes did not drain in time";
+		}
+	}
+	clientsMutex.unlock();
+
+	if(!err) {
+		auto [state, descriptors] = serializeState();
+
+		Bytes header;
+		appendInt(header, handoffMagic);
+		appendInt(header, handoffVersion);
+		appendInt(header, state.size());
+		appendInt(header, descriptors.size());
+
+		err = successor.write(header);
+		if(!err) {
+			err = successor.write(state);
+		}
+		if(!err) {
+			err = successor.sendDescriptors(descriptors);
+		}
+	}
+
+	Bytes ack;
+	if(!err) {
+		std::tie(ack, err) = successor.read(1);
+	}
+	if(!err && ack[0] != handoffAck) {
+		err = "Successor rejected the handoff";
+	}
+
+	if(err) {
+		uint64_t count;
+		::read(wakeFd, &count, sizeof count);
+		handoffMutex.lock();
+		draining = false;
+		handoffMutex.unlock();
+		handoffCondition.notify_all();
+	}
+
+	return err;
+}
+
+auto MqttBroker::serializeState() -> std::tuple<Bytes, std::vector<int>> {
+	Bytes bytes;
+	std::vector<int> descriptors;
+	std::map<UnixTcpSocket, uint32_t> indices;
+	std::map<const Session*, uint32_t> sessionIndices;
+
+	descriptors.push_back(listener.descriptor());
+
+	clientsMutex.lock();
+
+	for(const auto& [socket, client] : clients) {
+		indices[socket] = descriptors.size();
+		descriptors.push_back(socket.descriptor());
+	}
+
+	appendInt(bytes, sessions.size());
+	for(const auto& [identifier, session] : sessions) {
+		sessionIndices[session.get()] = sessionIndices.size();
+		appendString(bytes, identifier);
+		appendInt(bytes, session->persistent);
+		// zero while offline
+		appendInt(bytes, session->outbox ? indices[session->socket] : 0);
+		appendInt(bytes, session->dialed);
+		appendString(bytes, session->route);
+		if(session->queue) {
+			session->queue->serialize(bytes);
+		}
+	}
+
+	appendInt(bytes, clients.size());
+	for(const auto& [socket, client] : clients) {
+		appendString(bytes, client->identifier);
+		appendInt(bytes, client->keepAlive);
+		// a client whose session was taken over mid-handoff points past the end
+		auto it = sessionIndices.find(client->session.get());
+		appendInt(bytes, it != sessionIndices.end() ? it->second : sessionIndices.size());
+	}
+
+	uint32_t count = 0;
+	for(const auto& [topic, set] : subscriptions) {
+		count += set.size();
+	}
+
+	appendInt(bytes, count);
+	for(const auto& [topic, set] : subscriptions) {
+		for(const auto& sub : set) {
+			appendString(bytes, topic);
+			appendInt(bytes, sessionIndices[sub.session.get()]);
+			appendInt(bytes, sub.level);
+			appendString(bytes, sub.condition ? sub.condition->expression() : std::string_view());
+		}
+	}
+
+	// replays of offline sessions are dropped, the client asks again when it reconnects
+	count = 0;
+	for(const auto& replay : logReplays) {
+		count += replay->session->outbox != nullptr;
+	}
+
+	appendInt(bytes, count);
+	for(const auto& replay : logReplays) {
+		if(replay->session->outbox) {
+			appendInt(bytes, sessionIndices[replay->session.get()]);
+			appendString(bytes, replay->filter);
+			appendInt(bytes, replay->level);
+			appendString(bytes, replay->log->filter());
+			appendInt(bytes, replay->offset >> 32);
+			appendInt(bytes, replay->offset);
+		}
+	}
+
+	clientsMutex.unlock();
+
+	retainMutex.lock();
+
+	appendInt(bytes, retain.size());
+	for(const auto& [topic, message] : retain) {
+		appendString(bytes, topic);
+		appendInt(bytes, message->size());
+		bytes.insert(bytes.end(), message->begin(), message->end());
+	}
+
+	retainMutex.unlock();
+
+	return {
+		bytes,
+		descriptors,
+	};
+}
+
+auto MqttBroker::deserializeState(BytesView bytes, const std::vector<int>& descriptors) -> Error {
+	size_t offset = 0;
+
+	if(descriptors.empty()) {
+		return "Handoff carried no listener";
+	}
+
+	listener = UnixTcpSocket::fromDescriptor(descriptors[0]);
+
+	auto [sessionCount, err] = readInt(bytes, offset);
+	if(err) {
+		return err;
+	}
+
+	std::vector<std::shared_ptr<Session>> restored;
+	std::vector<uint32_t> owners;
+	for(uint32_t i = 0; i < sessionCount; i++) {
+		auto [identifier, identifierErr] = readString(bytes, offset);
+		if(identifierErr) {
+			return identifierErr;
+		}
+
+		uint32_t values[3];
+		for(auto& value : values) {
+			std::tie(value, err) = readInt(bytes, offset);
+			if(err) {
+				return err;
+			}
+		}
+
+		auto [persistent, owner, dialed] = values;
+		if(owner >= descriptors.size()) {
+			return "Handoff session refers to unknown client";
+		}
+
+		auto [route, routeErr] = readString(bytes, offset);
+		if(routeErr) {
+			return routeErr;
+		}
+
+		auto session = makeSession(identifier, persistent);
+		session->dialed = dialed;
+		session->route = route;
+		if(session->queue) {
+			err = session->queue->deserialize(bytes, offset);
+			if(err) {
+				return err;
+			}
+		}
+
+		sessions[identifier] = session;
+		restored.push_back(session);
+		owners.push_back(owner);
+	}
+
+	uint32_t clientCount;
+	std::tie(clientCount, err) = readInt(bytes, offset);
+	if(err) {
+		return err;
+	}
+
+	if(clientCount + 1 != descriptors.size()) {
+		return "Handoff descriptor count does not match client count";
+	}
+
+	for(uint32_t i = 0; i < clientCount; i++) {
+		auto socket = UnixTcpSocket::fromDescriptor(descriptors[i + 1]);
+		auto [identifier, identifierErr] = readString(bytes, offset);
+		if(identifierErr) {
+			return identifierErr;
+		}
+
+		uint32_t values[2];
+		for(auto& value : values) {
+			std::tie(value, err) = readInt(bytes, offset);
+			if(err) {
+				return err;
+			}
+		}
+
+		auto [keepAlive, sessionIndex] = values;
+		auto session = sessionIndex < restored.size() ? restored[sessionIndex] : makeSession(identifier, false);
+		// the socket keeps the predecessor's options unless this broker sets its own
+		if(config.notSentLowWatermark > 0) {
+			socket.setNotSentLowWatermark(config.notSentLowWatermark);
+		}
+
+		clients[socket] = std::make_shared<Client>(Client{
+			.socket = socket,
+			.identifier = identifier,
+			.keepAlive = static_cast<uint16_t>(keepAlive),
+			.outbox = std::make_shared<Outbox>(socket),
+			.session = session,
+		});
+	}
+
+	for(size_t i = 0; i < restored.size(); i++) {
+		if(owners[i] == 0) {
+			continue;
+		}
+
+		auto& session = restored[i];
+		session->socket = UnixTcpSocket::fromDescriptor(descriptors[owners[i]]);
+		session->outbox = clients[session->socket]->outbox;
+		session->replaying = session->queue && !session->queue->empty();
+	}
+
+	uint32_t subscriptionCount;
+	std::tie(subscriptionCount, err) = readInt(bytes, offset);
+	if(err) {
+		return err;
+	}
+
+	for(uint32_t i = 0; i < subscriptionCount; i++) {
+		auto [topic, topicErr] = readString(bytes, offset);
+		if(topicErr) {
+			return topicErr;
+		}
+
+		auto [index, indexErr] = readInt(bytes, offset);
+		if(indexErr) {
+			return indexErr;
+		}
+
+		auto [level, levelErr] = readInt(bytes, offset);
+		if(levelErr) {
+			return levelErr;
+		}
+
+		auto [expression, expressionErr] = readString(bytes, offset);
+		if(expressionErr) {
+			return expressionErr;
+		}
+
+		if(index >= restored.size()) {
+			return "Handoff subscription refers to unknown session";
+		}
+
+		std::shared_ptr<const ContentFilter> condition;
+		if(!expression.empty()) {
+			std::tie(condition, err) = compileCondition(expression);
+			if(err) {
+				return err;
+			}
+		}
+
+		subscribe(restored[index], topic, static_cast<Mqtt::QosLevel>(level), condition);
+	}
+
+	uint32_t replayCount;
+	std::tie(replayCount, err) = readInt(bytes, offset);
+	if(err) {
+		return err;
+	}
+
+	for(uint32_t i = 0; i < replayCount; i++) {
+		auto [index, indexErr] = readInt(bytes, offset);
+		if(indexErr) {
+			return indexErr;
+		}
+
+		auto [filter, filterErr] = readString(bytes, offset);
+		if(filterErr) {
+			return filterErr;
+		}
+
+		auto [level, levelErr] = readInt(bytes, offset);
+		if(levelErr) {
+			return levelErr;
+		}
+
+		auto [logFilter, logFilterErr] = readString(bytes, offset);
+		if(logFilterErr) {
+			return logFilterErr;
+		}
+
+		uint32_t halves[2];
+		for(auto& half : halves) {
+			std::tie(half, err) = readInt(bytes, offset);
+			if(err) {
+				return err;
+			}
+		}
+
+		if(index >= restored.size()) {
+			return "Handoff replay refers to unknown session";
+		}
+
+		auto log = std::find_if(topicLogs.begin(), topicLogs.end(), [&](const auto& log) {
+			return log->filter() == logFilter;
+		});
+		if(log == topicLogs.end()) {
+			return "Handoff replay refers to a topic log this broker does not keep";
+		}
+
+		logReplays.push_back(std::make_shared<LogReplay>(LogReplay{
+			.session = restored[index],
+			.filter = filter,
+			.level = static_cast<Mqtt::QosLevel>(level),
+			.log = log->get(),
+			.offset = static_cast<uint64_t>(halves[0]) << 32 | halves[1],
+		}));
+	}
+
+	uint32_t retainCount;
+	std::tie(retainCount, err) = readInt(bytes, offset);
+	if(err) {
+		return err;
+	}
+
+	for(uint32_t i = 0; i < retainCount; i++) {
+		auto [topic, topicErr] = readString(bytes, offset);
+		if(topicErr) {
+			return topicErr;
+		}
+
+		auto [length, lengthErr] = readInt(bytes, offset);
+		if(lengthErr) {
+			return lengthErr;
+		}
+
+		if(bytes.size() < offset + length) {
+			return "Handoff state truncated";
+		}
+
+		retain[topic] = Outbox::share(Bytes(bytes.begin() + offset, bytes.begin() + offset + length));
+		offset += length;
+	}
+
+	return nullptr;
+}
+
+auto MqttBroker::takeOver() -> Error {
+	auto [predecessor, err] = UnixDomainSocket::create();
+	if(err) {
+		return err;
+	}
+
+	err = predecessor.connect(config.upgradePath);
+	if(err) {
+		return err;
+	}
+
+	auto [header, headerErr] = predecessor.read(4 * sizeof(uint32_t));
+	if(headerErr) {
+		return headerErr;
+	}
+
+	size_t offset = 0;
+	uint32_t values[4];
+	for(auto& value : values) {
+		std::tie(value, err) = readInt(header, offset);
+		if(err) {
+			return err;
+		}
+	}
+
+	auto [magic, version, stateSize, descriptorCount] = values;
+	if(magic != handoffMagic || version != handoffVersion) {
+		return "Predecessor speaks an incompatible handoff protocol";
+	}
+
+	auto [state, stateErr] = predecessor.read(stateSize);
+	if(stateErr) {
+		return stateErr;
+	}
+
+	auto [descriptors, descriptorsErr] = predecessor.receiveDescriptors(descriptorCount);
+	if(descriptorsErr) {
+		for(int fd : descriptors) {
+			::close(fd);
+		}
+		return descriptorsErr;
+	}
+
+	err = openTopicLogs();
+	if(!err) {
+		err = deserializeState(state, descriptors);
+	}
+	if(err) {
+		logReplays.clear();
+		topicLogs.clear();
+		wildcardFilters.clear();
+		subscriptions.clear();
+		sessions.clear();
+		clients.clear();
+		retain.clear();
+		for(int fd : descriptors) {
+			::close(fd);
+		}
+		listener = UnixTcpSocket::fromDescriptor(-1);
+		return err;
+	}
+
+	err = predecessor.write(BytesView(&handoffAck, 1));
+	predecessor.close();
+	if(err) {
+		return err;
+	}
+
+	// the predecessor is gone by now, losing the log must not take the clients with it
+	if(err = openLog(false); err) {
+		std::cerr << "Write-ahead log disabled: " << err << '\n';
+		wal.reset();
+		config.walDirectory.clear();
+	}
+
+	// what was advertised is not handed over, bridges are sent the whole interest again
+	clientsMutex.lock();
+	for(const auto& [identifier, session] : sessions) {
+		if(session->bridge && session->outbox) {
+			bridgeSessions.insert(session);
+		}
+	}
+	advertiseInterest();
+	clientsMutex.unlock();
+
+	wakeFd = eventfd(0, EFD_CLOEXEC);
+	for(const auto& [socket, client] : clients) {
+		spawnClient(socket, true);
+	}
+	for(const auto& [identifier, session] : sessions) {
+		if(session->replaying) {
+			spawnReplay(session);
+		}
+	}
+	for(const auto& replay : logReplays) {
+		spawnLogReplay(replay);
+	}
+
+	std::cout << "Took over " << clients.size() << " clients\n";
+	return nullptr;
+}
@@ -0,0 +1,41 @@
+#include "mqtt_broker.hpp"
+
+// Ingress rate limits. Every connection has its own publish and byte
+// buckets, topic limits are shared by everyone publishing under their
+// filter. Buckets go into debt rather than rejecting, the debt is paid off
+// by not reading from the offending socket for a while.
+
+// a cached topic costs one hash lookup, the cache is dropped wholesale if a client sprays topics
+constexpr size_t maxCachedTopics = 1024;
+
+MqttBroker::TopicLimiter::TopicLimiter(const Config::TopicLimit& limit) 
+	: filter(limit.filter), publishes(limit.publishRate, limit.publishRate), bytes(limit.byteRate, limit.byteRate) {}
+
+auto MqttBroker::throttle(TokenBucket& publishes, TokenBucket& bytes, LimiterCache& cache, 
+		std::string_view topic, size_t size) -> TokenBucket::Clock::duration {
+	auto pause = std::max(publishes.reserve(1.0), bytes.reserve(size));
+	if(topicLimiters.empty()) {
+		return pause;
+	}
+
+	auto it = cache.find(topic);
+	if(it == cache.end()) {
+		if(cache.size() >= maxCachedTopics) {
+			cache.clear();
+		}
+
+		std::vector<TopicLimiter*> matched;
+		for(auto& limiter : topicLimiters) {
+			if(Mqtt::matches(limiter.filter, topic)) {
+				matched.push_back(&limiter);
+			}
+		}
+		it = cache.emplace(std::string(topic), std::move(matched)).first;
+	}
+
+	for(auto limiter : it->second) {
+		pause = std::max({pause, limiter->publishes.reserve(1.0), limiter->bytes.reserve(size)});
+	}
+
+	return pause;
+}
@@ -0,0 +1,326 @@
+#include "mqtt_broker.hpp"
+
+// Durability for QoS 1 and 2: a publish is acknowledged only after the write-
+// ahead log has synced it. The log is group committed, so one fdatasync
+// covers every publish that arrived while the previous one was running.
+// Besides the publishes it carries every change to a persistent session, so
+// startup rebuilds the retained messages, the persistent sessions and their
+// offline queues: a logged publish is queued again for every session that
+// was offline when it came in. Each new segment starts with a checkpoint of
+// that state so older segments can be dropped.
+
+// publishes are logged as their raw packets, whose first byte is 0x30 to 0x3f
+constexpr Byte sessionRecord = 0xf0;
+constexpr Byte queuedRecord = 0xf1;
+constexpr Byte forgottenRecord = 0xf2;
+
+static auto appendInt(Bytes& bytes, uint32_t value) -> void {
+	auto valueBytes = AsBigEndianBytes(value);
+	bytes.insert(bytes.end(), valueBytes.begin(), valueBytes.end());
+}
+
+static auto appendString(Bytes& bytes, std::string_view string) -> void {
+	appendInt(bytes, string.size());
+	bytes.insert(bytes.end(), string.begin(), string.end());
+}
+
+static auto readInt(BytesView bytes, size_t& offset) -> std::tuple<uint32_t, Error> {
+	if(bytes.size() < offset + sizeof(uint32_t)) {
+		return {
+			0,
+			"Log record truncated",
+		};
+	}
+
+	auto view = BytesView(bytes.begin() + offset, bytes.begin() + offset + sizeof(uint32_t));
+	offset += sizeof(uint32_t);
+	return fromBigEndianBytes<uint32_t>(view);
+}
+
+static auto readString(BytesView bytes, size_t& offset) -> std::tuple<std::string, Error> {
+	auto [length, err] = readInt(bytes, offset);
+	if(err) {
+		return {
+			{},
+			err,
+		};
+	}
+
+	if(bytes.size() < offset + length) {
+		return {
+			{},
+			"Log record truncated",
+		};
+	}
+
+	std::string string(bytes.begin() + offset, bytes.begin() + offset + length);
+	offset += length;
+	return {
+		string,
+		nullptr,
+	};
+}
+
+auto MqttBroker::openLog(bool recover) -> Error {
+	if(config.walDirectory.empty()) {
+		return nullptr;
+	}
+
+	wal = std::make_unique<WriteAheadLog>(config.walDirectory, config.walSegmentSize, 
+			config.walCommitDelay, config.walCommitBytes);
+
+	// sessions whose client was connected at that point in the log, they were sent what came in
+	std::unordered_set<std::string> online;
+	auto err = wal->open([this, recover, &online](BytesView record) {
+		if(recover) {
+			recoverRecord(record, online);
+		}
+	}, [this]() {
+		return checkpointRecords();
+	});
+	if(err) {
+		return err;
+	}
+
+	if(err = wal->pin(config.logCpus); err) {
+		std::cerr << err << '\n';
+	}
+	return nullptr;
+}
+
+auto MqttBroker::logSession(const Session& session) -> void {
+	if(!wal || !session.persistent) {
+		return;
+	}
+
+	SessionFilters filters;
+	for(const auto& [filter, set] : subscriptions) {
+		for(const auto& sub : set) {
+			if(sub.session.get() == &session) {
+				filters.emplace_back(filter, &sub);
+			}
+		}
+	}
+
+	wal->append(sessionBytes(session, filters), [](Error err) {
+		if(err) {
+			std::cerr << err << '\n';
+		}
+	});
+}
+
+auto MqttBroker::logForgotten(const Session& session) -> void {
+	if(!wal || !session.persistent) {
+		return;
+	}
+
+	Bytes record = {forgottenRecord};
+	appendString(record, session.identifier);
+	wal->append(record, [](Error err) {
+		if(err) {
+			std::cerr << err << '\n';
+		}
+	});
+}
+
+// the whole session every time, replaying a record twice changes nothing
+auto MqttBroker::sessionBytes(const Session& session, const SessionFilters& filters) -> Bytes {
+	Bytes record = {sessionRecord};
+	appendString(record, session.identifier);
+	appendInt(record, session.outbox != nullptr);
+
+	appendInt(record, filters.size());
+	for(const auto& [filter, sub] : filters) {
+		appendString(record, filter);
+		appendInt(record, sub->level);
+		appendString(record, sub->condition ? sub->condition->expression() : std::string_view());
+	}
+
+	return record;
+}
+
+auto MqttBroker::checkpointRecords() -> std::vector<Bytes> {
+	std::vector<Bytes> records;
+
+	clientsMutex.lock();
+
+	std::unordered_map<const Session*, SessionFilters> filters;
+	for(const auto& [filter, set] : subscriptions) {
+		for(const auto& sub : set) {
+			if(sub.session->persistent) {
+				filters[sub.session.get()].emplace_back(filter, &sub);
+			}
+		}
+	}
+
+	for(const auto& [identifier, session] : sessions) {
+		if(!session->persistent) {
+			continue;
+		}
+
+		records.push_back(sessionBytes(*session, filters[session.get()]));
+
+		auto [packets, err] = session->queue->packets();
+		if(err) {
+			std::cerr << "Offline queue of " << identifier << " not checkpointed: " << err << '\n';
+		}
+		for(const auto& packet : packets) {
+			Bytes record = {queuedRecord};
+			appendString(record, identifier);
+			record.insert(record.end(), packet->begin(), packet->end());
+			records.push_back(std::move(record));
+		}
+	}
+	clientsMutex.unlock();
+
+	retainMutex.lock();
+	for(const auto& [topic, packet] : retain) {
+		records.push_back(*packet);
+	}
+	retainMutex.unlock();
+
+	return records;
+}
+
+auto MqttBroker::recoverRecord(BytesView record, std::unordered_set<std::string>& online) -> void {
+	if(record.size() == 0) {
+		return;
+	}
+
+	size_t offset = 1;
+	if(record[0] == sessionRecord) {
+		recoverSession(record, online);
+		return;
+	} else if(record[0] == forgottenRecord) {
+		auto [identifier, err] = readString(record, offset);
+		std::lock_guard lock(clientsMutex);
+		if(auto it = sessions.find(identifier); !err && it != sessions.end()) {
+			discardSession(it->second);
+			sessions.erase(it);
+		}
+		online.erase(identifier);
+		return;
+	} else if(record[0] == queuedRecord) {
+		auto [identifier, err] = readString(record, offset);
+		std::lock_guard lock(clientsMutex);
+		if(auto it = sessions.find(identifier); !err && it != sessions.end() && it->second->queue) {
+			it->second->queue->push(Outbox::share(Bytes(record.begin() + offset, record.end())));
+		}
+		return;
+	}
+
+	auto [message, err] = Mqtt::decode(record);
+	auto publish = std::get_if<Mqtt::PublishHeader>(&message.content);
+	if(err || publish == nullptr) {
+		return;
+	}
+
+	if(message.retain) {
+		retainMutex.lock();
+		if(publish->payload.empty()) {
+			retain.erase(std::string(publish->topic));
+		} else {
+			retain.insert_or_assign(std::string(publish->topic), Outbox::share(Bytes(record.begin(), record.end())));
+		}
+		retainMutex.unlock();
+	}
+
+	// nothing in memory survived, so the packet itself is what gets queued
+	auto packet = Outbox::share(Bytes(record.begin(), record.end()));
+	ContentFilter::Evaluator evaluator(publish->payload);
+
+	std::lock_guard lock(clientsMutex);
+	forEachSubscription(publish->topic, [&](const SubscriptionSet& set) {
+		for(const auto& sub : set) {
+			if(online.contains(sub.session->identifier)) {
+				continue;
+			} else if(sub.condition && !evaluator.passes(*sub.condition)) {
+				continue;
+			}
+			sub.session->deliver(packet, std::min(message.level, sub.level));
+		}
+	});
+}
+
+auto MqttBroker::recoverSession(BytesView record, std::unordered_set<std::string>& online) -> void {
+	size_t offset = 1;
+	auto [identifier, err] = readString(record, offset);
+	if(err) {
+		return;
+	}
+
+	auto [connected, connectedErr] = readInt(record, offset);
+	auto [count, countErr] = readInt(record, offset);
+	if(connectedErr || countErr) {
+		return;
+	}
+
+	std::lock_guard lock(clientsMutex);
+	auto& session = sessions[identifier];
+	if(!session) {
+		session = makeSession(identifier, true);
+	}
+
+	for(auto& pair : subscriptions) {
+		pair.second.erase({session});
+	}
+
+	for(uint32_t i = 0; i < count; i++) {
+		auto [filter, filterErr] = readString(record, offset);
+		auto [level, levelErr] = readInt(record, offset);
+		auto [expression, expressionErr] = readString(record, offset);
+		if(filterErr || levelErr || expressionErr) {
+			break;
+		}
+
+		std::shared_ptr<const ContentFilter> condition;
+		if(!expression.empty()) {
+			std::tie(condition, err) = compileCondition(expression);
+			if(err) {
+				continue;
+			}
+		}
+
+		subscribe(session, filter, static_cast<Mqtt::QosLevel>(level), condition);
+	}
+
+	if(connected) {
+		online.insert(identifier);
+	} else {
+		online.erase(identifier);
+	}
+}
+
+auto MqttBroker::acknowledge(std::shared_ptr<Outbox> outbox, const Mqtt::Message& message, std::optional<BytesView> record) 
+		-> void {
+	auto publish = std::get_if<Mqtt::PublishHeader>(&message.content);
+	if(publish == nullptr || message.level == Mqtt::Lv0) {
+		return;
+	}
+
+	// QoS 2 publishes are logged like QoS 1 ones and completed by PUBREL -> PUBCOMP
+	Mqtt::Message response = {
+		.type = message.level == Mqtt::Lv1 ? Mqtt::Puback : Mqtt::Pubrec,
+		.level = Mqtt::Lv0,
+		.duplicate = false,
+		.retain = false,
+		.content = Mqtt::AckHeader{
+			.id = publish->id,
+		},
+	};
+	auto packet = Outbox::share(Mqtt::encode(response));
+
+	if(!wal || !record) {
+		outbox->pushControl(packet);
+		return;
+	}
+
+	wal->append(*record, [outbox, packet](Error err) {
+		if(err) {
+			// unacknowledged, the client resends after reconnecting
+			std::cerr << err << '\n';
+			return;
+		}
+		outbox->pushControl(packet);
+	});
+}
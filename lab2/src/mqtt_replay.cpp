@@ -0,0 +1,149 @@
+#include "mqtt_broker.hpp"
+
+#include <algorithm>
+#include <charconv>
+
+// Replay from a topic log: subscribing to $replay/<from>/<filter> streams
+// everything the log holds for filter starting at <from>, which is an
+// offset, @<unix milliseconds> or -<seconds ago>. History is pushed a window
+// at a time as the subscriber's outbox drains; once the replay reaches the
+// end of the log it becomes an ordinary subscription to filter.
+
+using namespace std::chrono_literals;
+
+template<typename T>
+static auto parseNumber(std::string_view string, T& value) -> bool {
+	auto [end, ec] = std::from_chars(string.data(), string.data() + string.size(), value);
+	return ec == std::errc() && end == string.data() + string.size() && !string.empty();
+}
+
+auto MqttBroker::openTopicLogs() -> Error {
+	for(const auto& filter : config.retentionFilters) {
+		auto log = std::make_unique<TopicLog>(filter, config.retentionDirectory, config.retentionSegmentSize,
+				config.retentionIndexInterval, config.retentionPeriod);
+		if(auto err = log->open(); err) {
+			return err;
+		}
+		topicLogs.push_back(std::move(log));
+	}
+
+	return nullptr;
+}
+
+auto MqttBroker::prepareLogReplay(std::shared_ptr<Session> session, std::string_view request, Mqtt::QosLevel level) 
+		-> std::shared_ptr<LogReplay> {
+	auto separator = request.find('/');
+	if(separator == std::string_view::npos || separator + 1 == request.size()) {
+		return nullptr;
+	}
+
+	auto from = request.substr(0, separator);
+	auto filter = request.substr(separator + 1);
+
+	// either the retained filter itself or a single topic it covers
+	auto it = std::find_if(topicLogs.begin(), topicLogs.end(), [filter](const auto& log) {
+		return log->filter() == filter || (!Mqtt::isWildcard(filter) && Mqtt::matches(log->filter(), filter));
+	});
+	if(it == topicLogs.end()) {
+		return nullptr;
+	}
+
+	auto& log = *it;
+	uint64_t offset = 0;
+	int64_t time = 0;
+	if(from.starts_with('@') && parseNumber(from.substr(1), time)) {
+		offset = log->offsetAt(TopicLog::Clock::time_point(std::chrono::milliseconds(time)));
+	} else if(from.starts_with('-') && parseNumber(from.substr(1), time)) {
+		offset = log->offsetAt(TopicLog::Clock::now() - std::chrono::seconds(time));
+	} else if(!parseNumber(from, offset)) {
+		return nullptr;
+	}
+
+	auto replay = std::make_shared<LogReplay>(LogReplay{
+		.session = session,
+		.filter = std::string(filter),
+		.level = level,
+		.log = log.get(),
+		.offset = offset,
+	});
+	logReplays.push_back(replay);
+	return replay;
+}
+
+auto MqttBroker::spawnLogReplay(std::shared_ptr<LogReplay> replay) -> void {
+	clientsMutex.lock();
+	auto outbox = replay->session->outbox;
+	clientsMutex.unlock();
+
+	handoffMutex.lock();
+	running++;
+	handoffMutex.unlock();
+
+	std::thread thread(&MqttBroker::replayLog, this, replay, outbox);
+	thread.detach();
+}
+
+auto MqttBroker::replayLog(std::shared_ptr<LogReplay> replay, std::shared_ptr<Outbox> outbox) -> void {
+	size_t lowWater = std::max<size_t>(config.replayWindow / 2, 1);
+	bool narrowed = replay->filter != replay->log->filter();
+
+	while(true) {
+		handoffMutex.lock();
+		bool drain = draining;
+		handoffMutex.unlock();
+
+		if(drain) {
+			park();
+			continue;
+		}
+
+		bool ready = outbox->waitUntilBelow(lowWater, 100ms);
+
+		// publishers append under this lock, so the switch to live traffic loses nothing
+		std::lock_guard lock(clientsMutex);
+		if(replay->session->outbox != outbox) {
+			break;
+		}
+
+		if(!ready) {
+			continue;
+		}
+
+		auto [records, next, err] = replay->log->read(replay->offset, config.replayWindow - lowWater);
+		if(err) {
+			std::cerr << "Replay of " << replay->filter << " stopped: " << err << '\n';
+			break;
+		}
+
+		if(next == replay->offset) {
+			subscribe(replay->session, replay->filter, replay->level);
+			logSession(*replay->session);
+			advertiseInterest();
+			break;
+		}
+
+		// only what the subscriber gets leaves the mapping
+		std::vector<Outbox::Packet> packets;
+		for(auto record : records.packets) {
+			if(narrowed) {
+				auto [topic, topicErr] = Mqtt::peekTopic(record);
+				if(topicErr || !Mqtt::matches(replay->filter, topic)) {
+					continue;
+				}
+			}
+			packets.push_back(Outbox::share(Bytes(record.begin(), record.end())));
+		}
+
+		replay->offset = next;
+		outbox->push(packets);
+	}
+
+	clientsMutex.lock();
+	logReplays.remove(replay);
+	clientsMutex.unlock();
+
+	handoffMutex.lock();
+	running--;
+	handoffMutex.unlock();
+	handoffCondition.notify_all();
+}
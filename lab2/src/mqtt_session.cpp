@@ -0,0 +1,111 @@
+#include "mqtt_broker.hpp"
+
+#include <algorithm>
+
+// Persistent sessions: a client that connects without the clean session flag
+// keeps its subscriptions after it goes away, and messages published to them
+// at QoS 1 or above wait in its offline queue. On reconnect the queue is
+// replayed through the outbox a window at a time so a long absence cannot
+// flood the socket or the broker's memory.
+
+using namespace std::chrono_literals;
+
+auto MqttBroker::Session::deliver(const Outbox::Packet& packet, Mqtt::QosLevel level) -> void {
+	if(outbox && !replaying) {
+		outbox->push(packet);
+		return;
+	}
+
+	// QoS 0 messages are only kept to stay in order behind a running replay
+	if(queue && (outbox || level > Mqtt::Lv0)) {
+		if(auto err = queue->push(packet); err) {
+			std::cerr << "Offline queue of " << identifier << ": " << err << '\n';
+		}
+	}
+}
+
+auto MqttBroker::makeSession(std::string_view identifier, bool persistent) -> std::shared_ptr<Session> {
+	auto session = std::make_shared<Session>(Session{
+		.identifier = std::string(identifier),
+		.persistent = persistent,
+		.outbox = nullptr,
+		.socket = UnixTcpSocket::fromDescriptor(-1),
+		.bridge = identifier.starts_with(bridgePrefix),
+	});
+
+	if(persistent) {
+		session->queue = std::make_unique<OfflineQueue>(config.offlineDirectory, identifier,
+				config.offlineMemoryLimit, config.offlineSegmentSize);
+	}
+
+	return session;
+}
+
+auto MqttBroker::discardSession(const std::shared_ptr<Session>& session) -> void {
+	for(auto& pair : subscriptions) {
+		pair.second.erase({session});
+	}
+
+	if(session->queue) {
+		session->queue->clear();
+	}
+
+	session->outbox = nullptr;
+	session->replaying = false;
+	bridgeSessions.erase(session);
+}
+
+auto MqttBroker::spawnReplay(std::shared_ptr<Session> session) -> void {
+	handoffMutex.lock();
+	running++;
+	handoffMutex.unlock();
+
+	std::thread thread(&MqttBroker::replayOffline, this, session, session->outbox);
+	thread.detach();
+}
+
+auto MqttBroker::replayOffline(std::shared_ptr<Session> session, std::shared_ptr<Outbox> outbox) -> void {
+	// refills once the outbox drains below half the window
+	size_t lowWater = std::max<size_t>(config.replayWindow / 2, 1);
+
+	while(true) {
+		handoffMutex.lock();
+		bool drain = draining;
+		handoffMutex.unlock();
+
+		if(drain) {
+			park();
+			continue;
+		}
+
+		bool ready = outbox->waitUntilBelow(lowWater, 100ms);
+
+		std::lock_guard lock(clientsMutex);
+		if(session->outbox != outbox) {
+			// disconnected or taken over, whatever is left waits for the next connection
+			break;
+		}
+
+		if(!ready) {
+			continue;
+		}
+
+		auto [packets, err] = session->queue->pop(config.replayWindow - lowWater);
+		if(err) {
+			std::cerr << "Offline queue of " << session->identifier << " dropped: " << err << '\n';
+			session->queue->clear();
+		}
+
+		outbox->push(packets);
+
+		if(session->queue->empty()) {
+			session->replaying = false;
+			break;
+		}
+	}
+
+	handoffMutex.lock();
+	running--;
+	handoffMutex.unlock();
+	handoffCondition.notify_all();
+}
@@ -0,0 +1,308 @@
+#include "mqtt_broker.hpp"
+
+#include <algorithm>
+
+#include <fcntl.h>
+#include <poll.h>
+#include <unistd.h>
+
+// Large-payload mode: the payload of a big PUBLISH never enters user space,
+// apart from the start the connection's reader may already have buffered.
+// It is spliced from the publisher's socket into a pipe one pipe-full at a
+// time, tee'd into a pipe per extra subscriber and spliced out to every
+// subscriber socket. Subscribers' outboxes are leased for the duration so
+// the forwarded packet cannot interleave with queued traffic. Every chunk
+// goes out to all subscribers at once; one that has not taken it within
+// stallTimeout is dropped, the others carry on. A publisher that sends
+// nothing for stallTimeout is dropped along with its half-sent packet.
+
+// default /proc/sys/fs/pipe-max-size, larger requests fail for unprivileged users
+constexpr size_t maxPipeSize = 1024 * 1024;
+// longest the leases, a chunk or the publisher between chunks may take
+constexpr auto stallTimeout = std::chrono::seconds(5);
+
+struct Pipe {
+	int read = -1;
+	int write = -1;
+
+	auto open(size_t size) -> Error {
+		int fds[2];
+		if(pipe2(fds, O_CLOEXEC) != 0) {
+			return "Could not create pipe";
+		}
+
+		read = fds[0];
+		write = fds[1];
+		fcntl(write, F_SETPIPE_SZ, static_cast<int>(size));
+		return nullptr;
+	}
+
+	auto close() -> void {
+		if(read >= 0) {
+			::close(read);
+			::close(write);
+		}
+		read = write = -1;
+	}
+};
+
+using Clock = std::chrono::steady_clock;
+
+// what is left of a deadline as a poll timeout, never negative
+static auto remainingMs(Clock::time_point deadline) -> int {
+	auto left = std::chrono::duration_cast<std::chrono::milliseconds>(deadline - Clock::now()).count();
+	return static_cast<int>(std::max<decltype(left)>(left, 0));
+}
+
+// false if fd did not become ready for events by the deadline
+static auto await(int fd, short events, Clock::time_point deadline) -> bool {
+	pollfd descriptor = {
+		.fd = fd,
+		.events = events,
+	};
+	int ready;
+	do {
+		ready = poll(&descriptor, 1, remainingMs(deadline));
+	} while(ready < 0 && errno == EINTR);
+	return ready > 0;
+}
+
+// subscriber sockets are non-blocking while leased, one still full at the deadline is given up on
+static auto writeFully(int fd, BytesView bytes, Clock::time_point deadline) -> bool {
+	size_t offset = 0;
+	while(offset < bytes.size()) {
+		auto result = ::write(fd, bytes.data() + offset, bytes.size() - offset);
+		if(result < 0 && errno == EINTR) {
+			continue;
+		} else if(result < 0 && errno == EAGAIN && await(fd, POLLOUT, deadline)) {
+			continue;
+		} else if(result < 0) {
+			return false;
+		}
+		offset += result;
+	}
+	return true;
+}
+
+// splices length bytes from every pipe into its socket side by side, so one
+// slow subscriber does not eat into the others' time; whoever is still short
+// of the chunk once the deadline passes is marked dead
+static auto spliceAll(const std::vector<int>& pipes, const std::vector<int>& sockets, 
+		std::vector<bool>& alive, size_t length, Clock::time_point deadline) -> void {
+	std::vector<size_t> pending(sockets.size());
+	for(size_t i = 0; i < sockets.size(); i++) {
+		pending[i] = alive[i] ? length : 0;
+	}
+
+	while(true) {
+		std::vector<pollfd> waiting;
+		std::vector<size_t> indices;
+		for(size_t i = 0; i < sockets.size(); i++) {
+			while(pending[i] > 0) {
+				auto result = splice(pipes[i], nullptr, sockets[i], nullptr, pending[i], 
+						SPLICE_F_MOVE | SPLICE_F_MORE | SPLICE_F_NONBLOCK);
+				if(result < 0 && errno == EINTR) {
+					continue;
+				} else if(result < 0 && errno == EAGAIN) {
+					break;
+				} else if(result <= 0) {
+					alive[i] = false;
+					pending[i] = 0;
+					break;
+				}
+				pending[i] -= result;
+			}
+
+			if(pending[i] > 0) {
+				waiting.push_back({
+					.fd = sockets[i],
+					.events = POLLOUT,
+				});
+				indices.push_back(i);
+			}
+		}
+
+		if(waiting.empty()) {
+			return;
+		}
+
+		int ready = poll(waiting.data(), waiting.size(), remainingMs(deadline));
+		if(ready == 0 || (ready < 0 && errno != EINTR)) {
+			for(auto i : indices) {
+				alive[i] = false;
+			}
+			return;
+		}
+	}
+}
+
+// empties whatever a dropped subscriber left in a pipe
+static auto drain(int pipe, int sink) -> void {
+	while(true) {
+		auto result = splice(pipe, nullptr, sink, nullptr, maxPipeSize, SPLICE_F_MOVE | SPLICE_F_NONBLOCK);
+		if(result <= 0 && !(result < 0 && errno == EINTR)) {
+			return;
+		}
+	}
+}
+
+// returns the flags to put back once the lease ends
+static auto setNonBlocking(int fd) -> int {
+	int flags = fcntl(fd, F_GETFL, 0);
+	fcntl(fd, F_SETFL, flags | O_NONBLOCK);
+	return flags;
+}
+
+auto MqttBroker::forwardLargePublish(BufferedReader& client, const std::shared_ptr<Session>& origin, 
+		const Mqtt::Message& message, std::optional<Stamp> stamp) -> Error {
+	auto publish = std::get_if<Mqtt::PublishHeader>(&message.content);
+	size_t remaining = publish->pendingPayload;
+
+	if(message.retain) {
+		std::cerr << "Large payloads are not retained, topic: " << publish->topic << '\n';
+	}
+
+	std::vector<std::shared_ptr<Outbox>> targets;
+	// outboxes of bridge links, whose copy carries the stamp
+	std::set<std::shared_ptr<Outbox>> bridges;
+
+	clientsMutex.lock();
+	forEachSubscription(publish->topic, [&](const SubscriptionSet& set) {
+		for(const auto& sub : set) {
+			// offline and replaying sessions miss large payloads, they are never spooled;
+			// conditions cannot be checked on a payload that never reaches user space
+			if(sub.session->outbox && !sub.session->replaying && !sub.condition
+					&& !(origin->bridge && sub.session == origin)) {
+				targets.push_back(sub.session->outbox);
+				if(sub.session->bridge) {
+					bridges.insert(sub.session->outbox);
+				}
+			}
+		}
+	}, &publish->levels);
+	clientsMutex.unlock();
+
+	// leases are always taken in descriptor order so two forwarders cannot deadlock
+	std::sort(targets.begin(), targets.end(), [](const auto& lhs, const auto& rhs) {
+		return lhs->descriptor() < rhs->descriptor();
+	});
+	targets.erase(std::unique(targets.begin(), targets.end()), targets.end());
+
+	// the broker does not track inflight messages, so it forwards at QoS 0
+	Mqtt::Message forwarded = {
+		.type = Mqtt::Publish,
+		.level = Mqtt::Lv0,
+		.duplicate = false,
+		.retain = false,
+	};
+	forwarded.content.emplace<Mqtt::PublishHeader>(*publish);
+	auto header = Mqtt::encodePublishHeader(forwarded, remaining);
+	Bytes bridgeHeader;
+	if(!bridges.empty()) {
+		bridgeHeader = Mqtt::encodePublishHeader(stamped(forwarded, stamp ? *stamp : nextStamp()), remaining);
+	}
+
+	// one budget for all leases and headers, a stuck subscriber cannot stall the ones behind it
+	auto leaseDeadline = Clock::now() + stallTimeout;
+	std::vector<std::shared_ptr<Outbox>> leased;
+	std::vector<int> flags;
+	for(auto& target : targets) {
+		if(!target->acquire(std::chrono::milliseconds(remainingMs(leaseDeadline)))) {
+			// its earlier traffic is still stuck, it misses this payload like an offline subscriber
+			continue;
+		}
+
+		int previous = setNonBlocking(target->descriptor());
+		if(writeFully(target->descriptor(), bridges.contains(target) ? bridgeHeader : header, leaseDeadline)) {
+			leased.push_back(target);
+			flags.push_back(previous);
+		} else {
+			fcntl(target->descriptor(), F_SETFL, previous);
+			target->close();
+			target->release();
+		}
+	}
+
+	size_t chunkSize = std::min(remaining, maxPipeSize);
+	Pipe source;
+	std::vector<Pipe> copies(leased.size() > 1 ? leased.size() - 1 : 0);
+	std::vector<bool> alive(leased.size(), true);
+	Error err = source.open(chunkSize);
+	for(auto& copy : copies) {
+		if(!err) {
+			err = copy.open(chunkSize);
+		}
+	}
+
+	// every subscriber but the last reads a duplicate, the last one consumes the source
+	std::vector<int> pipes;
+	std::vector<int> sockets;
+	for(size_t i = 0; i < leased.size(); i++) {
+		pipes.push_back(i < copies.size() ? copies[i].read : source.read);
+		sockets.push_back(leased[i]->descriptor());
+	}
+
+	int sink = -1;
+	if(!err) {
+		sink = ::open("/dev/null", O_WRONLY | O_CLOEXEC);
+	}
+
+	while(!err && remaining > 0) {
+		// the part of the payload the reader already holds enters the pipe like a spliced chunk
+		auto buffered = client.buffered();
+		ssize_t moved;
+		if(buffered.size() > 0) {
+			moved = ::write(source.write, buffered.data(), std::min({buffered.size(), remaining, chunkSize}));
+			if(moved > 0) {
+				client.consume(moved);
+			}
+		} else if(!await(client.socket().descriptor(), POLLIN, Clock::now() + stallTimeout)) {
+			err = "Publisher stalled mid payload";
+			break;
+		} else {
+			// the socket may be non-blocking while leased by another publisher, then a spurious wakeup reads nothing
+			moved = splice(client.socket().descriptor(), nullptr, source.write, nullptr,
+					std::min(remaining, chunkSize), SPLICE_F_MOVE | SPLICE_F_MORE | SPLICE_F_NONBLOCK);
+		}
+		if(moved < 0 && (errno == EINTR || errno == EAGAIN)) {
+			continue;
+		} else if(moved <= 0) {
+			err = "Publisher closed the connection mid payload";
+			break;
+		}
+		remaining -= moved;
+
+		for(size_t i = 0; i < copies.size(); i++) {
+			if(alive[i] && tee(source.read, copies[i].write, moved, 0) != moved) {
+				alive[i] = false;
+			}
+		}
+
+		// the chunk as a whole gets stallTimeout, whoever has not taken it by then is dropped
+		spliceAll(pipes, sockets, alive, moved, Clock::now() + stallTimeout);
+
+		// the source pipe still has to be emptied for the next chunk
+		if(leased.empty() || !alive.back()) {
+			drain(source.read, sink);
+		}
+	}
+
+	for(size_t i = 0; i < leased.size(); i++) {
+		// a subscriber that missed part of the payload has a corrupt stream
+		fcntl(leased[i]->descriptor(), F_SETFL, flags[i]);
+		if(!alive[i] || err) {
+			leased[i]->close();
+		}
+		leased[i]->release();
+	}
+
+	source.close();
+	for(auto& copy : copies) {
+		copy.close();
+	}
+	if(sink >= 0) {
+		::close(sink);
+	}
+
+	return err;
+}
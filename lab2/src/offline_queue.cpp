@@ -0,0 +1,333 @@
+#include "offline_queue.hpp"
+
+#include <fcntl.h>
+#include <sys/uio.h>
+#include <unistd.h>
+
+static auto appendInt(Bytes& bytes, uint32_t value) -> void {
+	auto valueBytes = AsBigEndianBytes(value);
+	bytes.insert(bytes.end(), valueBytes.begin(), valueBytes.end());
+}
+
+static auto readInt(BytesView bytes, size_t& offset) -> std::tuple<uint32_t, Error> {
+	if(bytes.size() < offset + sizeof(uint32_t)) {
+		return {
+			0,
+			"Offline queue state truncated",
+		};
+	}
+
+	auto view = BytesView(bytes.begin() + offset, bytes.begin() + offset + sizeof(uint32_t));
+	offset += sizeof(uint32_t);
+	return fromBigEndianBytes<uint32_t>(view);
+}
+
+OfflineQueue::OfflineQueue(std::string_view directory, std::string_view name, size_t memoryLimit, size_t segmentSize)
+	: memoryLimit(memoryLimit), segmentSize(segmentSize) {
+	// client identifiers may contain anything, hex keeps the file names safe
+	constexpr const char* digits = "0123456789abcdef";
+	prefix = directory;
+	prefix += '/';
+	for(unsigned char c : name) {
+		prefix += digits[c >> 4];
+		prefix += digits[c & 15];
+	}
+}
+
+OfflineQueue::~OfflineQueue() {
+	closeFiles();
+}
+
+auto OfflineQueue::push(Outbox::Packet packet) -> Error {
+	// once anything is on disk newer packets have to follow it there to keep the order
+	if(!onDisk && memoryBytes + packet->size() <= memoryLimit) {
+		memoryBytes += packet->size();
+		memory.push_back(std::move(packet));
+		return nullptr;
+	}
+
+	return spill(*packet);
+}
+
+auto OfflineQueue::pop(size_t maxBytes) -> std::tuple<std::vector<Outbox::Packet>, Error> {
+	std::vector<Outbox::Packet> packets;
+	size_t bytes = 0;
+
+	while(!memory.empty() && (packets.empty() || bytes + memory.front()->size() <= maxBytes)) {
+		bytes += memory.front()->size();
+		memoryBytes -= memory.front()->size();
+		packets.push_back(std::move(memory.front()));
+		memory.pop_front();
+	}
+
+	// everything on disk is newer than what was in memory
+	while(memory.empty() && onDisk && bytes < maxBytes) {
+		auto [packet, err] = readSegment();
+		if(err) {
+			return {
+				packets,
+				err,
+			};
+		}
+
+		bytes += packet->size();
+		packets.push_back(std::move(packet));
+	}
+
+	return {
+		packets,
+		nullptr,
+	};
+}
+
+auto OfflineQueue::empty() const -> bool {
+	return memory.empty() && !onDisk;
+}
+
+auto OfflineQueue::packets() const -> std::tuple<std::vector<Outbox::Packet>, Error> {
+	std::vector<Outbox::Packet> packets(memory.begin(), memory.end());
+
+	for(uint32_t i = firstSegment; onDisk && i != lastSegment + 1; i++) {
+		int fd = ::open(segmentPath(i).c_str(), O_RDONLY | O_CLOEXEC);
+		if(fd < 0) {
+			return {
+				packets,
+				"Could not open offline queue segment",
+			};
+		}
+
+		size_t offset = i == firstSegment ? readOffset : 0;
+		size_t end = segmentLengths[i - firstSegment];
+		while(offset < end) {
+			Byte lengthBytes[sizeof(uint32_t)];
+			if(::pread(fd, lengthBytes, sizeof lengthBytes, offset) != sizeof lengthBytes) {
+				break;
+			}
+
+			auto [length, err] = fromBigEndianBytes<uint32_t>(BytesView(lengthBytes, sizeof lengthBytes));
+			if(offset + sizeof lengthBytes + length > end) {
+				break;
+			}
+
+			Bytes packet(length);
+			if(::pread(fd, packet.data(), length, offset + sizeof lengthBytes) != length) {
+				break;
+			}
+
+			packets.push_back(Outbox::share(std::move(packet)));
+			offset += sizeof lengthBytes + length;
+		}
+		::close(fd);
+
+		if(offset < end) {
+			return {
+				packets,
+				"Offline queue segment truncated",
+			};
+		}
+	}
+
+	return {
+		packets,
+		nullptr,
+	};
+}
+
+auto OfflineQueue::clear() -> void {
+	memory.clear();
+	memoryBytes = 0;
+	closeFiles();
+
+	if(onDisk) {
+		for(uint32_t i = firstSegment; i != lastSegment + 1; i++) {
+			::unlink(segmentPath(i).c_str());
+		}
+	}
+	onDisk = false;
+	segmentLengths.clear();
+}
+
+auto OfflineQueue::serialize(Bytes& bytes) const -> void {
+	appendInt(bytes, memory.size());
+	for(const auto& packet : memory) {
+		appendInt(bytes, packet->size());
+		bytes.insert(bytes.end(), packet->begin(), packet->end());
+	}
+
+	appendInt(bytes, onDisk);
+	appendInt(bytes, firstSegment);
+	appendInt(bytes, lastSegment);
+	appendInt(bytes, readOffset);
+	appendInt(bytes, segmentLengths.size());
+	for(size_t length : segmentLengths) {
+		appendInt(bytes, length);
+	}
+}
+
+auto OfflineQueue::deserialize(BytesView bytes, size_t& offset) -> Error {
+	auto [count, err] = readInt(bytes, offset);
+	if(err) {
+		return err;
+	}
+
+	for(uint32_t i = 0; i < count; i++) {
+		auto [length, lengthErr] = readInt(bytes, offset);
+		if(lengthErr) {
+			return lengthErr;
+		}
+
+		if(bytes.size() < offset + length) {
+			return "Offline queue state truncated";
+		}
+
+		memory.push_back(Outbox::share(Bytes(bytes.begin() + offset, bytes.begin() + offset + length)));
+		memoryBytes += length;
+		offset += length;
+	}
+
+	uint32_t values[5];
+	for(auto& value : values) {
+		std::tie(value, err) = readInt(bytes, offset);
+		if(err) {
+			return err;
+		}
+	}
+
+	onDisk = values[0];
+	firstSegment = values[1];
+	lastSegment = values[2];
+	readOffset = values[3];
+	if(onDisk && values[4] != lastSegment - firstSegment + 1) {
+		return "Offline queue state inconsistent";
+	}
+
+	for(uint32_t i = 0; i < values[4]; i++) {
+		auto [length, lengthErr] = readInt(bytes, offset);
+		if(lengthErr) {
+			return lengthErr;
+		}
+		segmentLengths.push_back(length);
+	}
+	return nullptr;
+}
+
+auto OfflineQueue::spill(const Bytes& packet) -> Error {
+	if(!onDisk) {
+		onDisk = true;
+		firstSegment = lastSegment = 0;
+		readOffset = 0;
+		segmentLengths.assign(1, 0);
+		closeFiles();
+	} else if(segmentLengths.back() > 0 && segmentLengths.back() + sizeof(uint32_t) + packet.size() > segmentSize) {
+		::close(writeFd);
+		writeFd = -1;
+		lastSegment++;
+		segmentLengths.push_back(0);
+	}
+
+	if(writeFd < 0) {
+		// a fresh segment may reuse the name of one a previous process left behind; a resumed one,
+		// handed over by the previous broker process, is written past what it already holds
+		int flags = segmentLengths.back() == 0 ? O_TRUNC : 0;
+		writeFd = ::open(segmentPath(lastSegment).c_str(), O_WRONLY | O_CREAT | O_CLOEXEC | flags, 0600);
+		if(writeFd < 0) {
+			return "Could not open offline queue segment";
+		}
+	}
+
+	Bytes length;
+	appendInt(length, packet.size());
+	iovec vectors[] = {
+		{
+			.iov_base = length.data(),
+			.iov_len = length.size(),
+		},
+		{
+			.iov_base = const_cast<Byte*>(packet.data()),
+			.iov_len = packet.size(),
+		},
+	};
+
+	auto result = ::pwritev(writeFd, vectors, 2, segmentLengths.back());
+	if(result != static_cast<ssize_t>(length.size() + packet.size())) {
+		return "Could not write offline queue segment";
+	}
+
+	segmentLengths.back() += result;
+	return nullptr;
+}
+
+auto OfflineQueue::readSegment() -> std::tuple<Outbox::Packet, Error> {
+	if(readFd < 0) {
+		readFd = ::open(segmentPath(firstSegment).c_str(), O_RDONLY | O_CLOEXEC);
+		if(readFd < 0) {
+			return {
+				nullptr,
+				"Could not open offline queue segment",
+			};
+		}
+	}
+
+	Byte lengthBytes[sizeof(uint32_t)];
+	if(::pread(readFd, lengthBytes, sizeof lengthBytes, readOffset) != sizeof lengthBytes) {
+		return {
+			nullptr,
+			"Offline queue segment truncated",
+		};
+	}
+
+	// a packet larger than segmentSize gets a segment of its own, so what the segment holds is the bound
+	auto [length, err] = fromBigEndianBytes<uint32_t>(BytesView(lengthBytes, sizeof lengthBytes));
+	if(readOffset + sizeof lengthBytes + length > segmentLengths.front()) {
+		return {
+			nullptr,
+			"Offline queue segment corrupt",
+		};
+	}
+
+	Bytes packet(length);
+	if(::pread(readFd, packet.data(), length, readOffset + sizeof lengthBytes) != length) {
+		return {
+			nullptr,
+			"Offline queue segment truncated",
+		};
+	}
+
+	readOffset += sizeof lengthBytes + length;
+
+	if(readOffset >= segmentLengths.front()) {
+		::close(readFd);
+		readFd = -1;
+		::unlink(segmentPath(firstSegment).c_str());
+		readOffset = 0;
+
+		if(firstSegment == lastSegment) {
+			closeFiles();
+			onDisk = false;
+			segmentLengths.clear();
+		} else {
+			firstSegment++;
+			segmentLengths.pop_front();
+		}
+	}
+
+	return {
+		Outbox::share(std::move(packet)),
+		nullptr,
+	};
+}
+
+auto OfflineQueue::segmentPath(uint32_t sequence) const -> std::string {
+	return prefix + '.' + std::to_string(sequence) + ".seg";
+}
+
+auto OfflineQueue::closeFiles() -> void {
+	if(readFd >= 0) {
+		::close(readFd);
+		readFd = -1;
+	}
+	if(writeFd >= 0) {
+		::close(writeFd);
+		writeFd = -1;
+	}
+}
@@ -0,0 +1,263 @@
+#include "outbox.hpp"
+
+#include <algorithm>
+#include <climits>
+#include <unordered_set>
+
+#include "mqtt.hpp"
+#include "slab_pool.hpp"
+
+// bulk bytes taken per writev, bounds how long a control packet can wait
+constexpr size_t maxBatchBytes = 64 * 1024;
+
+auto Outbox::share(Bytes bytes) -> Packet {
+	return std::allocate_shared<const Bytes>(SlabAllocator<Bytes>(), std::move(bytes));
+}
+
+Outbox::Outbox(UnixTcpSocket socket) : socket(socket) {
+	sender = std::thread(&Outbox::run, this);
+}
+
+Outbox::~Outbox() {
+	stop(false);
+}
+
+auto Outbox::push(Packet packet) -> void {
+	mutex.lock();
+	if(!closed) {
+		pendingBytes += packet->size();
+		queue.push_back(std::move(packet));
+		queuedAt.push_back(Clock::now());
+	}
+	mutex.unlock();
+	condition.notify_all();
+}
+
+auto Outbox::push(const std::vector<Packet>& packets) -> void {
+	mutex.lock();
+	if(!closed) {
+		for(const auto& packet : packets) {
+			pendingBytes += packet->size();
+		}
+		queue.insert(queue.end(), packets.begin(), packets.end());
+		queuedAt.insert(queuedAt.end(), packets.size(), Clock::now());
+	}
+	mutex.unlock();
+	condition.notify_all();
+}
+
+auto Outbox::pushControl(Packet packet) -> void {
+	mutex.lock();
+	if(!closed) {
+		pendingBytes += packet->size();
+		control.push_back(std::move(packet));
+	}
+	mutex.unlock();
+	condition.notify_all();
+}
+
+auto Outbox::waitUntilEmpty(std::chrono::milliseconds timeout) -> bool {
+	std::unique_lock lock(mutex);
+	return condition.wait_for(lock, timeout, [this]() {
+		return closed || (queue.empty() && control.empty() && !writing && !leased);
+	});
+}
+
+auto Outbox::waitUntilBelow(size_t bytes, std::chrono::milliseconds timeout) -> bool {
+	std::unique_lock lock(mutex);
+	condition.wait_for(lock, timeout, [this, bytes]() {
+		return closed || pendingBytes < bytes;
+	});
+	return !closed && pendingBytes < bytes;
+}
+
+auto Outbox::acquire(std::chrono::milliseconds timeout) -> bool {
+	std::unique_lock lock(mutex);
+	bool idle = condition.wait_for(lock, timeout, [this]() {
+		return closed || (queue.empty() && control.empty() && !writing && !leased);
+	});
+
+	if(closed || !idle) {
+		return false;
+	}
+
+	leased = true;
+	return true;
+}
+
+auto Outbox::release() -> void {
+	mutex.lock();
+	leased = false;
+	mutex.unlock();
+	condition.notify_all();
+}
+
+auto Outbox::descriptor() const -> int {
+	return socket.descriptor();
+}
+
+auto Outbox::stats() -> Stats {
+	std::lock_guard lock(mutex);
+
+	auto now = Clock::now();
+	Clock::duration oldest{};
+	if(writing) {
+		oldest = now - writingSince;
+	} else if(!queuedAt.empty()) {
+		oldest = now - queuedAt.front();
+	}
+
+	return {
+		.packets = queue.size() + control.size(),
+		.bytes = pendingBytes,
+		.oldest = oldest,
+		.unsent = socket.unsentBytes(),
+	};
+}
+
+auto Outbox::conflate() -> size_t {
+	std::lock_guard lock(mutex);
+
+	// walking backwards the first packet seen for a topic is the newest one
+	std::unordered_set<std::string_view> seen;
+	std::deque<Packet> kept;
+	std::deque<Clock::time_point> keptAt;
+	size_t dropped = 0;
+
+	for(size_t i = queue.size(); i-- > 0;) {
+		auto& packet = queue[i];
+		// QoS 1 and 2 publishes are owed to the subscriber, only QoS 0 ones may go
+		if(!packet->empty() && (packet->front() >> 4) == Mqtt::Publish && ((packet->front() >> 1) & 3) == 0) {
+			auto [topic, err] = Mqtt::peekTopic(*packet);
+			if(!err && !seen.insert(topic).second) {
+				pendingBytes -= packet->size();
+				dropped++;
+				continue;
+			}
+		}
+
+		kept.push_front(packet);
+		keptAt.push_front(queuedAt[i]);
+	}
+
+	queue = std::move(kept);
+	queuedAt = std::move(keptAt);
+	return dropped;
+}
+
+auto Outbox::close() -> void {
+	stop(true);
+}
+
+auto Outbox::stop(bool abort) -> void {
+	mutex.lock();
+	bool wasClosed = closed;
+	closed = true;
+	queue.clear();
+	control.clear();
+	queuedAt.clear();
+	pendingBytes = 0;
+	mutex.unlock();
+	condition.notify_all();
+
+	// unblocks a writev stuck on a peer that stopped reading
+	if(abort && !wasClosed) {
+		socket.shutdown();
+	}
+
+	// close() may race from several threads, all of them return only once the sender is gone
+	std::lock_guard joining(joinMutex);
+	if(sender.joinable()) {
+		sender.join();
+	}
+}
+
+auto Outbox::run() -> void {
+	std::vector<Packet> batch;
+	std::unique_lock lock(mutex);
+
+	while(true) {
+		condition.wait(lock, [this]() {
+			return closed || ((!queue.empty() || !control.empty()) && !leased);
+		});
+
+		if(closed) {
+			return;
+		}
+
+		batch.assign(std::make_move_iterator(control.begin()), std::make_move_iterator(control.end()));
+		control.clear();
+		writingSince = queuedAt.empty() ? Clock::now() : queuedAt.front();
+
+		// at least one bulk packet goes out per batch, however large
+		size_t taken = 0;
+		size_t batchBytes = 0;
+		while(taken < queue.size() && (taken == 0 || batchBytes + queue[taken]->size() <= maxBatchBytes)) {
+			batchBytes += queue[taken]->size();
+			batch.push_back(std::move(queue[taken]));
+			taken++;
+		}
+		queue.erase(queue.begin(), queue.begin() + taken);
+		queuedAt.erase(queuedAt.begin(), queuedAt.begin() + taken);
+		writing = true;
+		lock.unlock();
+
+		auto err = writeAll(batch);
+		size_t written = 0;
+		for(const auto& packet : batch) {
+			written += packet->size();
+		}
+		batch.clear();
+
+		lock.lock();
+		writing = false;
+		pendingBytes -= std::min(written, pendingBytes);
+		if(err) {
+			std::cerr << "Outbox: " << err << '\n';
+			queue.clear();
+			control.clear();
+			queuedAt.clear();
+			pendingBytes = 0;
+		}
+		condition.notify_all();
+	}
+}
+
+auto Outbox::writeAll(const std::vector<Packet>& batch) -> Error {
+	size_t next = 0;
+	while(next < batch.size()) {
+		vectors.clear();
+		while(next < batch.size() && vectors.size() < IOV_MAX) {
+			auto& packet = *batch[next++];
+			if(packet.empty()) {
+				continue;
+			}
+
+			vectors.push_back({
+				.iov_base = const_cast<Byte*>(packet.data()),
+				.iov_len = packet.size(),
+			});
+		}
+
+		size_t first = 0;
+		while(first < vectors.size()) {
+			auto [written, err] = socket.writev(vectors.data() + first, vectors.size() - first);
+			if(err) {
+				return err;
+			}
+
+			// skip fully written buffers and trim the one cut short
+			while(first < vectors.size() && written >= vectors[first].iov_len) {
+				written -= vectors[first].iov_len;
+				first++;
+			}
+
+			if(first < vectors.size()) {
+				vectors[first].iov_base = static_cast<Byte*>(vectors[first].iov_base) + written;
+				vectors[first].iov_len -= written;
+			}
+		}
+	}
+
+	return nullptr;
+}
@@ -0,0 +1,46 @@
+#include "token_bucket.hpp"
+
+#include <algorithm>
+
+TokenBucket::TokenBucket(double rate, double burst) 
+	: rate(rate), burst(std::max(burst, 1.0)), tokens(this->burst), last(Clock::now()) {}
+
+auto TokenBucket::tryTake(double amount) -> bool {
+	if(!enabled()) {
+		return true;
+	}
+
+	std::lock_guard lock(mutex);
+	refill(Clock::now());
+	if(tokens < amount) {
+		return false;
+	}
+
+	tokens -= amount;
+	return true;
+}
+
+auto TokenBucket::reserve(double amount) -> Clock::duration {
+	if(!enabled()) {
+		return Clock::duration::zero();
+	}
+
+	std::lock_guard lock(mutex);
+	refill(Clock::now());
+	tokens -= amount;
+	if(tokens >= 0.0) {
+		return Clock::duration::zero();
+	}
+
+	return std::chrono::duration_cast<Clock::duration>(std::chrono::duration<double>(-tokens / rate));
+}
+
+auto TokenBucket::enabled() const -> bool {
+	return rate > 0.0;
+}
+
+auto TokenBucket::refill(Clock::time_point now) -> void {
+	std::chrono::duration<double> elapsed = now - last;
+	tokens = std::min(burst, tokens + elapsed.count() * rate);
+	last = now;
+}
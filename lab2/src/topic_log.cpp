@@ -0,0 +1,401 @@
+#include "topic_log.hpp"
+
+#include <algorithm>
+#include <charconv>
+#include <filesystem>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/uio.h>
+#include <unistd.h>
+
+// records are [offset][timestamp][length] followed by the packet, all big endian
+constexpr size_t recordHeaderSize = 2 * sizeof(uint64_t) + sizeof(uint32_t);
+constexpr size_t indexEntrySize = 3 * sizeof(uint64_t);
+
+struct RecordHeader {
+	uint64_t offset;
+	int64_t timestamp;
+	uint32_t length;
+};
+
+template<typename T>
+static auto appendInt(Bytes& bytes, T value) -> void {
+	auto valueBytes = AsBigEndianBytes(value);
+	bytes.insert(bytes.end(), valueBytes.begin(), valueBytes.end());
+}
+
+template<typename T>
+static auto readInt(const Byte* bytes) -> T {
+	auto [value, err] = fromBigEndianBytes<T>(BytesView(bytes, sizeof(T)));
+	return value;
+}
+
+static auto readRecordHeader(const Byte* bytes) -> RecordHeader {
+	return {
+		.offset = readInt<uint64_t>(bytes),
+		.timestamp = readInt<int64_t>(bytes + sizeof(uint64_t)),
+		.length = readInt<uint32_t>(bytes + 2 * sizeof(uint64_t)),
+	};
+}
+
+static auto toMilliseconds(TopicLog::Clock::time_point time) -> int64_t {
+	return std::chrono::duration_cast<std::chrono::milliseconds>(time.time_since_epoch()).count();
+}
+
+TopicLog::TopicLog(std::string filter, std::string_view directory, size_t segmentSize, 
+		size_t indexInterval, std::chrono::seconds retention)
+	: name(std::move(filter)), segmentSize(segmentSize), indexInterval(indexInterval), retention(retention) {
+	// filters contain slashes and wildcards, hex keeps the directory name flat
+	constexpr const char* digits = "0123456789abcdef";
+	this->directory = directory;
+	this->directory += '/';
+	for(unsigned char c : name) {
+		this->directory += digits[c >> 4];
+		this->directory += digits[c & 15];
+	}
+}
+
+TopicLog::~TopicLog() {
+	for(auto& segment : segments) {
+		closeSegment(segment, false);
+	}
+}
+
+auto TopicLog::open() -> Error {
+	std::error_code ec;
+	std::filesystem::create_directories(directory, ec);
+	if(ec) {
+		return "Could not create topic log directory";
+	}
+
+	std::vector<uint64_t> bases;
+	for(const auto& entry : std::filesystem::directory_iterator(directory, ec)) {
+		auto file = entry.path().filename().string();
+		uint64_t base = 0;
+		if(file.size() == 20 && file.ends_with(".log")) {
+			auto [end, parseErr] = std::from_chars(file.data(), file.data() + 16, base, 16);
+			if(parseErr == std::errc() && end == file.data() + 16) {
+				bases.push_back(base);
+			}
+		}
+	}
+	std::sort(bases.begin(), bases.end());
+
+	std::lock_guard lock(mutex);
+	for(auto base : bases) {
+		if(auto err = openSegment(base, false); err) {
+			return err;
+		}
+	}
+
+	if(segments.empty()) {
+		return openSegment(0, true);
+	}
+
+	dropExpired();
+	return nullptr;
+}
+
+auto TopicLog::filter() const -> std::string_view {
+	return name;
+}
+
+auto TopicLog::append(BytesView packet) -> Error {
+	std::lock_guard lock(mutex);
+
+	size_t recordSize = recordHeaderSize + packet.size();
+	if(segments.back().size > 0 && segments.back().size + recordSize > segmentSize) {
+		if(auto err = openSegment(segments.back().nextOffset, true); err) {
+			return err;
+		}
+		dropExpired();
+	}
+
+	auto& segment = segments.back();
+	// kept monotonic so the index can be searched by time even if the clock steps back
+	auto timestamp = std::max(toMilliseconds(Clock::now()), segment.lastTimestamp);
+
+	Bytes header;
+	header.reserve(recordHeaderSize);
+	appendInt(header, segment.nextOffset);
+	appendInt(header, timestamp);
+	appendInt(header, static_cast<uint32_t>(packet.size()));
+
+	iovec vectors[] = {
+		{
+			.iov_base = header.data(),
+			.iov_len = header.size(),
+		},
+		{
+			.iov_base = const_cast<Byte*>(packet.data()),
+			.iov_len = packet.size(),
+		},
+	};
+
+	if(::pwritev(segment.fd, vectors, 2, segment.size) != static_cast<ssize_t>(recordSize)) {
+		return "Could not append to topic log";
+	}
+
+	if(segment.index.empty() || segment.size - segment.index.back().position >= indexInterval) {
+		addIndexEntry(segment, {
+			.offset = segment.nextOffset,
+			.timestamp = timestamp,
+			.position = segment.size,
+		});
+	}
+
+	segment.size += recordSize;
+	segment.nextOffset++;
+	segment.lastTimestamp = timestamp;
+	return nullptr;
+}
+
+auto TopicLog::read(uint64_t offset, size_t maxBytes) -> std::tuple<Records, uint64_t, Error> {
+	std::lock_guard lock(mutex);
+
+	Records records;
+	size_t bytes = 0;
+
+	// whatever expired is skipped
+	offset = std::max(offset, segments.front().baseOffset);
+
+	auto it = std::upper_bound(segments.begin(), segments.end(), offset, [](uint64_t offset, const Segment& segment) {
+		return offset < segment.baseOffset;
+	});
+	if(it != segments.begin()) {
+		--it;
+	}
+
+	for(; it != segments.end(); ++it) {
+		auto& segment = *it;
+		if(offset >= segment.nextOffset) {
+			continue;
+		}
+
+		if(auto err = mapSegment(segment); err) {
+			return {
+				records,
+				offset,
+				err,
+			};
+		}
+		records.mappings.push_back(segment.map);
+
+		auto entry = std::upper_bound(segment.index.begin(), segment.index.end(), offset, 
+				[](uint64_t offset, const IndexEntry& entry) {
+			return offset < entry.offset;
+		});
+		size_t position = entry == segment.index.begin() ? 0 : std::prev(entry)->position;
+
+		while(position < segment.size) {
+			auto header = readRecordHeader(segment.map->data + position);
+			if(header.offset >= offset) {
+				if(!records.packets.empty() && bytes + header.length > maxBytes) {
+					return {
+						records,
+						offset,
+						nullptr,
+					};
+				}
+
+				records.packets.emplace_back(segment.map->data + position + recordHeaderSize, header.length);
+				bytes += header.length;
+				offset = header.offset + 1;
+			}
+			position += recordHeaderSize + header.length;
+		}
+	}
+
+	return {
+		records,
+		offset,
+		nullptr,
+	};
+}
+
+auto TopicLog::offsetAt(Clock::time_point time) -> uint64_t {
+	std::lock_guard lock(mutex);
+	auto timestamp = toMilliseconds(time);
+
+	for(auto& segment : segments) {
+		if(segment.nextOffset == segment.baseOffset || segment.lastTimestamp < timestamp) {
+			continue;
+		}
+
+		if(mapSegment(segment)) {
+			break;
+		}
+
+		auto entry = std::lower_bound(segment.index.begin(), segment.index.end(), timestamp, 
+				[](const IndexEntry& entry, int64_t timestamp) {
+			return entry.timestamp < timestamp;
+		});
+		size_t position = entry == segment.index.begin() ? 0 : std::prev(entry)->position;
+
+		while(position < segment.size) {
+			auto header = readRecordHeader(segment.map->data + position);
+			if(header.timestamp >= timestamp) {
+				return header.offset;
+			}
+			position += recordHeaderSize + header.length;
+		}
+	}
+
+	return segments.back().nextOffset;
+}
+
+auto TopicLog::endOffset() -> uint64_t {
+	std::lock_guard lock(mutex);
+	return segments.back().nextOffset;
+}
+
+auto TopicLog::openSegment(uint64_t baseOffset, bool create) -> Error {
+	Segment segment = {
+		.path = segmentPath(baseOffset),
+		.baseOffset = baseOffset,
+		.nextOffset = baseOffset,
+	};
+
+	int flags = O_RDWR | O_CLOEXEC | (create ? O_CREAT | O_TRUNC : 0);
+	segment.fd = ::open((segment.path + ".log").c_str(), flags, 0600);
+	segment.indexFd = ::open((segment.path + ".idx").c_str(), O_RDWR | O_CREAT | O_CLOEXEC | (create ? O_TRUNC : 0), 0600);
+	if(segment.fd < 0 || segment.indexFd < 0) {
+		closeSegment(segment, false);
+		return "Could not open topic log segment";
+	}
+
+	struct stat info;
+	fstat(segment.fd, &info);
+	segment.size = info.st_size;
+
+	// a torn index entry is dropped, the scan below restores what it pointed at
+	fstat(segment.indexFd, &info);
+	size_t entries = info.st_size / indexEntrySize;
+	Bytes indexBytes(entries * indexEntrySize);
+	if(::pread(segment.indexFd, indexBytes.data(), indexBytes.size(), 0) != static_cast<ssize_t>(indexBytes.size())) {
+		entries = 0;
+	}
+
+	for(size_t i = 0; i < entries; i++) {
+		auto entry = indexBytes.data() + i * indexEntrySize;
+		IndexEntry indexEntry = {
+			.offset = readInt<uint64_t>(entry),
+			.timestamp = readInt<int64_t>(entry + sizeof(uint64_t)),
+			.position = readInt<uint64_t>(entry + 2 * sizeof(uint64_t)),
+		};
+
+		if(indexEntry.position >= segment.size) {
+			break;
+		}
+		segment.index.push_back(indexEntry);
+	}
+	ftruncate(segment.indexFd, segment.index.size() * indexEntrySize);
+
+	if(auto err = mapSegment(segment); err) {
+		closeSegment(segment, false);
+		return err;
+	}
+
+	scan(segment, segment.index.empty() ? 0 : segment.index.back().position);
+	segments.push_back(std::move(segment));
+	return nullptr;
+}
+
+auto TopicLog::scan(Segment& segment, size_t position) -> void {
+	size_t lastIndexed = segment.index.empty() ? 0 : segment.index.back().position;
+
+	while(position + recordHeaderSize <= segment.size) {
+		auto header = readRecordHeader(segment.map->data + position);
+		if(position + recordHeaderSize + header.length > segment.size) {
+			break;
+		}
+
+		if(segment.index.empty() || (position - lastIndexed >= indexInterval && position > lastIndexed)) {
+			addIndexEntry(segment, {
+				.offset = header.offset,
+				.timestamp = header.timestamp,
+				.position = position,
+			});
+			lastIndexed = position;
+		}
+
+		segment.nextOffset = header.offset + 1;
+		segment.lastTimestamp = header.timestamp;
+		position += recordHeaderSize + header.length;
+	}
+
+	// whatever follows the last whole record was cut off by a crash
+	if(position < segment.size) {
+		ftruncate(segment.fd, position);
+		segment.size = position;
+	}
+}
+
+auto TopicLog::mapSegment(Segment& segment) -> Error {
+	if(segment.size <= (segment.map ? segment.map->size : 0)) {
+		return nullptr;
+	}
+
+	// views into the previous mapping keep it alive until they are done
+	auto map = mmap(nullptr, segment.size, PROT_READ, MAP_SHARED, segment.fd, 0);
+	if(map == MAP_FAILED) {
+		segment.map = nullptr;
+		return "Could not map topic log segment";
+	}
+
+	segment.map = std::make_shared<const Mapping>(static_cast<const Byte*>(map), segment.size);
+	return nullptr;
+}
+
+auto TopicLog::closeSegment(Segment& segment, bool remove) -> void {
+	segment.map = nullptr;
+	if(segment.fd >= 0) {
+		::close(segment.fd);
+	}
+	if(segment.indexFd >= 0) {
+		::close(segment.indexFd);
+	}
+	segment.fd = segment.indexFd = -1;
+
+	if(remove) {
+		::unlink((segment.path + ".log").c_str());
+		::unlink((segment.path + ".idx").c_str());
+	}
+}
+
+auto TopicLog::addIndexEntry(Segment& segment, const IndexEntry& entry) -> void {
+	Bytes bytes;
+	appendInt(bytes, entry.offset);
+	appendInt(bytes, entry.timestamp);
+	appendInt(bytes, entry.position);
+	::pwrite(segment.indexFd, bytes.data(), bytes.size(), segment.index.size() * indexEntrySize);
+	segment.index.push_back(entry);
+}
+
+auto TopicLog::expire() -> void {
+	std::lock_guard lock(mutex);
+	dropExpired();
+}
+
+auto TopicLog::dropExpired() -> void {
+	auto cutoff = toMilliseconds(Clock::now() - retention);
+	while(segments.size() > 1 && segments.front().lastTimestamp < cutoff) {
+		closeSegment(segments.front(), true);
+		segments.pop_front();
+	}
+}
+
+TopicLog::Mapping::Mapping(const Byte* data, size_t size) : data(data), size(size) {
+}
+
+TopicLog::Mapping::~Mapping() {
+	munmap(const_cast<Byte*>(data), size);
+}
+
+auto TopicLog::segmentPath(uint64_t baseOffset) const -> std::string {
+	char file[32];
+	snprintf(file, sizeof file, "%016llx", static_cast<unsigned long long>(baseOffset));
+	return directory + '/' + file;
+}
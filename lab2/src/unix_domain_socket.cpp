@@ -0,0 +1,213 @@
+#include "unix_domain_socket.hpp"
+
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+#include <errno.h>
+#include <string.h>
+
+// Linux refuses to pass more than SCM_MAX_FD descriptors per message
+constexpr size_t maxDescriptorsPerMessage = 253;
+
+static auto makeAddress(std::string_view path, sockaddr_un& address) -> Error {
+	if(path.size() >= sizeof address.sun_path) {
+		return "Unix socket path is too long";
+	}
+
+	memset(&address, 0, sizeof address);
+	address.sun_family = AF_UNIX;
+	std::copy(path.begin(), path.end(), address.sun_path);
+	return nullptr;
+}
+
+auto UnixDomainSocket::create() -> std::tuple<UnixDomainSocket, Error> {
+	UnixDomainSocket domainSocket;
+	domainSocket.fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+	if(domainSocket.fd < 0) {
+		return {
+			domainSocket,
+			"Could not create unix socket",
+		};
+	}
+
+	return {
+		domainSocket,
+		nullptr,
+	};
+}
+
+auto UnixDomainSocket::connect(std::string_view path) -> Error {
+	sockaddr_un address;
+	auto err = makeAddress(path, address);
+	if(err) {
+		return err;
+	}
+
+	int result = ::connect(fd, reinterpret_cast<const sockaddr*>(&address), sizeof address);
+	if(result != 0) {
+		return "Could not connect to unix socket";
+	}
+
+	return nullptr;
+}
+
+auto UnixDomainSocket::listen(std::string_view path) -> Error {
+	sockaddr_un address;
+	auto err = makeAddress(path, address);
+	if(err) {
+		return err;
+	}
+
+	// a stale path left behind by a crashed process would make bind fail
+	::unlink(address.sun_path);
+
+	int result = ::bind(fd, reinterpret_cast<const sockaddr*>(&address), sizeof address);
+	if(result != 0) {
+		return "Error binding unix socket";
+	}
+
+	result = ::listen(fd, 1);
+	if(result != 0) {
+		return "Could not set unix socket into listening state";
+	}
+
+	return nullptr;
+}
+
+auto UnixDomainSocket::accept() -> std::tuple<UnixDomainSocket, Error> {
+	int cfd = ::accept4(fd, nullptr, nullptr, SOCK_CLOEXEC);
+	if(cfd == -1) {
+		return {
+			UnixDomainSocket(),
+			"Failed to accept incoming unix connection",
+		};
+	}
+
+	UnixDomainSocket peer;
+	peer.fd = cfd;
+
+	return {
+		peer,
+		nullptr,
+	};
+}
+
+auto UnixDomainSocket::read(size_t howManyBytes) const -> std::tuple<Bytes, Error> {
+	Bytes bytes(howManyBytes);
+	size_t offset = 0;
+	while(offset < bytes.size()) {
+		auto result = ::read(fd, bytes.data() + offset, bytes.size() - offset);
+		if(result < 0 && errno == EINTR) {
+			continue;
+		} else if(result <= 0) {
+			return {
+				{},
+				"Reading from unix socket failed",
+			};
+		}
+		offset += result;
+	}
+
+	return {
+		bytes,
+		nullptr,
+	};
+}
+
+auto UnixDomainSocket::write(const BytesView bytes) const -> Error {
+	size_t offset = 0;
+	while(offset < bytes.size()) {
+		auto result = ::write(fd, bytes.data() + offset, bytes.size() - offset);
+		if(result < 0 && errno == EINTR) {
+			continue;
+		} else if(result < 0) {
+			return "Writing to unix socket failed";
+		}
+		offset += result;
+	}
+
+	return nullptr;
+}
+
+auto UnixDomainSocket::sendDescriptors(const std::vector<int>& descriptors) const -> Error {
+	for(size_t sent = 0; sent < descriptors.size(); sent += maxDescriptorsPerMessage) {
+		size_t count = std::min(maxDescriptorsPerMessage, descriptors.size() - sent);
+
+		// at least one byte of real data has to accompany the ancillary data
+		Byte dummy = 0;
+		iovec vector = {
+			.iov_base = &dummy,
+			.iov_len = sizeof dummy,
+		};
+
+		std::vector<Byte> control(CMSG_SPACE(count * sizeof(int)));
+		msghdr message = {};
+		message.msg_iov = &vector;
+		message.msg_iovlen = 1;
+		message.msg_control = control.data();
+		message.msg_controllen = control.size();
+
+		auto header = CMSG_FIRSTHDR(&message);
+		header->cmsg_level = SOL_SOCKET;
+		header->cmsg_type = SCM_RIGHTS;
+		header->cmsg_len = CMSG_LEN(count * sizeof(int));
+		memcpy(CMSG_DATA(header), descriptors.data() + sent, count * sizeof(int));
+
+		if(::sendmsg(fd, &message, 0) < 0) {
+			return "Could not pass descriptors over unix socket";
+		}
+	}
+
+	return nullptr;
+}
+
+auto UnixDomainSocket::receiveDescriptors(size_t howMany) const -> std::tuple<std::vector<int>, Error> {
+	std::vector<int> descriptors;
+	descriptors.reserve(howMany);
+
+	while(descriptors.size() < howMany) {
+		size_t count = std::min(maxDescriptorsPerMessage, howMany - descriptors.size());
+
+		Byte dummy = 0;
+		iovec vector = {
+			.iov_base = &dummy,
+			.iov_len = sizeof dummy,
+		};
+
+		std::vector<Byte> control(CMSG_SPACE(count * sizeof(int)));
+		msghdr message = {};
+		message.msg_iov = &vector;
+		message.msg_iovlen = 1;
+		message.msg_control = control.data();
+		message.msg_controllen = control.size();
+
+		if(::recvmsg(fd, &message, MSG_CMSG_CLOEXEC) <= 0) {
+			return {
+				descriptors,
+				"Could not receive descriptors over unix socket",
+			};
+		}
+
+		auto header = CMSG_FIRSTHDR(&message);
+		if(header == nullptr || header->cmsg_level != SOL_SOCKET || header->cmsg_type != SCM_RIGHTS
+				|| (message.msg_flags & MSG_CTRUNC)) {
+			return {
+				descriptors,
+				"Unix socket message did not carry the expected descriptors",
+			};
+		}
+
+		size_t received = (header->cmsg_len - CMSG_LEN(0)) / sizeof(int);
+		auto first = reinterpret_cast<const int*>(CMSG_DATA(header));
+		descriptors.insert(descriptors.end(), first, first + received);
+	}
+
+	return {
+		descriptors,
+		nullptr,
+	};
+}
+
+auto UnixDomainSocket::close() -> void {
+	::close(fd);
+}
@@ -0,0 +1,292 @@
+#include "write_ahead_log.hpp"
+
+#include "affinity.hpp"
+
+#include <algorithm>
+#include <array>
+#include <charconv>
+#include <filesystem>
+
+#include <fcntl.h>
+#include <unistd.h>
+
+// every record is framed as [length][crc32], both big endian, a torn tail fails the check
+constexpr size_t frameSize = 2 * sizeof(uint32_t);
+
+static constexpr auto crcTable = []() {
+	std::array<uint32_t, 256> table = {};
+	for(uint32_t i = 0; i < table.size(); i++) {
+		uint32_t value = i;
+		for(int bit = 0; bit < 8; bit++) {
+			value = (value & 1) ? 0xedb88320 ^ (value >> 1) : value >> 1;
+		}
+		table[i] = value;
+	}
+	return table;
+}();
+
+static auto crc32(BytesView bytes) -> uint32_t {
+	uint32_t crc = 0xffffffff;
+	for(auto byte : bytes) {
+		crc = crcTable[(crc ^ byte) & 0xff] ^ (crc >> 8);
+	}
+	return ~crc;
+}
+
+static auto appendRecord(Bytes& bytes, BytesView record) -> void {
+	uint32_t length = record.size();
+	uint32_t crc = crc32(record);
+	auto lengthBytes = AsBigEndianBytes(length);
+	auto crcBytes = AsBigEndianBytes(crc);
+	bytes.insert(bytes.end(), lengthBytes.begin(), lengthBytes.end());
+	bytes.insert(bytes.end(), crcBytes.begin(), crcBytes.end());
+	bytes.insert(bytes.end(), record.begin(), record.end());
+}
+
+// segments are named by an eight digit hex sequence number
+static auto parseSequence(const std::filesystem::path& path) -> std::tuple<uint32_t, bool> {
+	auto name = path.filename().string();
+	uint32_t sequence = 0;
+	if(name.size() != 12 || !name.ends_with(".wal")) {
+		return {
+			0,
+			false,
+		};
+	}
+
+	auto [end, ec] = std::from_chars(name.data(), name.data() + 8, sequence, 16);
+	return {
+		sequence,
+		ec == std::errc() && end == name.data() + 8,
+	};
+}
+
+static auto writeFully(int fd, BytesView bytes) -> bool {
+	size_t offset = 0;
+	while(offset < bytes.size()) {
+		auto result = ::write(fd, bytes.data() + offset, bytes.size() - offset);
+		if(result < 0 && errno == EINTR) {
+			continue;
+		} else if(result < 0) {
+			return false;
+		}
+		offset += result;
+	}
+	return true;
+}
+
+// stops at the first short or corrupt record, which is where a crash cut the segment off
+static auto recoverSegment(const std::string& path, const WriteAheadLog::Recovery& recover) -> void {
+	int fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+	if(fd < 0) {
+		return;
+	}
+
+	Bytes record;
+	Byte frame[frameSize];
+	off_t offset = 0;
+	while(::pread(fd, frame, frameSize, offset) == frameSize) {
+		auto [length, lengthErr] = fromBigEndianBytes<uint32_t>(BytesView(frame, sizeof(uint32_t)));
+		auto [crc, crcErr] = fromBigEndianBytes<uint32_t>(BytesView(frame + sizeof(uint32_t), sizeof(uint32_t)));
+
+		record.resize(length);
+		if(::pread(fd, record.data(), length, offset + frameSize) != length || crc32(record) != crc) {
+			break;
+		}
+
+		recover(record);
+		offset += frameSize + length;
+	}
+
+	::close(fd);
+}
+
+WriteAheadLog::WriteAheadLog(std::string directory, size_t segmentSize, 
+		std::chrono::microseconds commitDelay, size_t commitBytes)
+	: directory(std::move(directory)), segmentSize(segmentSize), 
+	commitDelay(commitDelay), commitBytes(commitBytes) {}
+
+WriteAheadLog::~WriteAheadLog() {
+	mutex.lock();
+	closed = true;
+	mutex.unlock();
+	condition.notify_all();
+
+	if(committer.joinable()) {
+		committer.join();
+	}
+
+	if(fd >= 0) {
+		::close(fd);
+	}
+}
+
+auto WriteAheadLog::open(const Recovery& recover, Checkpoint checkpoint) -> Error {
+	this->checkpoint = std::move(checkpoint);
+
+	std::error_code ec;
+	std::filesystem::create_directories(directory, ec);
+	if(ec) {
+		return "Could not create write-ahead log directory";
+	}
+
+	std::vector<uint32_t> sequences;
+	for(const auto& entry : std::filesystem::directory_iterator(directory, ec)) {
+		if(auto [segment, valid] = parseSequence(entry.path()); valid) {
+			sequences.push_back(segment);
+		}
+	}
+	std::sort(sequences.begin(), sequences.end());
+
+	for(auto segment : sequences) {
+		recoverSegment(segmentPath(segment), recover);
+	}
+
+	sequence = sequences.empty() ? 0 : sequences.back();
+	auto err = startSegment();
+	if(err) {
+		return err;
+	}
+
+	committer = std::thread(&WriteAheadLog::run, this);
+	return nullptr;
+}
+
+auto WriteAheadLog::append(BytesView record, Completion done) -> void {
+	mutex.lock();
+	if(pending.empty()) {
+		oldest = std::chrono::steady_clock::now();
+	}
+	appendRecord(pending, record);
+	completions.push_back(std::move(done));
+	bool wake = completions.size() == 1 || pending.size() >= commitBytes;
+	mutex.unlock();
+
+	if(wake) {
+		condition.notify_all();
+	}
+}
+
+auto WriteAheadLog::flush() -> void {
+	std::unique_lock lock(mutex);
+	condition.wait(lock, [this]() {
+		return closed || (pending.empty() && !committing);
+	});
+}
+
+auto WriteAheadLog::pin(const std::vector<int>& cpus) -> Error {
+	if(!committer.joinable()) {
+		return "Log is not open";
+	}
+
+	return Affinity::pin(cpus, committer.native_handle());
+}
+
+auto WriteAheadLog::run() -> void {
+	Bytes batch;
+	std::vector<Completion> done;
+	std::unique_lock lock(mutex);
+
+	while(true) {
+		condition.wait(lock, [this]() {
+			return closed || !pending.empty();
+		});
+
+		if(pending.empty()) {
+			return;
+		}
+
+		// whatever arrived during the last sync is already a batch, a delay only helps light load
+		if(commitDelay.count() > 0 && pending.size() < commitBytes) {
+			condition.wait_until(lock, oldest + commitDelay, [this]() {
+				return closed || pending.size() >= commitBytes;
+			});
+		}
+
+		std::swap(batch, pending);
+		std::swap(done, completions);
+		committing = true;
+		lock.unlock();
+
+		auto err = commit(batch);
+		for(auto& completion : done) {
+			completion(err);
+		}
+		batch.clear();
+		done.clear();
+
+		lock.lock();
+		committing = false;
+		condition.notify_all();
+	}
+}
+
+auto WriteAheadLog::commit(const Bytes& batch) -> Error {
+	if(!writeFully(fd, batch) || ::fdatasync(fd) != 0) {
+		return "Could not write the write-ahead log";
+	}
+
+	segmentOffset += batch.size();
+	if(segmentOffset >= segmentSize) {
+		if(auto err = startSegment(); err) {
+			// the batch itself is durable, the old segment just keeps growing
+			std::cerr << err << '\n';
+		}
+	}
+
+	return nullptr;
+}
+
+auto WriteAheadLog::startSegment() -> Error {
+	auto previous = sequence;
+	int next = ::open(segmentPath(sequence + 1).c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_APPEND | O_CLOEXEC, 0600);
+	if(next < 0) {
+		return "Could not create write-ahead log segment";
+	}
+
+	Bytes bytes;
+	if(checkpoint) {
+		for(const auto& record : checkpoint()) {
+			appendRecord(bytes, record);
+		}
+	}
+
+	if(!writeFully(next, bytes) || ::fdatasync(next) != 0) {
+		::close(next);
+		::unlink(segmentPath(sequence + 1).c_str());
+		return "Could not write write-ahead log checkpoint";
+	}
+
+	// the new name has to be durable before the segments it replaces disappear
+	int dir = ::open(directory.c_str(), O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+	if(dir >= 0) {
+		::fsync(dir);
+		::close(dir);
+	}
+
+	if(fd >= 0) {
+		::close(fd);
+	}
+	fd = next;
+	sequence++;
+	segmentOffset = bytes.size();
+
+	std::error_code ec;
+	std::vector<std::filesystem::path> stale;
+	for(const auto& entry : std::filesystem::directory_iterator(directory, ec)) {
+		if(auto [segment, valid] = parseSequence(entry.path()); valid && segment <= previous) {
+			stale.push_back(entry.path());
+		}
+	}
+	for(const auto& path : stale) {
+		std::filesystem::remove(path, ec);
+	}
+
+	return nullptr;
+}
+
+auto WriteAheadLog::segmentPath(uint32_t sequence) const -> std::string {
+	char name[16];
+	snprintf(name, sizeof name, "%08x.wal", sequence);
+	return directory + '/' + name;
+}
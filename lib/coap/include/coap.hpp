@@ -1,6 +1,7 @@
 #pragma once
 #include <cstdint>
 #include <string>
+#include <tuple>
 
 #include "common.hpp"
 
@@ -107,68 +108,26 @@ public:
 private:
 	static auto decodeHeader(Message& message, BytesView bytes, size_t& offset) -> Error;
 
-	struct HeaderRepresentation {
-	private:
-		constexpr static uint32_t versionMask = 0b11000000000000000000000000000000;
-		constexpr static uint32_t versionShift = 30u;
-
-		constexpr static uint32_t typeMask = 0b00110000000000000000000000000000;
-		constexpr static uint32_t typeShift = 28u;
-
-		constexpr static uint32_t tokenLengthMask = 0b00001111000000000000000000000000;
-		constexpr static uint32_t tokenLengthShift = 24u;
-
-		constexpr static uint32_t codeMask = 0b00000000111111110000000000000000;
-		constexpr static uint32_t codeShift = 16u;
-
-		constexpr static uint32_t messageIdMask = 0b00000000000000001111111111111111;
-		constexpr static uint32_t messageIdShift = 0u;
-	public:
-		uint32_t data = 0;
+	// the fixed header, from the most significant bit: version, type, token length, code and message id
+	struct HeaderRepresentation : PackedWord<uint32_t> {
+		using VersionField = BitField<uint32_t, 30, 2>;
+		using TypeField = BitField<uint32_t, 28, 2>;
+		using TokenLengthField = BitField<uint32_t, 24, 4>;
+		using CodeField = BitField<uint32_t, 16, 8>;
+		using MessageIdField = BitField<uint32_t, 0, 16>;
+		static_assert(WordLayout<uint32_t, VersionField, TypeField, TokenLengthField, CodeField,
+			MessageIdField>::tiles());
 
 		static auto fromMessage(const Message& message) -> HeaderRepresentation;
-
-		auto setVersion(uint32_t version) -> void;
-
-		auto setType(uint32_t type) -> void;
-
-		auto setTokenLength(uint32_t length) -> void;
-
-		auto setCode(uint32_t code) -> void;
-
-		auto setMessageId(uint32_t id) -> void;
-
-		auto getVersion() const -> uint32_t;
-
-		auto getType() const -> uint32_t;
-
-		auto getTokenLength() const -> uint32_t;
-
-		auto getCode() const -> uint32_t;
-
-		auto getMessageId() const -> uint32_t;
 	};
 
-	struct OptionRepresentation {
-	private:
-		constexpr static uint8_t typeMask = 0xF0;
-		constexpr static uint8_t typeShift = 4;
-
-		constexpr static uint8_t lengthMask = 0x0F;
-		constexpr static uint8_t lengthShift = 0;
-
-	public:
-		uint8_t data = 0;
+	// an option's first byte: the delta to the previous option's type and the value's length
+	struct OptionRepresentation : PackedWord<uint8_t> {
+		using TypeField = BitField<uint8_t, 4, 4>;
+		using LengthField = BitField<uint8_t, 0, 4>;
+		static_assert(WordLayout<uint8_t, TypeField, LengthField>::tiles());
 
 		static auto fromOption(const Option& option) -> OptionRepresentation;
-
-		auto setType(uint8_t type) -> void;
-
-		auto setLength(uint8_t length) -> void;
-
-		auto getType()  const-> uint8_t;
-
-		auto getLength() const -> uint8_t;
 	};
 };
 
@@ -0,0 +1,66 @@
+#pragma once
+#include <chrono>
+#include <functional>
+#include <random>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+
+#include "coap.hpp"
+#include "reactor.hpp"
+#include "unix_udp_socket.hpp"
+
+// CoAP client on a reactor of its own. Requests are confirmable and every
+// one of them is retransmitted on a reactor timer, with the timeout doubling
+// each time, until its piggybacked response arrives or the retransmissions
+// run out (RFC 7252, section 4.2). A lost datagram costs a retransmission
+// instead of a thread blocked forever. Requests may be made from any thread,
+// responses are handed over on the loop thread.
+class CoapClient {
+public:
+	// the response, or an error once the last retransmission went unanswered
+	using ResponseHandler = std::function<void(const Coap::Message& response, Error err)>;
+
+	struct Options {
+		std::string address;
+		uint16_t port = 5683;
+		// the first timeout is drawn between ackTimeout and one and a half times that
+		std::chrono::milliseconds ackTimeout = std::chrono::seconds(2);
+		size_t maxRetransmit = 4;
+	};
+
+	CoapClient(Options options);
+	~CoapClient();
+
+	CoapClient(const CoapClient&) = delete;
+	auto operator=(const CoapClient&) -> CoapClient& = delete;
+
+	auto open() -> Error;
+	auto get(std::string_view path, ResponseHandler handler) -> void;
+	// type and id are set here, may be called from any thread
+	auto request(Coap::Message message, ResponseHandler handler) -> void;
+	// runs the event loop until stop is called
+	auto run() -> Error;
+	auto stop() -> void;
+private:
+	struct Exchange {
+		Bytes datagram;
+		ResponseHandler handler;
+		Reactor::Clock::duration timeout;
+		size_t retransmissions;
+		Reactor::TimerId timer;
+	};
+
+	auto transmit(uint16_t id) -> void;
+	auto retransmit(uint16_t id) -> void;
+	auto receive() -> void;
+
+	Options options;
+	Reactor reactor;
+	UnixUdpSocket socket;
+	bool opened = false;
+	// touched by the loop thread only
+	std::unordered_map<uint16_t, Exchange> exchanges;
+	uint16_t nextId;
+	std::minstd_rand random;
+};
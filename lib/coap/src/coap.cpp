@@ -181,7 +181,7 @@ auto Coap::encode(const Message& message) -> Bytes {
 	uint32_t sumOptionsDataSize = 0;
 	for(size_t i = 0; i < message.options.size(); i++) {
 		options[i] = OptionRepresentation::fromOption(message.options[i]);
-		sumOptionsDataSize += options[i].getLength();
+		sumOptionsDataSize += options[i].get<OptionRepresentation::LengthField>();
 	}
 
 	auto sumBytes = sizeof(header) + (options.size() * sizeof(Option))
@@ -192,7 +192,7 @@ auto Coap::encode(const Message& message) -> Bytes {
 
 	// Header
 	{
-		auto headerAsBytes = AsBytes(header);
+		auto headerAsBytes = AsBigEndianBytes(header);
 		bytes.insert(bytes.end(), headerAsBytes.begin(), headerAsBytes.end());
 	}
 
@@ -202,14 +202,14 @@ auto Coap::encode(const Message& message) -> Bytes {
 	// Options
 	for(size_t i = 0; i < message.options.size(); i++) {
 		auto option = options[i];
-		auto optionAsBytes = AsBytes(option);
+		auto optionAsBytes = AsBigEndianBytes(option);
 		bytes.insert(bytes.end(), optionAsBytes.begin(), optionAsBytes.end());
 
 		if(message.options[i].isUint32()) {
-			auto unsignedAsBytes = AsBytes(message.options[i].uint32);
+			auto unsignedAsBytes = AsBigEndianBytes(message.options[i].uint32);
 			bytes.insert(bytes.end(), unsignedAsBytes.begin(), unsignedAsBytes.end());
 		} else if(message.options[i].isUint16()) {
-			auto unsignedAsBytes = AsBytes(message.options[i].uint16);
+			auto unsignedAsBytes = AsBigEndianBytes(message.options[i].uint16);
 			bytes.insert(bytes.end(), unsignedAsBytes.begin(), unsignedAsBytes.end());
 		} else if(message.options[i].isString()) {
 			bytes.insert(bytes.end(), message.options[i].string.begin(),
@@ -275,7 +275,7 @@ auto Coap::decode(BytesView bytes) -> std::tuple<Message, Error> {
 		auto optionEnd = bytes.begin() + offset;
 
 		auto optionBytes = BytesView(optionBegin, optionEnd);
-		auto [optionRep, err] = fromBytes<OptionRepresentation>(optionBytes);
+		auto [optionRep, err] = fromBigEndianBytes<OptionRepresentation>(optionBytes);
 		if(err) {
 			return {
 				message,
@@ -285,17 +285,17 @@ auto Coap::decode(BytesView bytes) -> std::tuple<Message, Error> {
 
 		Option option;
 
-		prevDelta += optionRep.getType();
+		prevDelta += optionRep.get<OptionRepresentation::TypeField>();
 		option.type = static_cast<Coap::OptionType>(prevDelta);
 
 		auto valueBegin = bytes.begin() + offset;
-		offset += optionRep.getLength();
+		offset += optionRep.get<OptionRepresentation::LengthField>();
 		auto valueEnd = bytes.begin() + offset;
 		auto valueBytes = BytesView(valueBegin, valueEnd);
 
 		if(valueBytes.size() > 0) {
 			if(option.isUint32()) {
-				auto [value, err] = fromBytes<uint32_t>(valueBytes);
+				auto [value, err] = fromBigEndianBytes<uint32_t>(valueBytes);
 				if(err) {
 					return {
 						message,
@@ -305,7 +305,7 @@ auto Coap::decode(BytesView bytes) -> std::tuple<Message, Error> {
 
 				option.uint32 = value;
 			} else if(option.isUint16()) {
-				auto [value, err] = fromBytes<uint16_t>(valueBytes);
+				auto [value, err] = fromBigEndianBytes<uint16_t>(valueBytes);
 				if(err) {
 					return {
 						message,
@@ -347,99 +347,47 @@ auto Coap::decodeHeader(Message& message, BytesView bytes, size_t& offset) -> Er
 	}
 
 	auto headerBytes = BytesView(bytes.begin(), bytes.begin() + offset);
-	auto [header, headerErr] = fromBytes<HeaderRepresentation>(headerBytes);
+	auto [header, headerErr] = fromBigEndianBytes<HeaderRepresentation>(headerBytes);
 
 	if(headerErr) {
 		return headerErr;
 	}
 
-	uint32_t version = header.getVersion();
+	uint32_t version = header.get<HeaderRepresentation::VersionField>();
 	if(version != 1) {
 		return "Message had a bad version ( != 1)";
 	}
 
-	message.type = static_cast<Coap::Type>(header.getType());
-	message.code = static_cast<Coap::Code>(header.getCode());
-	message.id = header.getMessageId();
-	message.tokens.resize(header.getTokenLength());
+	message.type = static_cast<Coap::Type>(header.get<HeaderRepresentation::TypeField>());
+	message.code = static_cast<Coap::Code>(header.get<HeaderRepresentation::CodeField>());
+	message.id = header.get<HeaderRepresentation::MessageIdField>();
+	message.tokens.resize(header.get<HeaderRepresentation::TokenLengthField>());
 	return nullptr;
 }
 
 auto Coap::HeaderRepresentation::fromMessage(const Message& message) -> HeaderRepresentation {
 	HeaderRepresentation header;
-	header.setVersion(1);
-	header.setType(message.type);
-	header.setTokenLength(message.tokens.size());
-	header.setCode(message.code);
-	header.setMessageId(message.id);
+	header.set<VersionField>(1);
+	header.set<TypeField>(message.type);
+	header.set<TokenLengthField>(message.tokens.size());
+	header.set<CodeField>(message.code);
+	header.set<MessageIdField>(message.id);
 	return header;
 }
 
-auto Coap::HeaderRepresentation::setVersion(uint32_t version) -> void {
-	setIntSegment(data, version, versionMask, versionShift);
-}
-
-auto Coap::HeaderRepresentation::setType(uint32_t type) -> void {
-	setIntSegment(data, type, typeMask, typeShift);
-}
-
-auto Coap::HeaderRepresentation::setTokenLength(uint32_t length) -> void {
-	setIntSegment(data, length, tokenLengthMask, tokenLengthShift);
-}
-
-auto Coap::HeaderRepresentation::setCode(uint32_t code) -> void {
-	setIntSegment(data, code, codeMask, codeShift);
-}
-
-auto Coap::HeaderRepresentation::setMessageId(uint32_t id) -> void {
-	setIntSegment(data, id, messageIdMask, messageIdShift);
-}
-
 auto Coap::OptionRepresentation::fromOption(const Option& option) -> OptionRepresentation {
 	OptionRepresentation optionRep;
-	optionRep.setType(option.type);
+	optionRep.set<TypeField>(option.type);
 	if(option.isUint32()) {
-		optionRep.setLength(sizeof(uint32_t));
+		optionRep.set<LengthField>(sizeof(uint32_t));
 	} else if(option.isUint16()) {
-		optionRep.setLength(sizeof(uint16_t));
+		optionRep.set<LengthField>(sizeof(uint16_t));
 	} else if(option.isString()) {
-		optionRep.setLength(option.string.size());
+		optionRep.set<LengthField>(option.string.size());
 	}
 	return optionRep;
 }
 
-auto Coap::HeaderRepresentation::getVersion() const -> uint32_t {
-	return getIntSegment(data, versionMask, versionShift);
-}
-auto Coap::HeaderRepresentation::getType() const -> uint32_t {
-	return getIntSegment(data, typeMask, typeShift);
-}
-auto Coap::HeaderRepresentation::getTokenLength() const -> uint32_t {
-	return getIntSegment(data, tokenLengthMask, tokenLengthShift);
-}
-auto Coap::HeaderRepresentation::getCode() const -> uint32_t {
-	return getIntSegment(data, codeMask, codeShift);
-}
-auto Coap::HeaderRepresentation::getMessageId() const -> uint32_t {
-	return getIntSegment(data, messageIdMask, messageIdShift);
-}
-
-auto Coap::OptionRepresentation::setType(uint8_t type) -> void {
-	setIntSegment(data, type, typeMask, typeShift);
-}
-
-auto Coap::OptionRepresentation::setLength(uint8_t length) -> void {
-	setIntSegment(data, length, lengthMask, lengthShift);
-}
-
-auto Coap::OptionRepresentation::getType()  const-> uint8_t {
-	return getIntSegment(data, typeMask, typeShift);
-}
-
-auto Coap::OptionRepresentation::getLength() const -> uint8_t {
-	return getIntSegment(data, lengthMask, lengthShift);
-}
-
 std::ostream& operator<<(std::ostream& os, const Coap::Message& message) {
 	os << "Type: " << Coap::toString(message.type) 
 		<< " Code: " << Coap::toString(message.code) 
@@ -0,0 +1,154 @@
+#include "coap_client.hpp"
+
+#include <iostream>
+
+#include <sys/epoll.h>
+
+// largest datagram a response may arrive in
+constexpr size_t maxDatagram = 1500;
+
+CoapClient::CoapClient(Options options) : options(std::move(options)), random(std::random_device()()) {
+	nextId = static_cast<uint16_t>(random());
+}
+
+CoapClient::~CoapClient() {
+	if(opened) {
+		reactor.unwatch(socket.descriptor());
+		socket.close();
+	}
+}
+
+auto CoapClient::open() -> Error {
+	if(auto err = reactor.open(); err) {
+		return err;
+	}
+
+	Error err = nullptr;
+	std::tie(socket, err) = UnixUdpSocket::create();
+	if(err) {
+		return err;
+	}
+
+	if(err = socket.connect(options.address, options.port); !err) {
+		err = reactor.watch(socket.descriptor(), EPOLLIN, [this](uint32_t events) {
+			receive();
+		});
+	}
+	if(err) {
+		socket.close();
+		return err;
+	}
+
+	opened = true;
+	return nullptr;
+}
+
+auto CoapClient::get(std::string_view path, ResponseHandler handler) -> void {
+	request(Coap::Message{
+		.type = Coap::Type::Confirmable,
+		.code = Coap::Code::Get,
+		.id = 0,
+		.tokens = {},
+		.options = {
+			{
+				.string = std::string(path),
+				.type = Coap::OptionType::UriPath,
+			}
+		},
+		.payload = {},
+	}, std::move(handler));
+}
+
+auto CoapClient::request(Coap::Message message, ResponseHandler handler) -> void {
+	reactor.post([this, message = std::move(message), handler = std::move(handler)]() mutable {
+		while(exchanges.contains(nextId)) {
+			nextId++;
+		}
+		auto id = nextId++;
+
+		message.type = Coap::Type::Confirmable;
+		message.id = id;
+
+		std::uniform_int_distribution<Reactor::Clock::rep> spread(0, Reactor::Clock::duration(options.ackTimeout).count() / 2);
+		exchanges.emplace(id, Exchange{
+			.datagram = Coap::encode(message),
+			.handler = std::move(handler),
+			.timeout = options.ackTimeout + Reactor::Clock::duration(spread(random)),
+			.retransmissions = 0,
+			.timer = 0,
+		});
+		transmit(id);
+	});
+}
+
+auto CoapClient::run() -> Error {
+	return reactor.run();
+}
+
+auto CoapClient::stop() -> void {
+	reactor.stop();
+}
+
+auto CoapClient::transmit(uint16_t id) -> void {
+	auto& exchange = exchanges.at(id);
+
+	// a datagram that could not be sent counts as lost, the retransmission timer covers both
+	if(auto [count, err] = socket.write(exchange.datagram); err) {
+		std::cerr << "CoAP: " << err << '\n';
+	}
+
+	exchange.timer = reactor.schedule(exchange.timeout, [this, id]() {
+		retransmit(id);
+	});
+}
+
+auto CoapClient::retransmit(uint16_t id) -> void {
+	auto it = exchanges.find(id);
+	if(it == exchanges.end()) {
+		return;
+	}
+
+	auto& exchange = it->second;
+	if(exchange.retransmissions == options.maxRetransmit) {
+		auto handler = std::move(exchange.handler);
+		exchanges.erase(it);
+		handler({}, "CoAP request went unanswered");
+		return;
+	}
+
+	exchange.retransmissions++;
+	exchange.timeout *= 2;
+	transmit(id);
+}
+
+auto CoapClient::receive() -> void {
+	auto [bytes, err] = socket.read(maxDatagram);
+	if(err) {
+		// an ICMP error for an earlier datagram, that request is retransmitted anyway
+		return;
+	}
+
+	auto [response, decodeErr] = Coap::decode(bytes);
+	if(decodeErr) {
+		std::cerr << "CoAP: " << decodeErr << '\n';
+		return;
+	}
+
+	// duplicates of a response that arrived already find no exchange
+	auto it = exchanges.find(static_cast<uint16_t>(response.id));
+	if(it == exchanges.end() || (response.type != Coap::Type::Acknowledgement && response.type != Coap::Type::Reset)) {
+		return;
+	}
+
+	reactor.cancel(it->second.timer);
+	auto handler = std::move(it->second.handler);
+	exchanges.erase(it);
+
+	if(response.type == Coap::Type::Reset) {
+		handler(response, "CoAP request was reset");
+	} else if(response.code == Coap::Code::Empty) {
+		handler(response, "Separate CoAP responses are not supported");
+	} else {
+		handler(response, nullptr);
+	}
+}
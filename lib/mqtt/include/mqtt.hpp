@@ -0,0 +1,181 @@
+#pragma once
+#include <array>
+#include <cstdint>
+#include <memory_resource>
+#include <string>
+#include <variant>
+
+#include "common.hpp"
+#include "buffered_reader.hpp"
+
+//https://openlabpro.com/guide/mqtt-packet-format/
+
+// 2 1st bytes = header
+// first 4 bits = message type
+// 5th bit = DUP flag
+// 6th and 7th bit - QoS Level
+// 8th bit RETAIN flag
+// 2nd byte = Remaining length, 1-4 bytes
+// the rest is payload
+
+class Mqtt {
+public:
+	enum Type : uint32_t {
+		Connect = 1,		// Connection request
+		Connack = 2,		// Connection acknowlegement
+		Publish = 3,		// Publish message
+		Puback = 4,			// Publish acknowlegement
+		Pubrec = 5,			// Publish recieved (QoS Lv2 part 1)
+		Pubrel = 6,			// Publish release (QoS Lv2 part 2)
+		Pubcomp = 7,		// Publish complete (QoS Lv2 part 3)
+		// Don't forget to like and
+		Subscribe = 8,		// Subscribe request
+		Suback = 9,			//Subscribe acknowlegement
+		Unsubscribe = 10,	// Unsubscribe request
+		Unsuback = 11,		// Unsubscribe acknowlegement
+		Pingreq = 12,		// Ping request
+		Pingresp = 13,		// Ping acknowlegement
+		Disconnect = 14,	// Disconnect notification
+	};
+
+	enum QosLevel : uint32_t {
+		Lv0 = 0,
+		Lv1 = 1,
+		Lv2 = 2,
+	};
+
+	enum ConnectFlags : uint8_t {
+		CleanSession = 0x02,
+	};
+
+	// headers use polymorphic allocators so decoding can draw from a per-connection arena
+	struct ConnectHeader {
+		std::pmr::string protocol;
+		std::pmr::string identifier;
+		uint16_t keepAlive;
+		uint8_t version;
+		uint8_t flags;
+	};
+
+	struct ConnackHeader {
+		uint8_t code;
+		bool sessionPresent = false;
+	};
+
+	// where the levels of a topic end, recorded while the topic is validated
+	struct TopicLevels {
+		static constexpr size_t maxSeparators = 31;
+		std::array<uint16_t, maxSeparators> separators;
+		uint8_t separatorCount = 0;
+		// more levels than fit, matching falls back to splitting the topic
+		bool overflow = false;
+
+		auto count() const -> size_t;
+		auto level(std::string_view topic, size_t index) const -> std::string_view;
+		auto add(size_t separator) -> void;
+	};
+
+	struct PublishHeader {
+		std::pmr::string topic;
+		std::pmr::string payload;
+		uint16_t id;
+		// payload bytes a streamed decode left to the reader, buffered first and then in the socket
+		size_t pendingPayload;
+		TopicLevels levels;
+	};
+
+	struct SubscribeHeader {
+		std::pmr::vector<std::pmr::string> topics;
+		std::pmr::vector<QosLevel> levels;
+		uint16_t id;
+	};
+
+	struct SubackHeader {
+		std::pmr::vector<Byte> payload;
+		uint16_t id;
+	};
+
+	struct UnsubscribeHeader {
+		std::pmr::vector<std::pmr::string> topics;
+		uint16_t id;
+	};
+
+	// PUBACK, PUBREC, PUBREL and PUBCOMP carry nothing but the packet id
+	struct AckHeader {
+		uint16_t id;
+	};
+
+	struct Message {
+		Type type;
+		QosLevel level;
+		bool duplicate;
+		bool retain;
+
+		std::variant<ConnectHeader, ConnackHeader, PublishHeader, SubscribeHeader, SubackHeader, UnsubscribeHeader, AckHeader> content;
+	};
+
+	static auto toString(Type type) -> std::string_view;
+	static auto toString(QosLevel level) -> std::string_view;
+
+	// publishes with more than streamThreshold remaining bytes are only decoded up to their payload;
+	// any other packet larger than maxPacketSize is refused before its body is read, zero means no limit
+	static auto decode(BufferedReader& client, 
+			std::pmr::memory_resource* resource = std::pmr::get_default_resource(),
+			size_t streamThreshold = 0, size_t maxPacketSize = 0) 
+		-> std::tuple<Message, std::pmr::vector<Byte>, Error>;
+	// length of the packet at the start of bytes, zero until its fixed header has fully arrived
+	static auto frameLength(BytesView bytes) -> std::tuple<size_t, Error>;
+	// one whole packet already in memory, as framed by frameLength
+	static auto decode(BytesView packet, std::pmr::memory_resource* resource = std::pmr::get_default_resource())
+		-> std::tuple<Message, Error>;
+	// fixed and variable header of a PUBLISH whose payload is written separately
+	static auto encodePublishHeader(const Mqtt::Message& message, size_t payloadLength) -> Bytes;
+	// exact size of the encoded message, zero if its content does not fit its type or is too long
+	static auto encodedSize(const Mqtt::Message& message) -> size_t;
+	// writes encodedSize(message) bytes and returns where they end
+	static auto encode(const Mqtt::Message& message, Byte* destination) -> Byte*;
+	// empty if the message cannot be encoded
+	static auto encode(const Mqtt::Message& message) -> Bytes;
+	// topic filter matching with the + and # wildcards
+	static auto isWildcard(std::string_view filter) -> bool;
+	static auto matches(std::string_view filter, std::string_view topic) -> bool;
+	// same as above for a topic already split by validateTopic
+	static auto matches(std::string_view filter, std::string_view topic, const TopicLevels& levels) -> bool;
+	// UTF-8 without NUL characters, topic names may not contain wildcards
+	static auto validateTopic(std::string_view topic, bool wildcards, TopicLevels* levels = nullptr) -> Error;
+	// wildcards must fill a whole level and # must be the last one
+	static auto validateFilter(std::string_view filter) -> Error;
+	// topic of an encoded PUBLISH without decoding the rest
+	static auto peekTopic(BytesView packet) -> std::tuple<std::string_view, Error>;
+	static auto peekPayload(BytesView packet) -> std::tuple<std::string_view, Error>;
+
+private:
+	static auto decodeConnect(BytesView bytes, std::pmr::memory_resource* resource) 
+		-> std::tuple<ConnectHeader, Error>;
+	static auto decodePublish(BytesView bytes, QosLevel level, std::pmr::memory_resource* resource) 
+		-> std::tuple<PublishHeader, Error>;
+	static auto decodeSubscribe(BytesView bytes, std::pmr::memory_resource* resource) 
+		-> std::tuple<SubscribeHeader, Error>;
+	static auto decodeUnsubscribe(BytesView bytes, std::pmr::memory_resource* resource) 
+		-> std::tuple<UnsubscribeHeader, Error>;
+	static auto decodeAck(BytesView bytes) -> std::tuple<AckHeader, Error>;
+	static auto remainingLength(const Message& message) -> std::tuple<size_t, Error>;
+	static auto decodeRemainder(Message& message, BytesView remainder, std::pmr::memory_resource* resource) -> Error;
+
+	// first byte of the fixed header, from the most significant bit down
+	struct HeaderRepresentation : PackedWord<uint8_t> {
+		using TypeField = BitField<uint8_t, 4, 4>;
+		using DuplicateField = BitField<uint8_t, 3, 1>;
+		using QosField = BitField<uint8_t, 1, 2>;
+		using RetainField = BitField<uint8_t, 0, 1>;
+		static_assert(WordLayout<uint8_t, TypeField, DuplicateField, QosField, RetainField>::tiles());
+
+		static auto fromMessage(const Message& message) -> HeaderRepresentation;
+		// sets the type and flags of message
+		auto toMessage(Message& message) const -> void;
+	};
+
+
+};
+
+std::ostream& operator<<(std::ostream& os, const Mqtt::Message& message);
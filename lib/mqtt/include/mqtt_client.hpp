@@ -0,0 +1,150 @@
+#pragma once
+#include <bitset>
+#include <chrono>
+#include <deque>
+#include <functional>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <vector>
+
+#include "byte_buffer.hpp"
+#include "mqtt.hpp"
+#include "reactor.hpp"
+
+// Non-blocking MQTT client on the broker's own codec. One thread runs a
+// reactor: it watches the socket, decodes whatever has arrived, hands
+// publishes to the callback and writes all queued packets in as few writes as
+// the socket takes. Publishing and subscribing never block and may happen on
+// any thread, also while disconnected; only the first packet queued since the
+// loop last ran posts work to it, so a burst of publishes costs one wakeup and
+// one write per flushBytes. A lost connection is dialed again with backoff on a reactor
+// timer; once the broker accepts it, every subscription is renewed and
+// unacknowledged QoS 1 publishes are resent. Dialing never blocks the loop: the
+// broker's name is resolved on a helper thread and the connect completes like
+// any other write.
+class MqttClient {
+public:
+	using Clock = std::chrono::steady_clock;
+	using PublishHandler = std::function<void(std::string_view topic, std::string_view payload)>;
+	// runs on the event loop thread once a QoS 0 publish is written or a QoS 1 publish acknowledged,
+	// with an error if that will not happen any more
+	using Completion = std::function<void(Error err)>;
+
+	struct Options {
+		std::string address;
+		uint16_t port;
+		std::string identifier;
+		uint16_t keepAlive = 60;
+		// most bytes moved from the queue into a single write
+		size_t flushBytes = 64 * 1024;
+	};
+
+	MqttClient(Options options);
+	~MqttClient();
+
+	MqttClient(const MqttClient&) = delete;
+	auto operator=(const MqttClient&) -> MqttClient& = delete;
+
+	// runs on the event loop thread, set it before calling run
+	auto onPublish(PublishHandler handler) -> void;
+	// QoS 2 is not supported
+	auto publish(std::string_view topic, std::string_view payload,
+			Mqtt::QosLevel level = Mqtt::Lv0, bool retain = false, Completion completion = nullptr) -> Error;
+	auto subscribe(std::string_view filter, Mqtt::QosLevel level = Mqtt::Lv0) -> Error;
+	auto unsubscribe(std::string_view filter) -> void;
+	// runs the event loop until stop is called
+	auto run() -> void;
+	auto stop() -> void;
+	// QoS 1 publishes the broker has not acknowledged yet
+	auto unacknowledged() const -> size_t;
+private:
+	using Packet = std::shared_ptr<const Bytes>;
+
+	enum class Kind {
+		// QoS 0, sent once if it ever is
+		Publish,
+		// QoS 1, kept in inFlight until acknowledged
+		Reliable,
+		// SUBSCRIBE and UNSUBSCRIBE, dropped once connected since all subscriptions are renewed then
+		Control,
+	};
+
+	struct Pending {
+		Kind kind;
+		Packet packet;
+		Completion completion;
+	};
+
+	struct InFlight {
+		uint16_t id;
+		Packet packet;
+		Completion completion;
+	};
+
+	// starts a connect to one of addresses, taking turns between attempts
+	auto dial(const std::vector<std::string>& addresses) -> std::tuple<UnixTcpSocket, Error>;
+	// resolves the broker's address off the loop thread, resolved carries on from there
+	auto connect() -> void;
+	// dials the broker, or schedules another attempt after the backoff
+	auto resolved(const std::vector<std::string>& addresses, Error err) -> void;
+	auto retry() -> void;
+	auto onReady(uint32_t events) -> void;
+	auto send() -> Error;
+	auto receive() -> Error;
+	auto handle(const Mqtt::Message& message) -> Error;
+	// pings the broker when nothing was sent for half the keep alive, drops the connection when it went quiet
+	auto checkKeepAlive() -> void;
+	// moves queued packets into output and watches for writability while output is left
+	auto transmit() -> void;
+	auto drop(Error err) -> void;
+	auto closeConnection() -> void;
+	auto shutdown() -> void;
+	// queues the subscriptions and unacknowledged publishes of the session the broker just accepted
+	auto resume() -> void;
+	// moves queued packets into output, up to flushBytes
+	auto flush() -> void;
+	// completes every publish that is entirely written
+	auto completeWritten() -> void;
+	// fails every publish that can no longer complete, all of them once stopped
+	auto abandon(Error err, bool stopped) -> void;
+	auto enqueue(Pending pending) -> void;
+	// skips the ids of unacknowledged publishes, mutex must be held
+	auto takeId() -> uint16_t;
+
+	Options options;
+	PublishHandler handler;
+	Reactor reactor;
+
+	mutable std::mutex mutex;
+	bool connected = false;
+	bool stopping = false;
+	std::deque<Pending> pending;
+	std::deque<InFlight> inFlight;
+	// the ids in inFlight
+	std::bitset<65536> inFlightIds;
+	std::map<std::string, Mqtt::QosLevel, std::less<>> subscriptions;
+	uint16_t nextId = 1;
+
+	// looks up options.address, joined before the next lookup starts
+	std::thread resolver;
+
+	// touched by the event loop thread only
+	UnixTcpSocket socket;
+	size_t nextAddress = 0;
+	bool live = false;
+	uint32_t interest = 0;
+	Clock::duration backoff;
+	Clock::time_point lastSent;
+	Clock::time_point lastReceived;
+	Reactor::TimerId keepAliveTimer = 0;
+	Reactor::TimerId reconnectTimer = 0;
+	ByteBuffer input;
+	Bytes output;
+	size_t written = 0;
+	// QoS 0 publishes in output by where they end
+	std::deque<std::pair<size_t, Completion>> unwritten;
+};
@@ -0,0 +1,1058 @@
+#include "mqtt.hpp"
+
+auto Mqtt::toString(Type type) -> std::string_view {
+	switch(type) {
+		case Connect:
+			return "Connect";
+		case Connack:
+			return "Connack";
+		case Publish:
+			return "Publish";
+		case Puback:
+			return "Puback";
+		case Pubrec:
+			return "Pubrec";
+		case Pubrel:
+			return "Pubrel";
+		case Pubcomp:
+			return "Pubcomp";
+		case Subscribe:
+			return "Subscribe";
+		case Suback:
+			return "Suback";
+		case Unsubscribe:
+			return "Unsubscribe";
+		case Unsuback:
+			return "Unsuback";
+		case Pingreq:
+			return "Pingreq";
+		case Pingresp:
+			return "Pingresp";
+		case Disconnect:
+			return "Disconnect";
+	}
+	return "Unrecognized";
+}
+
+auto Mqtt::toString(QosLevel level) -> std::string_view {
+	switch(level) {
+		case Lv0:
+			return "Level 0";
+		case Lv1:
+			return "Level 1";
+		case Lv2:
+			return "Level 2";
+	}
+	return "Unrecognized";
+}
+
+auto Mqtt::decode(BufferedReader& client, std::pmr::memory_resource* resource, size_t streamThreshold, size_t maxPacketSize) 
+		-> std::tuple<Message, std::pmr::vector<Byte>, Error> {
+	Message message;
+	std::pmr::vector<Byte> bytesResult(resource);
+	// fixed header plus the longest possible remaining length
+	bytesResult.reserve(sizeof(HeaderRepresentation) + 4);
+	bytesResult.resize(sizeof(HeaderRepresentation));
+
+	auto err = client.readExact(bytesResult.data(), sizeof(HeaderRepresentation));
+	if(err) {
+		return {
+			message,
+			{},
+			err,
+		};
+	}
+
+	auto header = loadBigEndian<HeaderRepresentation>(bytesResult.data());
+	header.toMessage(message);
+
+	// accumulate length
+	size_t remainingLength = 0;
+	size_t multiplier = 1;
+	Byte byte = 0;
+
+	do {
+		err = client.readExact(&byte, sizeof(Byte));
+		if(err) {
+			return {
+				message,
+				{},
+				err,
+			};
+		}
+
+		bytesResult.push_back(byte);
+		remainingLength += (byte & 127) * multiplier;
+		multiplier *= 128;
+		// at most four length bytes
+		if((byte & 128) != 0 && multiplier > 128 * 128 * 128) {
+			return {
+				message,
+				{},
+				"Error decoding length",
+			};
+		}
+	} while((byte & 128) != 0);
+
+	size_t headerLength = bytesResult.size();
+	size_t bodyLength = remainingLength;
+	size_t bodyRead = 0;
+	// a streamed payload is never held in memory, so only the rest counts against the limit
+	bool streamed = message.type == Publish && streamThreshold > 0 && remainingLength > streamThreshold;
+
+	if(!streamed && maxPacketSize > 0 && headerLength + remainingLength > maxPacketSize) {
+		return {
+			message,
+			{},
+			"Packet exceeds the maximum size",
+		};
+	}
+
+	if(streamed) {
+		// only the topic and packet id are read, the payload is left for the caller to splice
+		bytesResult.resize(headerLength + 2);
+		err = client.readExact(bytesResult.data() + headerLength, 2);
+		if(err) {
+			return {
+				message,
+				{},
+				err,
+			};
+		}
+
+		auto topicLengthBytes = BytesView(bytesResult.data() + headerLength, 2);
+		auto [topicLength, topicLengthErr] = fromBigEndianBytes<uint16_t>(topicLengthBytes);
+		if(topicLengthErr) {
+			return {
+				message,
+				{},
+				topicLengthErr,
+			};
+		}
+
+		bodyLength = 2 + topicLength + (message.level != Lv0 ? 2 : 0);
+		bodyRead = 2;
+		if(bodyLength > remainingLength) {
+			return {
+				message,
+				{},
+				"Publish topic longer than the packet",
+			};
+		}
+	}
+
+	bytesResult.resize(headerLength + bodyLength);
+
+	err = client.readExact(bytesResult.data() + headerLength + bodyRead, bodyLength - bodyRead);
+	if(err) {
+		return {
+			message,
+			{},
+			err,
+		};
+	}
+
+	BytesView remainder(bytesResult.data() + headerLength, bodyLength);
+	if(err = decodeRemainder(message, remainder, resource); err) {
+		return {
+			message,
+			{},
+			err,
+		};
+	}
+
+	if(auto publish = std::get_if<PublishHeader>(&message.content); publish) {
+		publish->pendingPayload = remainingLength - bodyLength;
+	}
+
+	return {
+		std::move(message),
+		std::move(bytesResult),
+		nullptr,
+	};
+}
+
+auto Mqtt::frameLength(BytesView bytes) -> std::tuple<size_t, Error> {
+	size_t remainingLength = 0;
+	size_t multiplier = 1;
+	size_t offset = sizeof(HeaderRepresentation);
+
+	while(true) {
+		if(offset >= bytes.size()) {
+			return {
+				0,
+				nullptr,
+			};
+		}
+
+		Byte byte = bytes[offset++];
+		remainingLength += (byte & 127) * multiplier;
+		if((byte & 128) == 0) {
+			break;
+		}
+
+		multiplier *= 128;
+		if(multiplier > 128 * 128 * 128) {
+			return {
+				0,
+				"Error decoding length",
+			};
+		}
+	}
+
+	return {
+		offset + remainingLength,
+		nullptr,
+	};
+}
+
+auto Mqtt::decode(BytesView packet, std::pmr::memory_resource* resource) -> std::tuple<Message, Error> {
+	Message message;
+
+	auto [length, err] = frameLength(packet);
+	if(err) {
+		return {
+			message,
+			err,
+		};
+	} else if(length == 0 || length != packet.size()) {
+		return {
+			message,
+			"Bytes do not hold exactly one packet",
+		};
+	}
+
+	loadBigEndian<HeaderRepresentation>(packet.data()).toMessage(message);
+
+	size_t headerLength = 1;
+	while(packet[headerLength++] & 128) {}
+
+	err = decodeRemainder(message, BytesView(packet.data() + headerLength, packet.size() - headerLength), resource);
+	if(auto publish = std::get_if<PublishHeader>(&message.content); publish) {
+		publish->pendingPayload = 0;
+	}
+
+	return {
+		std::move(message),
+		err,
+	};
+}
+
+auto Mqtt::decodeRemainder(Message& message, BytesView remainder, std::pmr::memory_resource* resource) -> Error {
+	// emplace rather than assign, assignment would copy into the variant's default allocator
+	switch(message.type) {
+		case Connect: {
+			auto [connect, connectErr] = decodeConnect(remainder, resource);
+			if(connectErr) {
+				return connectErr;
+			}
+			message.content.emplace<ConnectHeader>(std::move(connect));
+			break;
+		}
+		case Connack:
+			if(remainder.size() < 2) {
+				return "Bytes not enough to fit connack";
+			}
+			message.content.emplace<ConnackHeader>(ConnackHeader{
+				.code = remainder[1],
+				.sessionPresent = (remainder[0] & 0x01) != 0,
+			});
+			break;
+		case Publish: {
+			auto [publish, publishErr] = decodePublish(remainder, message.level, resource);
+			if(publishErr) {
+				return publishErr;
+			}
+			message.content.emplace<PublishHeader>(std::move(publish));
+			break;
+		}
+		case Puback:
+		case Pubrec:
+		case Pubrel:
+		case Pubcomp: {
+			auto [ack, ackErr] = decodeAck(remainder);
+			if(ackErr) {
+				return ackErr;
+			}
+			message.content.emplace<AckHeader>(ack);
+			break;
+		}
+		case Subscribe: {
+			auto [subscribe, subscribeErr] = decodeSubscribe(remainder, resource);
+			if(subscribeErr) {
+				return subscribeErr;
+			}
+			message.content.emplace<SubscribeHeader>(std::move(subscribe));
+			break;
+		}
+		case Suback:
+			break;
+		case Unsubscribe: {
+			auto [unsubscribe, unsubscribeErr] = decodeUnsubscribe(remainder, resource);
+			if(unsubscribeErr) {
+				return unsubscribeErr;
+			}
+			message.content.emplace<UnsubscribeHeader>(std::move(unsubscribe));
+			break;
+		}
+		case Unsuback:
+			break;
+		case Pingreq:
+			break;
+		case Pingresp:
+			break;
+		case Disconnect:
+			break;
+	}
+
+	return nullptr;
+}
+
+// Encoding sizes the packet first, then writes every field exactly once into
+// memory that already has room for it.
+
+constexpr size_t maxRemainingLength = 268435455;
+
+static auto lengthSize(size_t length) -> size_t {
+	return length < 128 ? 1 : (length < 128 * 128 ? 2 : (length < 128 * 128 * 128 ? 3 : 4));
+}
+
+static auto writeLength(Byte* destination, size_t length) -> Byte* {
+	do {
+		Byte byte = length % 128;
+		length /= 128;
+		if(length > 0) {
+			byte |= 128;
+		}
+		*destination++ = byte;
+	} while(length > 0);
+	return destination;
+}
+
+static auto writeString(Byte* destination, std::string_view string) -> Byte* {
+	destination = storeBigEndian<uint16_t>(destination, string.size());
+	return std::copy(string.begin(), string.end(), destination);
+}
+
+auto Mqtt::remainingLength(const Message& message) -> std::tuple<size_t, Error> {
+	size_t length = 0;
+	Error err = nullptr;
+
+	auto addString = [&](std::string_view string) {
+		if(string.size() > UINT16_MAX) {
+			err = "String too long for a packet";
+		}
+		length += 2 + string.size();
+	};
+
+	switch(message.type) {
+		case Connect: {
+			auto connect = std::get_if<ConnectHeader>(&message.content);
+			if(connect == nullptr) {
+				return {
+					0,
+					"Connect without its header",
+				};
+			}
+			addString(connect->protocol);
+			length += 1 + 1 + 2;
+			addString(connect->identifier);
+			break;
+		}
+		case Connack:
+			if(!std::holds_alternative<ConnackHeader>(message.content)) {
+				return {
+					0,
+					"Connack without its header",
+				};
+			}
+			length = 2;
+			break;
+		case Publish: {
+			auto publish = std::get_if<PublishHeader>(&message.content);
+			if(publish == nullptr) {
+				return {
+					0,
+					"Publish without its header",
+				};
+			}
+			addString(publish->topic);
+			length += (message.level != Lv0 ? 2 : 0) + publish->payload.size();
+			break;
+		}
+		case Puback:
+		case Pubrec:
+		case Pubrel:
+		case Pubcomp:
+		case Unsuback:
+			if(!std::holds_alternative<AckHeader>(message.content)) {
+				return {
+					0,
+					"Acknowledgement without its packet id",
+				};
+			}
+			length = 2;
+			break;
+		case Subscribe: {
+			auto subscribe = std::get_if<SubscribeHeader>(&message.content);
+			if(subscribe == nullptr || subscribe->topics.size() != subscribe->levels.size()) {
+				return {
+					0,
+					"Subscribe without a level for every topic",
+				};
+			}
+			length = 2;
+			for(const auto& topic : subscribe->topics) {
+				addString(topic);
+				length += 1;
+			}
+			break;
+		}
+		case Suback: {
+			auto suback = std::get_if<SubackHeader>(&message.content);
+			if(suback == nullptr) {
+				return {
+					0,
+					"Suback without its header",
+				};
+			}
+			length = 2 + suback->payload.size();
+			break;
+		}
+		case Unsubscribe: {
+			auto unsubscribe = std::get_if<UnsubscribeHeader>(&message.content);
+			if(unsubscribe == nullptr) {
+				return {
+					0,
+					"Unsubscribe without its header",
+				};
+			}
+			length = 2;
+			for(const auto& topic : unsubscribe->topics) {
+				addString(topic);
+			}
+			break;
+		}
+		case Pingreq:
+		case Pingresp:
+		case Disconnect:
+			break;
+		default:
+			return {
+				0,
+				"Unknown message type",
+			};
+	}
+
+	if(!err && length > maxRemainingLength) {
+		err = "Packet too long to encode";
+	}
+
+	return {
+		length,
+		err,
+	};
+}
+
+auto Mqtt::encodedSize(const Message& message) -> size_t {
+	auto [length, err] = remainingLength(message);
+	if(err) {
+		return 0;
+	}
+	return sizeof(HeaderRepresentation) + lengthSize(length) + length;
+}
+
+auto Mqtt::encode(const Message& message, Byte* destination) -> Byte* {
+	auto [length, err] = remainingLength(message);
+	if(err) {
+		return destination;
+	}
+
+	auto header = HeaderRepresentation::fromMessage(message);
+	if(message.type != Publish) {
+		// only a PUBLISH has flags, the others have reserved bits the protocol fixes
+		header.data = 0;
+		header.set<HeaderRepresentation::TypeField>(message.type);
+		if(message.type == Pubrel || message.type == Subscribe || message.type == Unsubscribe) {
+			header.set<HeaderRepresentation::QosField>(Lv1);
+		}
+	}
+
+	destination = storeBigEndian(destination, header);
+	destination = writeLength(destination, length);
+
+	switch(message.type) {
+		case Connect: {
+			auto& connect = std::get<ConnectHeader>(message.content);
+			destination = writeString(destination, connect.protocol);
+			*destination++ = connect.version;
+			*destination++ = connect.flags;
+			destination = storeBigEndian<uint16_t>(destination, connect.keepAlive);
+			destination = writeString(destination, connect.identifier);
+			break;
+		}
+		case Connack: {
+			auto& connack = std::get<ConnackHeader>(message.content);
+			*destination++ = connack.sessionPresent;
+			*destination++ = connack.code;
+			break;
+		}
+		case Publish: {
+			auto& publish = std::get<PublishHeader>(message.content);
+			destination = writeString(destination, publish.topic);
+			// id field only present in QoS 1 and 2
+			if(message.level != Lv0) {
+				destination = storeBigEndian<uint16_t>(destination, publish.id);
+			}
+			destination = std::copy(publish.payload.begin(), publish.payload.end(), destination);
+			break;
+		}
+		case Puback:
+		case Pubrec:
+		case Pubrel:
+		case Pubcomp:
+		case Unsuback:
+			destination = storeBigEndian<uint16_t>(destination, std::get<AckHeader>(message.content).id);
+			break;
+		case Subscribe: {
+			auto& subscribe = std::get<SubscribeHeader>(message.content);
+			destination = storeBigEndian<uint16_t>(destination, subscribe.id);
+			for(size_t i = 0; i < subscribe.topics.size(); i++) {
+				destination = writeString(destination, subscribe.topics[i]);
+				*destination++ = static_cast<Byte>(subscribe.levels[i]);
+			}
+			break;
+		}
+		case Suback: {
+			auto& suback = std::get<SubackHeader>(message.content);
+			destination = storeBigEndian<uint16_t>(destination, suback.id);
+			destination = std::copy(suback.payload.begin(), suback.payload.end(), destination);
+			break;
+		}
+		case Unsubscribe: {
+			auto& unsubscribe = std::get<UnsubscribeHeader>(message.content);
+			destination = storeBigEndian<uint16_t>(destination, unsubscribe.id);
+			for(const auto& topic : unsubscribe.topics) {
+				destination = writeString(destination, topic);
+			}
+			break;
+		}
+		default:
+			break;
+	}
+
+	return destination;
+}
+
+auto Mqtt::encode(const Message& message) -> Bytes {
+	Bytes bytes(encodedSize(message));
+	encode(message, bytes.data());
+	return bytes;
+}
+
+auto Mqtt::isWildcard(std::string_view filter) -> bool {
+	return filter.find_first_of("+#") != std::string_view::npos;
+}
+
+auto Mqtt::matches(std::string_view filter, std::string_view topic) -> bool {
+	// wildcards at the first level never match $ topics
+	if(!topic.empty() && topic[0] == '$' && !filter.empty() && (filter[0] == '+' || filter[0] == '#')) {
+		return false;
+	}
+
+	while(true) {
+		auto filterEnd = filter.find('/');
+		auto filterLevel = filter.substr(0, filterEnd);
+
+		if(filterLevel == "#") {
+			return true;
+		}
+
+		auto topicEnd = topic.find('/');
+		if(filterLevel != "+" && filterLevel != topic.substr(0, topicEnd)) {
+			return false;
+		}
+
+		if(filterEnd == std::string_view::npos || topicEnd == std::string_view::npos) {
+			// "a/#" also matches its parent "a"
+			return filterEnd == topicEnd || (topicEnd == std::string_view::npos && filter.substr(filterEnd + 1) == "#");
+		}
+
+		filter.remove_prefix(filterEnd + 1);
+		topic.remove_prefix(topicEnd + 1);
+	}
+}
+
+auto Mqtt::peekTopic(BytesView packet) -> std::tuple<std::string_view, Error> {
+	size_t offset = 1;
+	do {
+		if(offset >= packet.size() || offset > 4) {
+			return {
+				{},
+				"Error decoding length",
+			};
+		}
+	} while(packet[offset++] & 128);
+
+	if(packet.size() < offset + 2) {
+		return {
+			{},
+			"Bytes not enough to fit topic length",
+		};
+	}
+
+	auto [topicLength, err] = fromBigEndianBytes<uint16_t>(BytesView(packet.data() + offset, 2));
+	offset += 2;
+	if(err || packet.size() < offset + topicLength) {
+		return {
+			{},
+			"Bytes not enough to fit topic",
+		};
+	}
+
+	return {
+		std::string_view(reinterpret_cast<const char*>(packet.data() + offset), topicLength),
+		nullptr,
+	};
+}
+
+auto Mqtt::peekPayload(BytesView packet) -> std::tuple<std::string_view, Error> {
+	auto [topic, err] = peekTopic(packet);
+	if(err) {
+		return {
+			{},
+			err,
+		};
+	}
+
+	size_t offset = topic.data() + topic.size() - reinterpret_cast<const char*>(packet.data());
+	if(packet[0] & 0x06) {
+		offset += 2;
+	}
+
+	if(offset > packet.size()) {
+		return {
+			{},
+			"Bytes not enough to fit packet id",
+		};
+	}
+
+	return {
+		std::string_view(reinterpret_cast<const char*>(packet.data() + offset), packet.size() - offset),
+		nullptr,
+	};
+}
+
+auto Mqtt::encodePublishHeader(const Mqtt::Message& message, size_t payloadLength) -> Bytes {
+	auto publish = std::get_if<Mqtt::PublishHeader>(&message.content);
+	if(publish == nullptr || publish->topic.size() > UINT16_MAX) {
+		return {};
+	}
+
+	size_t idLength = message.level != Lv0 ? 2 : 0;
+	size_t length = 2 + publish->topic.size() + idLength + payloadLength;
+	if(length > maxRemainingLength) {
+		return {};
+	}
+
+	Bytes bytes(sizeof(HeaderRepresentation) + lengthSize(length) + length - payloadLength);
+	auto destination = bytes.data();
+	destination = storeBigEndian(destination, HeaderRepresentation::fromMessage(message));
+	destination = writeLength(destination, length);
+	destination = writeString(destination, publish->topic);
+	if(idLength > 0) {
+		storeBigEndian<uint16_t>(destination, publish->id);
+	}
+	return bytes;
+}
+
+auto Mqtt::decodeConnect(BytesView bytes, std::pmr::memory_resource* resource) 
+		-> std::tuple<ConnectHeader, Error> {
+	ConnectHeader header = {
+		.protocol = std::pmr::string(resource),
+		.identifier = std::pmr::string(resource),
+	};
+	if(bytes.size() < 2) {
+		return {
+			header,
+			"Bytes not long enough to fit header",
+		};
+	}
+
+	auto varHeaderBytes = BytesView(bytes.begin(), bytes.begin() + 2);
+	auto [varHeaderLength, varHeaderErr] = fromBigEndianBytes<uint16_t>(varHeaderBytes);
+	if(varHeaderErr) {
+		return {
+			header,
+			varHeaderErr,
+		};
+	}
+
+	header.protocol.resize(varHeaderLength);
+	std::copy(bytes.begin() + 2, bytes.begin() + 2 + varHeaderLength, header.protocol.begin());
+	
+	size_t offset = 2 + varHeaderLength;
+	
+	if(bytes.size() < offset + 1) {
+		return {
+			header,
+			"Bytes not long enough to fit protocol version",
+		};
+	}
+
+	header.version = bytes[offset];
+	offset++;
+
+	if(bytes.size() < offset + 1) {
+		return {
+			header,
+			"Bytes not long enough to fit flag data",
+		};
+	}
+
+	header.flags = bytes[offset];
+	offset++;
+
+	if(bytes.size() < offset + 2) {
+		return {
+			header,
+			"Bytes not long enough to fit keep alive data",
+		};
+	}
+
+	BytesView keepAliveBytes(bytes.begin() + offset, bytes.begin() + offset + 2);
+	auto [keepAlive, keepAliveErr] = fromBigEndianBytes<uint16_t>(keepAliveBytes);
+	if(keepAliveErr) {
+		return {
+			header,
+			keepAliveErr,
+		};
+	}
+	header.keepAlive = keepAlive;
+
+	offset += 2;
+	if(bytes.size() < offset + 2) {
+		return {
+			header,
+			"Bytes not long enough to fit payload length data",
+		};
+	}
+
+	BytesView payloadLengthBytes(bytes.begin() + offset, bytes.begin() + offset + 2);
+	auto [payloadLength, payloadLengthErr] = fromBigEndianBytes<uint16_t>(payloadLengthBytes);
+	if(payloadLengthErr) {
+		return {
+			header,
+			payloadLengthErr,
+		};
+	}
+
+	offset += 2;
+	if(bytes.size() != offset + payloadLength) {
+		return {
+			header,
+			"Bytes not as long as specified by payload length data",
+		};
+	}
+
+	header.identifier.resize(payloadLength);
+	std::copy(bytes.begin() + offset, bytes.end(), header.identifier.begin());
+
+	return {
+		std::move(header),
+		nullptr,
+	};
+}
+
+auto Mqtt::decodePublish(BytesView bytes, QosLevel level, std::pmr::memory_resource* resource) 
+		-> std::tuple<PublishHeader, Error> {
+	PublishHeader header = {
+		.topic = std::pmr::string(resource),
+		.payload = std::pmr::string(resource),
+	};
+	if(bytes.size() < 2) {
+		return {
+			header,
+			"Bytes not long enough to fit header",
+		};
+	}
+
+	auto varHeaderBytes = BytesView(bytes.begin(), bytes.begin() + 2);
+	auto [varHeaderLength, varHeaderErr] = fromBigEndianBytes<uint16_t>(varHeaderBytes);
+	if(varHeaderErr) {
+		return {
+			header,
+			varHeaderErr,
+		};
+	}
+
+	if(bytes.size() < sizeof(uint16_t) + varHeaderLength) {
+		return {
+			header,
+			"Bytes not enough to fit topic",
+		};
+	}
+
+	header.topic.resize(varHeaderLength);
+	std::copy(bytes.begin() + 2, bytes.begin() + 2 + varHeaderLength, header.topic.begin());
+	if(auto err = validateTopic(header.topic, false, &header.levels); err) {
+		return {
+			header,
+			err,
+		};
+	}
+	
+	size_t offset = 2 + varHeaderLength;
+	
+	if(bytes.size() < offset + 2 && level != QosLevel::Lv0) {
+		return {
+			header,
+			"Bytes not long enough to fit QoS level",
+		};
+	}
+
+	// id field only present in QoS 1 and 2
+	if(level != QosLevel::Lv0) {
+		auto idBytes = BytesView(bytes.begin() + offset, bytes.begin() + offset + 2);
+		auto [id, idErr] = fromBigEndianBytes<uint16_t>(idBytes);
+		if(idErr) {
+			return {
+				header,
+				idErr,
+			};
+		}
+
+		header.id = id;
+		offset += 2;
+	}
+
+	header.payload.resize(bytes.size() - offset);
+	std::copy(bytes.begin() + offset, bytes.end(), header.payload.begin());
+
+	return {
+		std::move(header),
+		nullptr,
+	};
+}
+
+auto Mqtt::decodeSubscribe(BytesView bytes, std::pmr::memory_resource* resource) 
+		-> std::tuple<SubscribeHeader, Error> {
+	SubscribeHeader header = {
+		.topics = std::pmr::vector<std::pmr::string>(resource),
+		.levels = std::pmr::vector<QosLevel>(resource),
+	};
+	uint8_t level;
+	size_t offset = 0;
+
+	if(bytes.size() < 2) {
+		return {
+			header,
+			"Bytes not long enough to fit message id",
+		};
+	}
+
+	auto idBytes = BytesView(bytes.begin(), bytes.begin() + 2);
+	auto [id, idErr] = fromBigEndianBytes<uint16_t>(idBytes);
+	if(idErr) {
+		return {
+			header,
+			idErr,
+		};
+	}
+
+	header.id = id;
+	offset += 2;
+
+	while(offset < bytes.size()) {
+		if(bytes.size() < offset + 2) {
+			return {
+				header,
+				"Bytes not long enough to fit topic length",
+			};
+		}
+
+		auto topicLengthBytes = BytesView(bytes.begin() + offset, bytes.begin() + offset + 2);
+		auto [topicLength, topicLengthErr] = fromBigEndianBytes<uint16_t>(topicLengthBytes);
+		if(topicLengthErr) {
+			return {
+				header,
+				topicLengthErr,
+			};
+		}
+
+		offset += 2;
+
+		if(bytes.size() < offset + topicLength) {
+			return {
+				header,
+				"Bytes not enough to fit topic",
+			};
+		}
+
+		auto topicBegin = bytes.begin() + offset;
+		auto topic = std::string_view(reinterpret_cast<const char*>(bytes.data() + offset), topicLength);
+		if(auto err = validateTopic(topic, true); err) {
+			return {
+				header,
+				err,
+			};
+		}
+		offset += topicLength;
+
+		if(bytes.size() <= offset) {
+			return {
+				header,
+				"Bytes not enough to fit QoS level",
+			};
+		}
+
+		level = bytes[offset];
+		offset++;
+
+		header.topics.emplace_back(topicBegin, topicBegin + topicLength);
+		header.levels.push_back(static_cast<QosLevel>(level));
+	}
+
+	return {
+		std::move(header),
+		nullptr,
+	};
+}
+
+auto Mqtt::decodeAck(BytesView bytes) -> std::tuple<Mqtt::AckHeader, Error> {
+	if(bytes.size() < 2) {
+		return {
+			{},
+			"Bytes not enough to fit id",
+		};
+	}
+
+	auto [id, err] = fromBigEndianBytes<uint16_t>(BytesView(bytes.begin(), bytes.begin() + 2));
+	return {
+		{
+			.id = id,
+		},
+		err,
+	};
+}
+
+auto Mqtt::decodeUnsubscribe(BytesView bytes, std::pmr::memory_resource* resource) 
+		-> std::tuple<Mqtt::UnsubscribeHeader, Error> {
+	UnsubscribeHeader header = {
+		.topics = std::pmr::vector<std::pmr::string>(resource),
+	};
+	size_t offset = 0;
+
+	if(bytes.size() < 2) {
+		return {
+			header,
+			"Bytes not enough to fit id",
+		};
+	}
+
+	auto idBytes = BytesView(bytes.begin(), bytes.begin() + 2);
+	auto [id, err] = fromBigEndianBytes<uint16_t>(idBytes);
+	if(err) {
+		return {
+			header,
+			err,
+		};
+	}
+
+	offset += 2;
+	header.id = id;
+
+	while(offset < bytes.size()) {
+		if(bytes.size() < offset + 2) {
+			return {
+				header,
+				"Bytes not enough to fit topic length",
+			};
+		}
+
+		auto topicLengthBytes = BytesView(bytes.begin() + offset, bytes.begin() + offset + 2);
+		auto [topicLength, topicLengthErr] = fromBigEndianBytes<uint16_t>(topicLengthBytes);
+
+		if(topicLengthErr) {
+			return {
+				header,
+				topicLengthErr,
+			};
+		}
+
+		offset += 2;
+
+		if(bytes.size() < offset + topicLength) {
+			return {
+				header,
+				"Bytes not enough to fit topic",
+			};
+		}
+
+		auto topic = std::string_view(reinterpret_cast<const char*>(bytes.data() + offset), topicLength);
+		if(auto err = validateTopic(topic, true); err) {
+			return {
+				header,
+				err,
+			};
+		}
+
+		header.topics.emplace_back(topic);
+		offset += topicLength;
+	}
+
+	return {
+		std::move(header),
+		nullptr,
+	};
+}
+
+auto Mqtt::HeaderRepresentation::fromMessage(const Message& message) -> HeaderRepresentation {
+	HeaderRepresentation header;
+	header.set<TypeField>(message.type);
+	header.set<DuplicateField>(message.duplicate);
+	header.set<QosField>(message.level);
+	header.set<RetainField>(message.retain);
+	return header;
+}
+
+auto Mqtt::HeaderRepresentation::toMessage(Message& message) const -> void {
+	message.type = static_cast<Type>(get<TypeField>());
+	message.level = static_cast<QosLevel>(get<QosField>());
+	message.duplicate = get<DuplicateField>();
+	message.retain = get<RetainField>();
+}
+
+std::ostream& operator<<(std::ostream& os, const Mqtt::Message& message) {
+	os << "Type: " << Mqtt::toString(message.type) 
+		<< ", QoS: " << Mqtt::toString(message.level) 
+		<< ", Duplicate: " << (message.duplicate ? "true" : "false")
+		<< ", Retain: " << (message.retain ? "true" : "false");
+
+	if(auto connect = std::get_if<Mqtt::ConnectHeader>(&message.content); connect 
+			&& message.type == Mqtt::Connect) {
+		os << ", Protocol: " << connect->protocol 
+			<< ", Identifier: " << connect->identifier
+			<< ", Keep-alive: " << connect->keepAlive
+			<< ", Version: " << static_cast<int>(connect->version);
+	} else if(auto publish = std::get_if<Mqtt::PublishHeader>(&message.content); publish 
+			&& message.type == Mqtt::Publish) {
+		os << ", Topic: " << publish->topic
+			<< ", Id: " << publish->id
+			<< ", Payload: " << publish->payload;
+	} else if(auto ack = std::get_if<Mqtt::AckHeader>(&message.content); ack) {
+		os << ", Id: " << ack->id;
+	} else if(auto subscribe = std::get_if<Mqtt::SubscribeHeader>(&message.content); subscribe
+			&& message.type == Mqtt::Subscribe) {
+		os << ", Topics: ";
+		for(auto& topic : subscribe->topics) {
+			os << topic << ", ";
+		}
+		os << " Levels: ";
+		for(auto& level : subscribe->levels) {
+			os << Mqtt::toString(level) << ", ";
+		}
+	}
+
+	return os;
+}
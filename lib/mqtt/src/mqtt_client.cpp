@@ -0,0 +1,656 @@
+#include "mqtt_client.hpp"
+#include "unix_dns_lookup.hpp"
+
+#include <algorithm>
+#include <iostream>
+
+#include <errno.h>
+#include <sys/epoll.h>
+
+using namespace std::chrono_literals;
+
+constexpr auto minBackoff = 1s;
+constexpr auto maxBackoff = 60s;
+constexpr size_t readChunk = 64 * 1024;
+constexpr Byte duplicateFlag = 0x08;
+
+static auto encodeAck(Mqtt::Type type, uint16_t id) -> Bytes {
+	return Mqtt::encode({
+		.type = type,
+		.level = type == Mqtt::Pubrel ? Mqtt::Lv1 : Mqtt::Lv0,
+		.duplicate = false,
+		.retain = false,
+		.content = Mqtt::AckHeader{
+			.id = id,
+		},
+	});
+}
+
+MqttClient::MqttClient(Options options) : options(std::move(options)), backoff(minBackoff) {}
+
+MqttClient::~MqttClient() {
+	if(resolver.joinable()) {
+		resolver.join();
+	}
+	closeConnection();
+}
+
+auto MqttClient::onPublish(PublishHandler handler) -> void {
+	this->handler = std::move(handler);
+}
+
+auto MqttClient::publish(std::string_view topic, std::string_view payload, Mqtt::QosLevel level, bool retain,
+		Completion completion) -> Error {
+	if(auto err = Mqtt::validateTopic(topic, false); err) {
+		return err;
+	} else if(level == Mqtt::Lv2) {
+		return "QoS 2 publishes are not supported";
+	}
+
+	Mqtt::Message message = {
+		.type = Mqtt::Publish,
+		.level = level,
+		.duplicate = false,
+		.retain = retain,
+	};
+	message.content.emplace<Mqtt::PublishHeader>(Mqtt::PublishHeader{
+		.topic = std::pmr::string(topic),
+		.payload = std::pmr::string(payload),
+		.id = 0,
+		.pendingPayload = 0,
+	});
+
+	if(level == Mqtt::Lv0) {
+		enqueue({
+			.kind = Kind::Publish,
+			.packet = std::make_shared<const Bytes>(Mqtt::encode(message)),
+			.completion = std::move(completion),
+		});
+		return nullptr;
+	}
+
+	mutex.lock();
+	if(inFlight.size() >= 65535) {
+		mutex.unlock();
+		return "Too many unacknowledged publishes";
+	}
+
+	auto& publish = std::get<Mqtt::PublishHeader>(message.content);
+	publish.id = takeId();
+	auto packet = std::make_shared<const Bytes>(Mqtt::encode(message));
+	inFlightIds.set(publish.id);
+	inFlight.push_back({
+		.id = publish.id,
+		.packet = packet,
+		.completion = std::move(completion),
+	});
+	mutex.unlock();
+
+	enqueue({
+		.kind = Kind::Reliable,
+		.packet = packet,
+	});
+	return nullptr;
+}
+
+auto MqttClient::subscribe(std::string_view filter, Mqtt::QosLevel level) -> Error {
+	if(auto err = Mqtt::validateTopic(filter, true); err) {
+		return err;
+	} else if(auto err = Mqtt::validateFilter(filter); err) {
+		return err;
+	} else if(level == Mqtt::Lv2) {
+		return "QoS 2 subscriptions are not supported";
+	}
+
+	mutex.lock();
+	subscriptions.insert_or_assign(std::string(filter), level);
+
+	Mqtt::SubscribeHeader subscribe = {
+		.id = takeId(),
+	};
+	subscribe.topics.emplace_back(filter);
+	subscribe.levels.push_back(level);
+	mutex.unlock();
+
+	enqueue({
+		.kind = Kind::Control,
+		.packet = std::make_shared<const Bytes>(Mqtt::encode({
+			.type = Mqtt::Subscribe,
+			.level = Mqtt::Lv1,
+			.duplicate = false,
+			.retain = false,
+			.content = std::move(subscribe),
+		})),
+	});
+	return nullptr;
+}
+
+auto MqttClient::unsubscribe(std::string_view filter) -> void {
+	mutex.lock();
+	if(auto it = subscriptions.find(filter); it != subscriptions.end()) {
+		subscriptions.erase(it);
+	}
+
+	Mqtt::UnsubscribeHeader unsubscribe = {
+		.id = takeId(),
+	};
+	unsubscribe.topics.emplace_back(filter);
+	mutex.unlock();
+
+	enqueue({
+		.kind = Kind::Control,
+		.packet = std::make_shared<const Bytes>(Mqtt::encode({
+			.type = Mqtt::Unsubscribe,
+			.level = Mqtt::Lv1,
+			.duplicate = false,
+			.retain = false,
+			.content = std::move(unsubscribe),
+		})),
+	});
+}
+
+auto MqttClient::run() -> void {
+	if(auto err = reactor.open(); err) {
+		std::cerr << "MQTT client: " << err << '\n';
+		abandon("Client stopped", true);
+		return;
+	}
+
+	mutex.lock();
+	bool stopped = stopping;
+	mutex.unlock();
+	if(!stopped) {
+		connect();
+	}
+
+	if(auto err = reactor.run(); err) {
+		std::cerr << "MQTT client: " << err << '\n';
+	}
+	closeConnection();
+	abandon("Client stopped", true);
+}
+
+auto MqttClient::stop() -> void {
+	mutex.lock();
+	stopping = true;
+	mutex.unlock();
+	reactor.post([this]() {
+		shutdown();
+	});
+}
+
+auto MqttClient::unacknowledged() const -> size_t {
+	std::lock_guard<std::mutex> guard(mutex);
+	return inFlight.size();
+}
+
+auto MqttClient::dial(const std::vector<std::string>& addresses) -> std::tuple<UnixTcpSocket, Error> {
+	auto [socket, err] = UnixTcpSocket::create();
+	if(err) {
+		return {
+			socket,
+			err,
+		};
+	}
+
+	// the connection is only used once readable or writable, a short read or write is resumed later
+	if(err = socket.setNonBlocking(true); err) {
+		socket.close();
+		return {
+			socket,
+			err,
+		};
+	}
+
+	// an address that refuses shows only later, so every attempt starts at the next one
+	err = "Could not lookup address/port combination";
+	for(size_t i = 0; i < addresses.size() && err; i++) {
+		err = socket.startConnect(addresses[nextAddress++ % addresses.size()], options.port);
+	}
+	if(err) {
+		socket.close();
+		return {
+			socket,
+			err,
+		};
+	}
+
+	output = Mqtt::encode({
+		.type = Mqtt::Connect,
+		.level = Mqtt::Lv0,
+		.duplicate = false,
+		.retain = false,
+		.content = Mqtt::ConnectHeader{
+			.protocol = "MQTT",
+			.identifier = std::pmr::string(options.identifier),
+			.keepAlive = options.keepAlive,
+			.version = 4,
+			.flags = Mqtt::CleanSession,
+		},
+	});
+
+	return {
+		socket,
+		nullptr,
+	};
+}
+
+auto MqttClient::connect() -> void {
+	// the previous lookup has posted its result already, or connect would not run again
+	if(resolver.joinable()) {
+		resolver.join();
+	}
+
+	resolver = std::thread([this]() {
+		auto [addresses, err] = dnsLookup(options.address, options.port);
+		reactor.post([this, addresses = std::move(addresses), err]() {
+			resolved(addresses, err);
+		});
+	});
+}
+
+auto MqttClient::resolved(const std::vector<std::string>& addresses, Error err) -> void {
+	mutex.lock();
+	bool stopped = stopping;
+	mutex.unlock();
+	if(stopped) {
+		return;
+	}
+
+	UnixTcpSocket connection;
+	if(!err) {
+		std::tie(connection, err) = dial(addresses);
+	}
+	if(err) {
+		std::cerr << "MQTT connection to " << options.address << ":" << options.port << ": " << err << '\n';
+		retry();
+		return;
+	}
+
+	// the CONNECT is already waiting in output, writability also means the handshake is done
+	interest = EPOLLIN | EPOLLOUT;
+	if(err = reactor.watch(connection.descriptor(), interest, [this](uint32_t events) {
+		onReady(events);
+	}); err) {
+		connection.close();
+		std::cerr << "MQTT connection to " << options.address << ":" << options.port << ": " << err << '\n';
+		retry();
+		return;
+	}
+
+	socket = connection;
+	live = true;
+	backoff = minBackoff;
+	lastSent = Clock::now();
+	lastReceived = Clock::now();
+	if(options.keepAlive > 0) {
+		keepAliveTimer = reactor.schedule(std::chrono::seconds(options.keepAlive) / 2, [this]() {
+			checkKeepAlive();
+		});
+	}
+}
+
+auto MqttClient::retry() -> void {
+	reconnectTimer = reactor.schedule(backoff, [this]() {
+		reconnectTimer = 0;
+		connect();
+	});
+	backoff = std::min<Clock::duration>(backoff * 2, maxBackoff);
+}
+
+auto MqttClient::onReady(uint32_t events) -> void {
+	Error err = nullptr;
+	if(events & EPOLLOUT) {
+		err = send();
+	}
+	if(!err && (events & (EPOLLIN | EPOLLHUP | EPOLLERR))) {
+		err = receive();
+	}
+
+	if(err) {
+		drop(err);
+	} else {
+		transmit();
+	}
+}
+
+auto MqttClient::send() -> Error {
+	auto [count, err] = socket.write(BytesView(output.data() + written, output.size() - written));
+	if(err && errno != EAGAIN) {
+		return err;
+	}
+
+	written += count;
+	completeWritten();
+	if(written == output.size()) {
+		output.clear();
+		written = 0;
+	}
+	lastSent = Clock::now();
+	return nullptr;
+}
+
+auto MqttClient::receive() -> Error {
+	auto [count, err] = socket.read(input.prepare(readChunk), readChunk);
+	if(err && errno != EAGAIN) {
+		return err;
+	} else if(!err && count == 0) {
+		return "Connection closed by broker";
+	}
+	input.commit(count);
+	lastReceived = Clock::now();
+
+	// every complete packet is handled, a partial one waits for the rest
+	while(true) {
+		auto remaining = input.readable();
+		auto [length, frameErr] = Mqtt::frameLength(remaining);
+		if(frameErr) {
+			return frameErr;
+		} else if(length == 0 || length > remaining.size()) {
+			return nullptr;
+		}
+
+		auto [message, decodeErr] = Mqtt::decode(BytesView(remaining.data(), length));
+		if(decodeErr) {
+			return decodeErr;
+		}
+		input.consume(length);
+
+		if(auto handleErr = handle(message); handleErr) {
+			return handleErr;
+		}
+	}
+}
+
+auto MqttClient::checkKeepAlive() -> void {
+	auto keepAlive = std::chrono::duration_cast<Clock::duration>(std::chrono::seconds(options.keepAlive));
+	auto now = Clock::now();
+	if(now - lastReceived > keepAlive * 3 / 2) {
+		keepAliveTimer = 0;
+		drop("Broker stopped answering");
+		return;
+	}
+
+	if(now - lastSent >= keepAlive / 2) {
+		auto ping = Mqtt::encode({
+			.type = Mqtt::Pingreq,
+			.level = Mqtt::Lv0,
+			.duplicate = false,
+			.retain = false,
+		});
+		output.insert(output.end(), ping.begin(), ping.end());
+		lastSent = now;
+		transmit();
+	}
+
+	keepAliveTimer = reactor.schedule(lastSent + keepAlive / 2 - now, [this]() {
+		checkKeepAlive();
+	});
+}
+
+auto MqttClient::transmit() -> void {
+	if(!live) {
+		return;
+	}
+
+	// the socket is nearly always writable, so waiting for the reactor to say so would only cost a round;
+	// a burst beyond flushBytes goes out a flush at a time until the queue is empty or the socket full
+	bool full = (interest & EPOLLOUT) && written < output.size();
+	bool queued = false;
+	while(true) {
+		// nothing but the CONNECT may go out before the broker accepted it
+		mutex.lock();
+		if(connected) {
+			flush();
+		}
+		queued = connected && !pending.empty();
+		mutex.unlock();
+
+		if(full || written == output.size()) {
+			break;
+		}
+
+		if(auto err = send(); err) {
+			drop(err);
+			return;
+		}
+		full = written < output.size();
+	}
+
+	uint32_t wanted = EPOLLIN | (written < output.size() || queued ? EPOLLOUT : 0);
+	if(wanted != interest) {
+		if(auto err = reactor.modify(socket.descriptor(), wanted); err) {
+			drop(err);
+			return;
+		}
+		interest = wanted;
+	}
+}
+
+auto MqttClient::drop(Error err) -> void {
+	closeConnection();
+	abandon("Connection lost before the publish was written", false);
+	std::cerr << "MQTT connection to " << options.address << ":" << options.port << ": " << err << '\n';
+	retry();
+}
+
+auto MqttClient::closeConnection() -> void {
+	if(!live) {
+		return;
+	}
+
+	reactor.unwatch(socket.descriptor());
+	socket.close();
+	live = false;
+	if(keepAliveTimer != 0) {
+		reactor.cancel(keepAliveTimer);
+		keepAliveTimer = 0;
+	}
+
+	mutex.lock();
+	connected = false;
+	mutex.unlock();
+}
+
+auto MqttClient::shutdown() -> void {
+	if(live) {
+		// best effort, the broker drops the connection either way
+		socket.write(Mqtt::encode({
+			.type = Mqtt::Disconnect,
+			.level = Mqtt::Lv0,
+			.duplicate = false,
+			.retain = false,
+		}));
+		closeConnection();
+	}
+
+	if(reconnectTimer != 0) {
+		reactor.cancel(reconnectTimer);
+		reconnectTimer = 0;
+	}
+	reactor.stop();
+}
+
+auto MqttClient::handle(const Mqtt::Message& message) -> Error {
+	switch(message.type) {
+		case Mqtt::Connack: {
+			auto connack = std::get_if<Mqtt::ConnackHeader>(&message.content);
+			if(connack == nullptr || connack->code != 0x00) {
+				std::cerr << "CONNACK code " << static_cast<int>(connack ? connack->code : 0xff) << '\n';
+				return "Broker refused the connection";
+			}
+			resume();
+			break;
+		}
+		case Mqtt::Publish: {
+			auto publish = std::get_if<Mqtt::PublishHeader>(&message.content);
+			if(publish == nullptr) {
+				return "Publish without a header";
+			}
+
+			if(handler) {
+				handler(publish->topic, publish->payload);
+			}
+
+			if(message.level == Mqtt::Lv1) {
+				auto ack = encodeAck(Mqtt::Puback, publish->id);
+				output.insert(output.end(), ack.begin(), ack.end());
+			} else if(message.level == Mqtt::Lv2) {
+				// delivered on arrival, a duplicate from the broker is delivered again
+				auto ack = encodeAck(Mqtt::Pubrec, publish->id);
+				output.insert(output.end(), ack.begin(), ack.end());
+			}
+			break;
+		}
+		case Mqtt::Pubrel: {
+			auto ack = encodeAck(Mqtt::Pubcomp, std::get<Mqtt::AckHeader>(message.content).id);
+			output.insert(output.end(), ack.begin(), ack.end());
+			break;
+		}
+		case Mqtt::Puback: {
+			auto id = std::get<Mqtt::AckHeader>(message.content).id;
+			Completion completion;
+
+			mutex.lock();
+			// acknowledgements nearly always arrive in order
+			auto it = std::find_if(inFlight.begin(), inFlight.end(), [&](const InFlight& entry) {
+				return entry.id == id;
+			});
+			if(it != inFlight.end()) {
+				completion = std::move(it->completion);
+				inFlightIds.reset(id);
+				inFlight.erase(it);
+			}
+			mutex.unlock();
+
+			if(completion) {
+				completion(nullptr);
+			}
+			break;
+		}
+		case Mqtt::Suback:
+		case Mqtt::Unsuback:
+		case Mqtt::Pingresp:
+			break;
+		default:
+			std::cerr << "Unexpected " << Mqtt::toString(message.type) << " from broker\n";
+			return "Unexpected packet from broker";
+	}
+
+	return nullptr;
+}
+
+auto MqttClient::resume() -> void {
+	std::lock_guard<std::mutex> guard(mutex);
+	connected = true;
+
+	// only QoS 0 publishes stay queued, the rest is covered by what follows
+	std::erase_if(pending, [](const Pending& entry) {
+		return entry.kind != Kind::Publish;
+	});
+
+	// the session is clean, so every subscription is made again in one SUBSCRIBE
+	if(!subscriptions.empty()) {
+		Mqtt::SubscribeHeader subscribe = {
+			.id = takeId(),
+		};
+		for(const auto& [filter, level] : subscriptions) {
+			subscribe.topics.emplace_back(filter);
+			subscribe.levels.push_back(level);
+		}
+
+		auto packet = Mqtt::encode({
+			.type = Mqtt::Subscribe,
+			.level = Mqtt::Lv1,
+			.duplicate = false,
+			.retain = false,
+			.content = std::move(subscribe),
+		});
+		output.insert(output.end(), packet.begin(), packet.end());
+	}
+
+	// sent before, so marked as possible duplicates
+	for(const auto& entry : inFlight) {
+		size_t start = output.size();
+		output.insert(output.end(), entry.packet->begin(), entry.packet->end());
+		output[start] |= duplicateFlag;
+	}
+}
+
+auto MqttClient::flush() -> void {
+	while(!pending.empty() && output.size() < options.flushBytes) {
+		auto& entry = pending.front();
+		output.insert(output.end(), entry.packet->begin(), entry.packet->end());
+		if(entry.completion) {
+			unwritten.emplace_back(output.size(), std::move(entry.completion));
+		}
+		pending.pop_front();
+	}
+}
+
+auto MqttClient::completeWritten() -> void {
+	while(!unwritten.empty() && unwritten.front().first <= written) {
+		auto completion = std::move(unwritten.front().second);
+		unwritten.pop_front();
+		completion(nullptr);
+	}
+}
+
+auto MqttClient::abandon(Error err, bool stopped) -> void {
+	std::vector<Completion> failed;
+	for(auto& entry : unwritten) {
+		failed.push_back(std::move(entry.second));
+	}
+	unwritten.clear();
+
+	input.clear();
+	output.clear();
+	written = 0;
+
+	// queued QoS 0 publishes wait for the next connection, unacknowledged QoS 1 ones are resent
+	if(stopped) {
+		mutex.lock();
+		for(auto& entry : pending) {
+			if(entry.completion) {
+				failed.push_back(std::move(entry.completion));
+			}
+		}
+		for(auto& entry : inFlight) {
+			if(entry.completion) {
+				failed.push_back(std::move(entry.completion));
+			}
+		}
+		pending.clear();
+		inFlight.clear();
+		inFlightIds.reset();
+		mutex.unlock();
+	}
+
+	for(auto& completion : failed) {
+		completion(err);
+	}
+}
+
+auto MqttClient::enqueue(Pending entry) -> void {
+	mutex.lock();
+	// the loop takes everything queued when it runs, so only the first packet of a burst wakes it
+	bool idle = pending.empty();
+	pending.push_back(std::move(entry));
+	mutex.unlock();
+
+	if(idle) {
+		reactor.post([this]() {
+			transmit();
+		});
+	}
+}
+
+auto MqttClient::takeId() -> uint16_t {
+	// publish() refuses once all 65535 are in flight, so a free one is always found
+	uint16_t id;
+	do {
+		id = nextId;
+		nextId = nextId % 65535 + 1;
+	} while(inFlightIds.test(id));
+	return id;
+}
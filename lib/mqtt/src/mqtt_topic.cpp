@@ -0,0 +1,249 @@
+#include "mqtt.hpp"
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define MQTT_TOPIC_SIMD 1
+#endif
+
+// Topic validation: one pass over the topic checks that it is UTF-8 without
+// NUL characters, that a topic name carries no wildcards, and records where
+// every '/' is so routing can match levels without splitting the topic again.
+// Blocks of ASCII, which is nearly every topic, are checked 32 or 16 bytes at
+// a time; a block with a multibyte character is checked byte by byte.
+
+auto Mqtt::TopicLevels::count() const -> size_t {
+	return separatorCount + 1;
+}
+
+auto Mqtt::TopicLevels::level(std::string_view topic, size_t index) const -> std::string_view {
+	size_t begin = index == 0 ? 0 : separators[index - 1] + 1;
+	size_t end = index < separatorCount ? separators[index] : topic.size();
+	return topic.substr(begin, end - begin);
+}
+
+auto Mqtt::TopicLevels::add(size_t separator) -> void {
+	if(separatorCount < maxSeparators) {
+		separators[separatorCount] = static_cast<uint16_t>(separator);
+		separatorCount++;
+	} else {
+		overflow = true;
+	}
+}
+
+// length of the well-formed UTF-8 sequence starting with a non-ASCII byte at offset, zero if malformed
+static auto sequenceLength(const uint8_t* data, size_t size, size_t offset) -> size_t {
+	uint8_t lead = data[offset];
+	size_t length;
+	uint8_t low = 0x80;
+	uint8_t high = 0xbf;
+
+	if(lead >= 0xc2 && lead <= 0xdf) {
+		length = 2;
+	} else if(lead >= 0xe0 && lead <= 0xef) {
+		length = 3;
+		// no overlong encodings and no surrogates
+		low = lead == 0xe0 ? 0xa0 : 0x80;
+		high = lead == 0xed ? 0x9f : 0xbf;
+	} else if(lead >= 0xf0 && lead <= 0xf4) {
+		length = 4;
+		low = lead == 0xf0 ? 0x90 : 0x80;
+		high = lead == 0xf4 ? 0x8f : 0xbf;
+	} else {
+		return 0;
+	}
+
+	if(offset + length > size || data[offset + 1] < low || data[offset + 1] > high) {
+		return 0;
+	}
+	for(size_t i = 2; i < length; i++) {
+		if(data[offset + i] < 0x80 || data[offset + i] > 0xbf) {
+			return 0;
+		}
+	}
+	return length;
+}
+
+// checks bytes from offset up to at least end, a multibyte character may carry it past end
+static auto scanScalar(const uint8_t* data, size_t size, size_t& offset, size_t end, bool wildcards,
+		Mqtt::TopicLevels* levels) -> Error {
+	while(offset < end) {
+		uint8_t byte = data[offset];
+		if(byte >= 0x80) {
+			size_t length = sequenceLength(data, size, offset);
+			if(length == 0) {
+				return "Topic is not valid UTF-8";
+			}
+			offset += length;
+			continue;
+		}
+
+		if(byte == 0) {
+			return "Topic contains a NUL character";
+		} else if(!wildcards && (byte == '+' || byte == '#')) {
+			return "Topic name contains a wildcard";
+		} else if(byte == '/' && levels) {
+			levels->add(offset);
+		}
+		offset++;
+	}
+	return nullptr;
+}
+
+#ifdef MQTT_TOPIC_SIMD
+__attribute__((target("avx2")))
+static auto scanAvx2(const uint8_t* data, size_t size, size_t& offset, bool wildcards,
+		Mqtt::TopicLevels* levels) -> Error {
+	const __m256i zero = _mm256_setzero_si256();
+	const __m256i slash = _mm256_set1_epi8('/');
+	const __m256i plus = _mm256_set1_epi8('+');
+	const __m256i hash = _mm256_set1_epi8('#');
+
+	while(offset + 32 <= size) {
+		__m256i block = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(data + offset));
+		if(_mm256_movemask_epi8(block) != 0) {
+			if(auto err = scanScalar(data, size, offset, offset + 32, wildcards, levels); err) {
+				return err;
+			}
+			continue;
+		}
+
+		if(_mm256_movemask_epi8(_mm256_cmpeq_epi8(block, zero)) != 0) {
+			return "Topic contains a NUL character";
+		}
+
+		if(!wildcards && _mm256_movemask_epi8(_mm256_or_si256(
+				_mm256_cmpeq_epi8(block, plus), _mm256_cmpeq_epi8(block, hash))) != 0) {
+			return "Topic name contains a wildcard";
+		}
+
+		if(levels) {
+			uint32_t separators = _mm256_movemask_epi8(_mm256_cmpeq_epi8(block, slash));
+			while(separators != 0) {
+				levels->add(offset + __builtin_ctz(separators));
+				separators &= separators - 1;
+			}
+		}
+		offset += 32;
+	}
+	return nullptr;
+}
+
+static auto scanSse2(const uint8_t* data, size_t size, size_t& offset, bool wildcards,
+		Mqtt::TopicLevels* levels) -> Error {
+	const __m128i zero = _mm_setzero_si128();
+	const __m128i slash = _mm_set1_epi8('/');
+	const __m128i plus = _mm_set1_epi8('+');
+	const __m128i hash = _mm_set1_epi8('#');
+
+	while(offset + 16 <= size) {
+		__m128i block = _mm_loadu_si128(reinterpret_cast<const __m128i*>(data + offset));
+		if(_mm_movemask_epi8(block) != 0) {
+			if(auto err = scanScalar(data, size, offset, offset + 16, wildcards, levels); err) {
+				return err;
+			}
+			continue;
+		}
+
+		if(_mm_movemask_epi8(_mm_cmpeq_epi8(block, zero)) != 0) {
+			return "Topic contains a NUL character";
+		}
+
+		if(!wildcards && _mm_movemask_epi8(_mm_or_si128(
+				_mm_cmpeq_epi8(block, plus), _mm_cmpeq_epi8(block, hash))) != 0) {
+			return "Topic name contains a wildcard";
+		}
+
+		if(levels) {
+			uint32_t separators = _mm_movemask_epi8(_mm_cmpeq_epi8(block, slash));
+			while(separators != 0) {
+				levels->add(offset + __builtin_ctz(separators));
+				separators &= separators - 1;
+			}
+		}
+		offset += 16;
+	}
+	return nullptr;
+}
+#endif
+
+auto Mqtt::validateTopic(std::string_view topic, bool wildcards, TopicLevels* levels) -> Error {
+	auto data = reinterpret_cast<const uint8_t*>(topic.data());
+	size_t offset = 0;
+
+	if(levels) {
+		*levels = {};
+	}
+
+	// names and filters are at least one character long
+	if(topic.empty()) {
+		return "Topic is empty";
+	}
+
+#ifdef MQTT_TOPIC_SIMD
+	static const bool avx2 = __builtin_cpu_supports("avx2");
+	auto err = avx2 ? scanAvx2(data, topic.size(), offset, wildcards, levels)
+		: scanSse2(data, topic.size(), offset, wildcards, levels);
+	if(err) {
+		return err;
+	}
+#endif
+
+	return scanScalar(data, topic.size(), offset, topic.size(), wildcards, levels);
+}
+
+auto Mqtt::validateFilter(std::string_view filter) -> Error {
+	if(filter.empty()) {
+		return "Topic filter is empty";
+	}
+
+	while(true) {
+		auto end = filter.find('/');
+		auto level = filter.substr(0, end);
+
+		if(level.find('#') != std::string_view::npos && (level != "#" || end != std::string_view::npos)) {
+			return "Multi-level wildcard is not alone in the last level";
+		} else if(level.find('+') != std::string_view::npos && level != "+") {
+			return "Single-level wildcard is not alone in its level";
+		}
+
+		if(end == std::string_view::npos) {
+			return nullptr;
+		}
+		filter.remove_prefix(end + 1);
+	}
+}
+
+auto Mqtt::matches(std::string_view filter, std::string_view topic, const TopicLevels& levels) -> bool {
+	if(levels.overflow) {
+		return matches(filter, topic);
+	}
+
+	// wildcards at the first level never match $ topics
+	if(!topic.empty() && topic[0] == '$' && !filter.empty() && (filter[0] == '+' || filter[0] == '#')) {
+		return false;
+	}
+
+	size_t count = levels.count();
+	size_t index = 0;
+	while(true) {
+		auto filterEnd = filter.find('/');
+		auto filterLevel = filter.substr(0, filterEnd);
+
+		if(filterLevel == "#") {
+			return true;
+		} else if(filterLevel != "+" && filterLevel != levels.level(topic, index)) {
+			return false;
+		}
+		index++;
+
+		if(filterEnd == std::string_view::npos) {
+			return index == count;
+		}
+		filter.remove_prefix(filterEnd + 1);
+
+		if(index == count) {
+			// "a/#" also matches its parent "a"
+			return filter == "#";
+		}
+	}
+}
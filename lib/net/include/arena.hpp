@@ -0,0 +1,39 @@
+#pragma once
+#include <cstddef>
+#include <memory_resource>
+#include <vector>
+
+// Bump allocator for data that dies together, e.g. everything decoded from
+// one packet. Deallocation is a no-op, reset() rewinds the arena and keeps
+// its memory so a warmed up arena never touches the heap again. What it keeps
+// is capped at a few times the initial size, a single huge packet does not
+// pin its memory for the arena's lifetime.
+class Arena : public std::pmr::memory_resource {
+public:
+	Arena(size_t initialSize = 4096);
+	~Arena();
+
+	Arena(const Arena&) = delete;
+	auto operator=(const Arena&) -> Arena& = delete;
+
+	auto reset() -> void;
+	// blocks taken from the heap so far, flat once the arena is warmed up
+	auto upstreamAllocations() const -> size_t;
+private:
+	auto do_allocate(size_t bytes, size_t alignment) -> void* override;
+	auto do_deallocate(void* pointer, size_t bytes, size_t alignment) -> void override;
+	auto do_is_equal(const std::pmr::memory_resource& other) const noexcept -> bool override;
+
+	auto grow(size_t atLeast) -> void;
+
+	struct Block {
+		std::byte* data;
+		size_t size;
+	};
+
+	std::vector<Block> blocks;
+	std::byte* cursor = nullptr;
+	std::byte* limit = nullptr;
+	size_t keepLimit;
+	size_t allocations = 0;
+};
@@ -0,0 +1,71 @@
+#pragma once
+#include <coroutine>
+#include <memory>
+#include <tuple>
+#include <vector>
+
+#include "byte_buffer.hpp"
+#include "common.hpp"
+#include "error.hpp"
+#include "reactor.hpp"
+#include "task.hpp"
+#include "unix_tcp_socket.hpp"
+
+// Non-blocking TCP socket for coroutines on a Reactor. Every operation tries
+// the system call first and only suspends when it would block; the reactor
+// watches the socket edge triggered for as long as it is attached, so waiting
+// costs no epoll_ctl calls. Reads go through a block buffer like
+// BufferedReader's. At most one coroutine may read and one write at a time,
+// and both must be done before the socket is closed.
+class AsyncTcpSocket {
+public:
+	static auto attach(Reactor& reactor, UnixTcpSocket socket) -> std::tuple<AsyncTcpSocket, Error>;
+
+	AsyncTcpSocket() = default;
+	AsyncTcpSocket(AsyncTcpSocket&& other) = default;
+	auto operator=(AsyncTcpSocket&& other) -> AsyncTcpSocket&;
+	~AsyncTcpSocket();
+
+	// at least one connection
+	auto acceptBatch(size_t maxCount) -> Task<std::tuple<std::vector<UnixTcpSocket>, Error>>;
+	// whatever has arrived, at least one byte unless the peer closed the connection
+	auto read(Byte* destination, size_t howManyBytes) -> Task<std::tuple<size_t, Error>>;
+	auto read(size_t howManyBytes) -> Task<std::tuple<Bytes, Error>>;
+	// all of them unless the connection ends first
+	auto readExact(size_t howManyBytes) -> Task<std::tuple<Bytes, Error>>;
+	// up to and including thisByte
+	auto readUntil(Byte thisByte) -> Task<std::tuple<Bytes, Error>>;
+	// all of bytes unless writing fails
+	auto write(BytesView bytes) -> Task<std::tuple<size_t, Error>>;
+	auto close() -> void;
+	auto socket() const -> UnixTcpSocket;
+private:
+	struct State {
+		Reactor* reactor;
+		UnixTcpSocket socket;
+		std::coroutine_handle<> reader;
+		std::coroutine_handle<> writer;
+		ByteBuffer input;
+	};
+
+	struct Readiness {
+		State* state;
+		bool writing;
+
+		auto await_ready() const noexcept -> bool {
+			return false;
+		}
+
+		auto await_suspend(std::coroutine_handle<> handle) noexcept -> void {
+			(writing ? state->writer : state->reader) = handle;
+		}
+
+		auto await_resume() const noexcept -> void {}
+	};
+
+	// one more block into the input buffer, at least one byte unless the peer closed the connection
+	auto fill() -> Task<std::tuple<size_t, Error>>;
+
+	// the reactor's handler points at the state, so it stays put when the socket is moved
+	std::unique_ptr<State> state;
+};
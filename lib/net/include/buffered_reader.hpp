@@ -0,0 +1,43 @@
+#pragma once
+#include <chrono>
+#include <tuple>
+
+#include "byte_buffer.hpp"
+#include "common.hpp"
+#include "error.hpp"
+#include "unix_tcp_socket.hpp"
+
+// Reads a TCP socket a block at a time and hands out exactly as many bytes as
+// asked for, so a packet split over several segments is put back together and
+// a burst of small packets costs one read. Whatever was read ahead lives only
+// in this reader: before anyone else reads the socket, buffered() has to be
+// drained. Works on blocking and non-blocking sockets alike.
+class BufferedReader {
+public:
+	static constexpr size_t defaultBlockSize = 16 * 1024;
+
+	BufferedReader(UnixTcpSocket socket, size_t blockSize = defaultBlockSize);
+
+	auto readExact(Byte* destination, size_t howManyBytes) -> Error;
+	auto readExact(size_t howManyBytes) -> std::tuple<Bytes, Error>;
+	// up to and including thisByte
+	auto readUntil(Byte thisByte) -> std::tuple<Bytes, Error>;
+	// read from the socket but not handed out yet
+	auto buffered() const -> BytesView;
+	auto consume(size_t count) -> void;
+	// zero reads no further than asked for and leaves everything after it in the kernel
+	auto setBlockSize(size_t bytes) -> void;
+	// a wait for the socket also watches wakeFd; once that turns readable the peer has grace
+	// to deliver more, after which the read fails rather than block whoever raised it
+	auto interruptBy(int wakeFd, std::chrono::milliseconds grace) -> void;
+	auto socket() const -> UnixTcpSocket;
+private:
+	// at least one byte, waits for the socket if it has none
+	auto receive(Byte* destination, size_t howManyBytes) -> std::tuple<size_t, Error>;
+
+	UnixTcpSocket connection;
+	ByteBuffer input;
+	size_t blockSize;
+	int wakeFd = -1;
+	std::chrono::milliseconds grace{0};
+};
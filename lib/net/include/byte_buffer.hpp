@@ -0,0 +1,25 @@
+#pragma once
+#include "common.hpp"
+
+// Contiguous buffer that is filled at its back and drained from its front,
+// e.g. the bytes read from a socket but not yet decoded. Drained bytes are
+// reclaimed by moving the unread rest to the start, and only once that is
+// cheaper than growing, so a steady stream settles into one allocation.
+class ByteBuffer {
+public:
+	ByteBuffer(size_t capacity = 0);
+
+	auto readable() const -> BytesView;
+	auto size() const -> size_t;
+	auto empty() const -> bool;
+	auto consume(size_t count) -> void;
+	// room for at least count more bytes, commit says how many were written there
+	auto prepare(size_t count) -> Byte*;
+	auto commit(size_t count) -> void;
+	auto append(BytesView bytes) -> void;
+	auto clear() -> void;
+private:
+	Bytes storage;
+	size_t begin = 0;
+	size_t end = 0;
+};
@@ -0,0 +1,223 @@
+#pragma once
+#include <algorithm>
+#include <array>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <tuple>
+#include <type_traits>
+#include <vector>
+
+#include <iostream>
+
+#include "error.hpp"
+
+using Byte = unsigned char;
+using Bytes = std::vector<Byte>;
+
+template<typename T>
+class View {
+public:
+	template<typename U>
+	View(const U* a, size_t length) : first(a), last(a + length) {}
+
+	template<typename U>
+	View(const U a, const U b) : first(&*a), last(&*b) {}
+
+	template<typename Container>
+	View(const Container& container) : 
+		first(reinterpret_cast<const T*>(&*container.begin())), 
+		last(reinterpret_cast<const T*>(&*container.end())) {}
+
+	auto size() const -> size_t {
+		return std::distance(first, last);
+	}
+
+	auto begin() const -> const T* {
+		return first;
+	}
+
+	auto end() const -> const T* {
+		return last;
+	}
+
+	auto data() const -> const T* {
+		return first;
+	}
+
+	auto operator[](size_t index) const -> const T& {
+		return first[index];
+	}
+
+private:
+	const T* first;
+	const T* last;
+};
+
+using BytesView = View<Byte>;
+
+// counters written by different threads are kept this far apart so they do not share a line
+constexpr size_t cacheLineSize = 64;
+
+// Wire layouts are declared field by field: a BitField is Width bits of a
+// Word, starting Offset bits above its least significant bit, and reading or
+// writing one is a shift and a mask known at compile time. A PackedWord holds
+// the word itself, and WordLayout checks that a set of fields tiles it.
+template<typename WordType, unsigned Offset, unsigned Width>
+struct BitField {
+	using Word = WordType;
+	static_assert(std::is_unsigned<Word>::value && Width > 0 && Offset + Width <= sizeof(Word) * 8,
+			"Bit field does not fit its word");
+
+	constexpr static Word mask = static_cast<Word>(
+			(Width >= 64 ? ~uint64_t(0) : (uint64_t(1) << Width) - 1) << Offset);
+
+	constexpr static auto get(Word word) -> Word {
+		return static_cast<Word>((word & mask) >> Offset);
+	}
+
+	constexpr static auto set(Word word, Word value) -> Word {
+		return static_cast<Word>((word & ~mask) | ((static_cast<uint64_t>(value) << Offset) & mask));
+	}
+};
+
+template<typename Word, typename... Fields>
+struct WordLayout {
+	// every bit belongs to exactly one field
+	constexpr static auto tiles() -> bool {
+		uint64_t seen = 0;
+		bool overlap = false;
+		((overlap = overlap || (seen & Fields::mask) != 0, seen |= Fields::mask), ...);
+		return !overlap && seen == static_cast<Word>(~Word(0))
+			&& (std::is_same<typename Fields::Word, Word>::value && ...);
+	}
+};
+
+template<typename Word>
+struct PackedWord {
+	Word data = 0;
+
+	template<typename Field>
+	constexpr auto get() const -> Word {
+		static_assert(std::is_same<typename Field::Word, Word>::value, "Field of another word");
+		return Field::get(data);
+	}
+
+	template<typename Field>
+	constexpr auto set(Word value) -> void {
+		static_assert(std::is_same<typename Field::Word, Word>::value, "Field of another word");
+		data = Field::set(data, value);
+	}
+};
+
+template<typename T>
+constexpr auto byteSwap(T value) -> T {
+	static_assert(std::is_integral<T>::value, "Only integers have a byte order");
+	if constexpr(sizeof(T) == 1) {
+		return value;
+	} else if constexpr(sizeof(T) == 2) {
+		return static_cast<T>(__builtin_bswap16(static_cast<uint16_t>(value)));
+	} else if constexpr(sizeof(T) == 4) {
+		return static_cast<T>(__builtin_bswap32(static_cast<uint32_t>(value)));
+	} else {
+		return static_cast<T>(__builtin_bswap64(static_cast<uint64_t>(value)));
+	}
+}
+
+static_assert(byteSwap<uint32_t>(0x11223344) == 0x44332211 && byteSwap<uint16_t>(0x1122) == 0x2211);
+static_assert(BitField<uint8_t, 1, 2>::set(0xff, 0) == 0xf9 && BitField<uint8_t, 1, 2>::get(0x04) == 2);
+
+// converts either way between host and network byte order
+template<typename T>
+constexpr auto bigEndian(T value) -> T {
+#if __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+	return value;
+#else
+	return byteSwap(value);
+#endif
+}
+
+// integers are converted as they are, wire layouts through the word they pack
+template<typename T, typename = void>
+struct WireWordOf {
+	using Type = T;
+};
+
+template<typename T>
+struct WireWordOf<T, std::void_t<decltype(T::data)>> {
+	using Type = decltype(T::data);
+};
+
+template<typename T>
+using WireWord = typename WireWordOf<T>::Type;
+
+// unaligned, the source may be anywhere in a packet
+template<typename T>
+auto loadBigEndian(const Byte* source) -> T {
+	WireWord<T> word;
+	std::memcpy(&word, source, sizeof word);
+	word = bigEndian(word);
+
+	if constexpr(std::is_integral<T>::value) {
+		return word;
+	} else {
+		T value;
+		value.data = word;
+		return value;
+	}
+}
+
+template<typename T>
+auto storeBigEndian(Byte* destination, const T& value) -> Byte* {
+	WireWord<T> word;
+	if constexpr(std::is_integral<T>::value) {
+		word = bigEndian(value);
+	} else {
+		word = bigEndian(value.data);
+	}
+	std::memcpy(destination, &word, sizeof word);
+	return destination + sizeof word;
+}
+
+// the bytes of a value in network byte order, kept by value so a temporary is fine
+template<typename T>
+struct AsBigEndianBytes {
+	AsBigEndianBytes(const T& value) {
+		storeBigEndian(bytes.data(), value);
+	}
+
+	auto begin() const -> const Byte* {
+		return bytes.data();
+	}
+
+	auto end() const -> const Byte* {
+		return bytes.data() + bytes.size();
+	}
+
+	auto size() const -> size_t {
+		return bytes.size();
+	}
+
+private:
+	std::array<Byte, sizeof(WireWord<T>)> bytes;
+};
+
+template<typename T>
+auto fromBigEndianBytes(BytesView bytes) -> std::tuple<T, Error> {
+	if(sizeof(WireWord<T>) != bytes.size()) {
+		return {
+			T(),
+			"Size mismatch between byte view and conversion type",
+		};
+	} else if(bytes.data() == nullptr) {
+		return {
+			T(),
+			"Byte view points to null",
+		};
+	}
+
+	return {
+		loadBigEndian<T>(bytes.data()),
+		nullptr,
+	};
+}
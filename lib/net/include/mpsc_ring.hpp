@@ -0,0 +1,110 @@
+#pragma once
+#include <atomic>
+#include <bit>
+#include <memory>
+
+#include "common.hpp"
+
+// Bounded queue from any number of producing threads to one consuming
+// thread. Producers claim slots by moving the shared tail forward with a
+// compare-and-swap and publish each slot through a sequence number of its
+// own, so a producer that is slow to fill its slot never blocks the others
+// from claiming theirs; the consumer stops at the first slot not published
+// yet. A batch claims all of its slots with a single compare-and-swap.
+// Capacity is rounded up to a power of two.
+template<typename T>
+class MpscRing {
+public:
+	explicit MpscRing(size_t capacity) :
+			size(std::bit_ceil(std::max<size_t>(capacity, 2))), mask(size - 1), slots(new Slot[size]) {
+		for(size_t i = 0; i < size; i++) {
+			slots[i].sequence.store(i, std::memory_order_relaxed);
+		}
+	}
+
+	MpscRing(const MpscRing&) = delete;
+	auto operator=(const MpscRing&) -> MpscRing& = delete;
+
+	// any thread, value is left untouched if the ring is full
+	auto tryPush(T&& value) -> bool {
+		auto position = tail.load(std::memory_order_relaxed);
+		while(true) {
+			auto& slot = slots[position & mask];
+			auto lag = static_cast<intptr_t>(slot.sequence.load(std::memory_order_acquire) - position);
+			if(lag < 0) {
+				return false;
+			} else if(lag > 0) {
+				position = tail.load(std::memory_order_relaxed);
+			} else if(tail.compare_exchange_weak(position, position + 1, std::memory_order_relaxed)) {
+				slot.value = std::move(value);
+				slot.sequence.store(position + 1, std::memory_order_release);
+				return true;
+			}
+		}
+	}
+
+	// any thread, moves as many as fit, returns the first one left over
+	template<typename Iterator>
+	auto tryPush(Iterator first, Iterator last) -> Iterator {
+		auto wanted = std::min(static_cast<size_t>(std::distance(first, last)), size);
+		auto position = tail.load(std::memory_order_relaxed);
+		while(wanted > 0) {
+			// the consumer frees slots in order, so the last one being free means all of them are
+			auto lag = static_cast<intptr_t>(slots[(position + wanted - 1) & mask].sequence.load(std::memory_order_acquire)
+					- (position + wanted - 1));
+			if(lag == 0) {
+				if(tail.compare_exchange_weak(position, position + wanted, std::memory_order_relaxed)) {
+					break;
+				}
+			} else if(lag > 0) {
+				position = tail.load(std::memory_order_relaxed);
+			} else {
+				wanted /= 2;
+			}
+		}
+
+		for(size_t i = 0; i < wanted; i++, ++first) {
+			auto& slot = slots[(position + i) & mask];
+			slot.value = std::move(*first);
+			slot.sequence.store(position + i + 1, std::memory_order_release);
+		}
+		return first;
+	}
+
+	// consumer only, hands up to maxCount values to consume in the order they were claimed
+	template<typename Consume>
+	auto popBatch(Consume&& consume, size_t maxCount = SIZE_MAX) -> size_t {
+		size_t count = 0;
+		while(count < maxCount) {
+			auto& slot = slots[head & mask];
+			if(slot.sequence.load(std::memory_order_acquire) != head + 1) {
+				break;
+			}
+
+			// taken out first, consume may push into this very ring
+			auto value = std::move(slot.value);
+			slot.value = T();
+			slot.sequence.store(head + size, std::memory_order_release);
+			head++;
+			count++;
+			consume(std::move(value));
+		}
+		return count;
+	}
+
+	auto capacity() const -> size_t {
+		return size;
+	}
+private:
+	struct Slot {
+		std::atomic<size_t> sequence;
+		T value;
+	};
+
+	size_t size;
+	size_t mask;
+	std::unique_ptr<Slot[]> slots;
+
+	alignas(cacheLineSize) std::atomic<size_t> tail = 0;
+	alignas(cacheLineSize) size_t head = 0;
+};
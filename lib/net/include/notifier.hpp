@@ -0,0 +1,30 @@
+#pragma once
+#include <atomic>
+
+#include "error.hpp"
+
+// Wakes a consumer that waits on descriptor() through poll or epoll. A
+// producer calls notify after publishing to a ring; only the first notify
+// since the consumer last acknowledged writes the eventfd, so a burst of
+// pushes costs one system call. The consumer acknowledges once it is woken
+// and drains afterwards, anything published after the acknowledgement
+// wakes it again.
+class Notifier {
+public:
+	Notifier();
+	~Notifier();
+
+	Notifier(const Notifier&) = delete;
+	auto operator=(const Notifier&) -> Notifier& = delete;
+
+	// notifies made before this wake nobody, whatever they announced is found on the first drain
+	auto open() -> Error;
+	// any thread, after the value it is about to announce was published
+	auto notify() -> void;
+	// consumer only, before draining, whenever descriptor() turned readable
+	auto acknowledge() -> void;
+	auto descriptor() const -> int;
+private:
+	int fd = -1;
+	std::atomic<bool> pending = false;
+};
@@ -0,0 +1,94 @@
+#pragma once
+#include <chrono>
+#include <atomic>
+#include <coroutine>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <unordered_map>
+#include <vector>
+
+#include "error.hpp"
+#include "mpsc_ring.hpp"
+#include "notifier.hpp"
+#include "timer_wheel.hpp"
+
+// Readiness loop over epoll for one thread. Descriptors are watched with a
+// handler that receives the epoll events they became ready for, timers run
+// once their deadline has passed. Everything but post and stop belongs to the
+// loop thread; those two queue work for it on a lock-free ring and wake it
+// through an eventfd, once per batch no matter how many tasks were posted.
+// A ring that is full spills into a locked list, so posting never fails, but
+// tasks are only guaranteed to run in order while the ring has room.
+// Coroutines running on the loop suspend on it with sleep, or on a socket
+// through AsyncTcpSocket.
+class Reactor {
+public:
+	using Clock = TimerWheel::Clock;
+	using Handler = std::function<void(uint32_t events)>;
+	using Callback = std::function<void()>;
+	using TimerId = TimerWheel::Id;
+
+	struct SleepAwaiter {
+		Reactor& reactor;
+		Clock::duration delay;
+
+		auto await_ready() const noexcept -> bool {
+			return delay <= Clock::duration::zero();
+		}
+
+		auto await_suspend(std::coroutine_handle<> handle) -> void {
+			reactor.schedule(delay, [handle]() {
+				handle.resume();
+			});
+		}
+
+		auto await_resume() const noexcept -> void {}
+	};
+
+	Reactor();
+	~Reactor();
+
+	Reactor(const Reactor&) = delete;
+	auto operator=(const Reactor&) -> Reactor& = delete;
+
+	auto open() -> Error;
+	// events are EPOLLIN, EPOLLOUT and friends, level triggered unless they include EPOLLET
+	auto watch(int fd, uint32_t events, Handler handler) -> Error;
+	auto modify(int fd, uint32_t events) -> Error;
+	// safe from within the descriptor's own handler
+	auto unwatch(int fd) -> void;
+	// millisecond resolution, scheduling and cancelling cost the same however many timers are pending
+	auto schedule(Clock::duration delay, Callback task) -> TimerId;
+	auto cancel(TimerId id) -> void;
+	// co_await resumes the coroutine on the loop thread once delay has passed
+	auto sleep(Clock::duration delay) -> SleepAwaiter;
+	// runs task on the loop thread, may be called from any thread
+	auto post(Callback task) -> void;
+	// makes run return once the current round of handlers is done, may be called from any thread
+	auto stop() -> void;
+	// dispatches until stopped
+	auto run() -> Error;
+private:
+	struct Watch {
+		uint32_t generation;
+		// shared so a handler that unwatches its descriptor outlives the call
+		std::shared_ptr<Handler> handler;
+	};
+
+	// false once stopped
+	auto runPosted() -> bool;
+
+	int epollFd = -1;
+	Notifier notifier;
+	// tells an event for a descriptor apart from one for an earlier descriptor with the same number
+	uint32_t generation = 0;
+	std::unordered_map<int, Watch> watches;
+	TimerWheel timers;
+
+	MpscRing<Callback> posted;
+	std::atomic<bool> spilled = false;
+	std::mutex spillMutex;
+	std::vector<Callback> spill;
+	std::atomic<bool> stopping = false;
+};
@@ -0,0 +1,74 @@
+#pragma once
+#include <array>
+#include <cstddef>
+#include <memory_resource>
+
+// Fixed-size blocks for container nodes, packet headers and other small
+// objects that come and go at a high rate. A request is rounded up to a
+// size class and every class keeps a free list per thread, so allocating
+// and freeing touch no lock and no memory another thread is using. A
+// thread whose list runs dry takes a batch from a shared depot or carves a
+// new slab, one whose list grows long hands a batch back, and a thread that
+// exits hands back everything. Any thread may free any block. Slabs are
+// never returned to the system; larger or over-aligned requests go to
+// operator new.
+class SlabPool : public std::pmr::memory_resource {
+public:
+	static constexpr size_t granularity = 16;
+	static constexpr size_t maxBlockSize = 512;
+	static constexpr size_t classCount = maxBlockSize / granularity;
+
+	struct ClassStats {
+		size_t blockSize;
+		size_t allocations;
+		size_t deallocations;
+		// carved from slabs so far, in use or waiting on a free list
+		size_t blocks;
+	};
+
+	struct Stats {
+		std::array<ClassStats, classCount> classes;
+		// requests too large for any class
+		size_t upstreamAllocations;
+		size_t slabBytes;
+	};
+
+	// shared by the whole process
+	static auto instance() -> SlabPool&;
+
+	SlabPool(const SlabPool&) = delete;
+	auto operator=(const SlabPool&) -> SlabPool& = delete;
+
+	// the counters of every thread are read one by one, so the totals may be slightly out of step
+	auto stats() const -> Stats;
+private:
+	SlabPool() = default;
+
+	auto do_allocate(size_t bytes, size_t alignment) -> void* override;
+	auto do_deallocate(void* pointer, size_t bytes, size_t alignment) -> void override;
+	auto do_is_equal(const std::pmr::memory_resource& other) const noexcept -> bool override;
+};
+
+// Stateless allocator on SlabPool::instance() for containers that are not polymorphic.
+template<typename T>
+struct SlabAllocator {
+	using value_type = T;
+
+	SlabAllocator() = default;
+
+	template<typename U>
+	SlabAllocator(const SlabAllocator<U>&) {}
+
+	auto allocate(size_t count) -> T* {
+		return static_cast<T*>(SlabPool::instance().allocate(count * sizeof(T), alignof(T)));
+	}
+
+	auto deallocate(T* pointer, size_t count) -> void {
+		SlabPool::instance().deallocate(pointer, count * sizeof(T), alignof(T));
+	}
+
+	template<typename U>
+	auto operator==(const SlabAllocator<U>&) const -> bool {
+		return true;
+	}
+};
@@ -0,0 +1,89 @@
+#pragma once
+#include <atomic>
+#include <bit>
+#include <vector>
+
+#include "common.hpp"
+
+// Bounded queue between exactly one producing and one consuming thread, with
+// no lock and no read-modify-write on either side. Each side owns one index
+// on a cache line of its own and keeps a copy of the other side's index, so
+// it only touches the other line once the copy says the ring is full or
+// empty. Capacity is rounded up to a power of two.
+template<typename T>
+class SpscRing {
+public:
+	explicit SpscRing(size_t capacity) : slots(std::bit_ceil(std::max<size_t>(capacity, 2))), mask(slots.size() - 1) {}
+
+	SpscRing(const SpscRing&) = delete;
+	auto operator=(const SpscRing&) -> SpscRing& = delete;
+
+	// producer only, value is left untouched if the ring is full
+	auto tryPush(T&& value) -> bool {
+		auto position = tail.load(std::memory_order_relaxed);
+		if(position - cachedHead == slots.size()) {
+			cachedHead = head.load(std::memory_order_acquire);
+			if(position - cachedHead == slots.size()) {
+				return false;
+			}
+		}
+
+		slots[position & mask] = std::move(value);
+		tail.store(position + 1, std::memory_order_release);
+		return true;
+	}
+
+	// producer only, moves as many as fit and publishes them at once, returns the first one left over
+	template<typename Iterator>
+	auto tryPush(Iterator first, Iterator last) -> Iterator {
+		auto position = tail.load(std::memory_order_relaxed);
+		auto wanted = static_cast<size_t>(std::distance(first, last));
+		if(slots.size() - (position - cachedHead) < wanted) {
+			cachedHead = head.load(std::memory_order_acquire);
+		}
+
+		auto count = std::min(wanted, slots.size() - (position - cachedHead));
+		for(size_t i = 0; i < count; i++, ++first) {
+			slots[(position + i) & mask] = std::move(*first);
+		}
+		tail.store(position + count, std::memory_order_release);
+		return first;
+	}
+
+	// consumer only, hands up to maxCount values to consume in order and frees their slots together
+	template<typename Consume>
+	auto popBatch(Consume&& consume, size_t maxCount = SIZE_MAX) -> size_t {
+		auto position = head.load(std::memory_order_relaxed);
+		if(cachedTail == position) {
+			cachedTail = tail.load(std::memory_order_acquire);
+		}
+
+		auto count = std::min(maxCount, cachedTail - position);
+		for(size_t i = 0; i < count; i++) {
+			auto& slot = slots[(position + i) & mask];
+			consume(std::move(slot));
+			// whatever the value still holds is released now rather than when the slot is reused
+			slot = T();
+		}
+		head.store(position + count, std::memory_order_release);
+		return count;
+	}
+
+	// consumer only
+	auto empty() -> bool {
+		return head.load(std::memory_order_relaxed) == tail.load(std::memory_order_acquire);
+	}
+
+	auto capacity() const -> size_t {
+		return slots.size();
+	}
+private:
+	std::vector<T> slots;
+	size_t mask;
+
+	alignas(cacheLineSize) std::atomic<size_t> head = 0;
+	size_t cachedTail = 0;
+
+	alignas(cacheLineSize) std::atomic<size_t> tail = 0;
+	size_t cachedHead = 0;
+};
@@ -0,0 +1,142 @@
+#pragma once
+#include <coroutine>
+#include <exception>
+#include <optional>
+#include <utility>
+
+// Lazily started coroutine that produces a T for whoever co_awaits it. The
+// awaiting coroutine is resumed directly when the task finishes, so a chain
+// of awaits unwinds without growing the stack. Errors are returned the way
+// the rest of the tree returns them, an escaping exception terminates.
+template<typename T = void>
+class Task;
+
+namespace detail {
+
+template<typename T>
+struct TaskResult {
+	auto return_value(T value) -> void {
+		result.emplace(std::move(value));
+	}
+
+	auto take() -> T {
+		return std::move(*result);
+	}
+
+	std::optional<T> result;
+};
+
+template<>
+struct TaskResult<void> {
+	auto return_void() -> void {}
+	auto take() -> void {}
+};
+
+}
+
+template<typename T>
+class Task {
+public:
+	struct promise_type : detail::TaskResult<T> {
+		struct FinalAwaiter {
+			auto await_ready() noexcept -> bool {
+				return false;
+			}
+
+			auto await_suspend(std::coroutine_handle<promise_type> handle) noexcept -> std::coroutine_handle<> {
+				return handle.promise().continuation;
+			}
+
+			auto await_resume() noexcept -> void {}
+		};
+
+		auto get_return_object() -> Task {
+			return Task(std::coroutine_handle<promise_type>::from_promise(*this));
+		}
+
+		auto initial_suspend() noexcept -> std::suspend_always {
+			return {};
+		}
+
+		auto final_suspend() noexcept -> FinalAwaiter {
+			return {};
+		}
+
+		auto unhandled_exception() -> void {
+			std::terminate();
+		}
+
+		std::coroutine_handle<> continuation = std::noop_coroutine();
+	};
+
+	Task(Task&& other) noexcept : handle(std::exchange(other.handle, nullptr)) {}
+
+	auto operator=(Task&& other) noexcept -> Task& {
+		if(this != &other) {
+			if(handle) {
+				handle.destroy();
+			}
+			handle = std::exchange(other.handle, nullptr);
+		}
+		return *this;
+	}
+
+	~Task() {
+		if(handle) {
+			handle.destroy();
+		}
+	}
+
+	auto await_ready() const noexcept -> bool {
+		return false;
+	}
+
+	auto await_suspend(std::coroutine_handle<> caller) noexcept -> std::coroutine_handle<> {
+		handle.promise().continuation = caller;
+		return handle;
+	}
+
+	auto await_resume() -> T {
+		return handle.promise().take();
+	}
+private:
+	explicit Task(std::coroutine_handle<promise_type> handle) : handle(handle) {}
+
+	std::coroutine_handle<promise_type> handle;
+};
+
+namespace detail {
+
+// runs eagerly and frees itself when done, nobody awaits it
+struct Detached {
+	struct promise_type {
+		auto get_return_object() -> Detached {
+			return {};
+		}
+
+		auto initial_suspend() noexcept -> std::suspend_never {
+			return {};
+		}
+
+		auto final_suspend() noexcept -> std::suspend_never {
+			return {};
+		}
+
+		auto return_void() -> void {}
+
+		auto unhandled_exception() -> void {
+			std::terminate();
+		}
+	};
+};
+
+inline auto detach(Task<void> task) -> Detached {
+	co_await task;
+}
+
+}
+
+// starts task right away, it runs on until its first suspension and is finished by whoever resumes it
+inline auto spawn(Task<void> task) -> void {
+	detail::detach(std::move(task));
+}
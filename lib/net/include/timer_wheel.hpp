@@ -0,0 +1,70 @@
+#pragma once
+#include <array>
+#include <chrono>
+#include <cstdint>
+#include <functional>
+#include <optional>
+#include <vector>
+
+// One-shot timers on a hierarchical timing wheel with millisecond ticks.
+// Level 0 has a slot per tick for the next 256 ticks, every level above
+// covers 256 times the span of the one below; a timer sits in the slot its
+// deadline falls into and drops a level each time the wheel below wraps
+// around to it. Adding and cancelling a timer are a linked list insert and
+// unlink, expiring costs one step per slot that holds timers. Deadlines
+// further out than the top level reaches are parked in it and re-filed.
+class TimerWheel {
+public:
+	using Clock = std::chrono::steady_clock;
+	using Callback = std::function<void()>;
+	// never zero, so zero can stand for no timer
+	using Id = uint64_t;
+
+	TimerWheel();
+
+	// a timer never runs before its deadline, at most one tick after it
+	auto add(Clock::time_point deadline, Callback task) -> Id;
+	// ids of timers that ran or were cancelled already are ignored
+	auto cancel(Id id) -> void;
+	// not after the earliest live deadline, and exact once that is less than a wheel turn away
+	auto next() const -> std::optional<Clock::time_point>;
+	// runs every timer whose deadline is not after now, returns how many ran
+	auto expire(Clock::time_point now) -> size_t;
+	auto size() const -> size_t;
+private:
+	static constexpr size_t slotBits = 8;
+	static constexpr size_t slotCount = size_t(1) << slotBits;
+	static constexpr size_t levelCount = 4;
+	static constexpr uint32_t none = ~uint32_t(0);
+
+	struct Node {
+		Callback task;
+		uint64_t deadline;
+		uint32_t previous;
+		uint32_t next;
+		// bumped whenever the node is freed, so stale ids miss
+		uint32_t generation;
+		// level * slotCount + index, none while free
+		uint32_t slot;
+	};
+
+	auto toTick(Clock::time_point time, bool roundUp) const -> uint64_t;
+	auto file(uint32_t index) -> void;
+	auto unlink(uint32_t index) -> void;
+	auto release(uint32_t index) -> void;
+	// first tick that runs timers or cascades them, all ones if the wheel is empty
+	auto nextTick() const -> uint64_t;
+	// moves a slot of a higher level down to where its timers belong now
+	auto cascade(size_t level, size_t index) -> void;
+	// first occupied slot of level at or after index, slotCount if none
+	auto firstOccupied(size_t level, size_t index) const -> size_t;
+
+	Clock::time_point origin;
+	// the next tick to run, every earlier one is done
+	uint64_t current = 0;
+	std::vector<Node> nodes;
+	std::vector<uint32_t> freeNodes;
+	std::array<uint32_t, levelCount * slotCount> heads;
+	std::array<uint64_t, levelCount * slotCount / 64> occupied = {};
+	size_t live = 0;
+};
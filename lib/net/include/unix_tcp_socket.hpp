@@ -0,0 +1,46 @@
+#pragma once
+#include <tuple>
+#include <vector>
+
+#include <sys/uio.h>
+
+#include "common.hpp"
+#include "error.hpp"
+
+class UnixTcpSocket {
+public:
+	static auto create() -> std::tuple<UnixTcpSocket, Error>;
+	static auto fromDescriptor(int fd) -> UnixTcpSocket;
+
+	auto operator==(UnixTcpSocket other) const -> bool;
+	auto operator<(UnixTcpSocket other) const -> bool;
+
+	auto connect(std::string_view address, uint16_t port) -> Error;
+	// a numeric IPv4 address only; a non-blocking socket returns with the handshake under way,
+	// writability tells when it is done and a failure shows on the first read or write
+	auto startConnect(std::string_view ip, uint16_t port) -> Error;
+	auto listen(uint16_t port) -> Error;
+	auto accept() -> std::tuple<UnixTcpSocket, Error>;
+	auto acceptBatch(size_t maxCount) -> std::tuple<std::vector<UnixTcpSocket>, Error>;
+	auto setNonBlocking(bool nonBlocking) -> Error;
+	// caps unsent data the kernel buffers, writes beyond it block until the peer catches up
+	auto setNotSentLowWatermark(size_t bytes) -> Error;
+	auto read(size_t howManyBytes) const -> std::tuple<Bytes, Error>;
+	auto read(Byte* destination, size_t howManyBytes) const -> std::tuple<size_t, Error>;
+	// never takes anything past thisByte from the socket, see BufferedReader for the fast way
+	auto readUntil(Byte thisByte) const -> std::tuple<Bytes, Error>;
+	// a single write, which may take fewer bytes than given
+	auto write(const BytesView bytes) const -> std::tuple<size_t, Error>;
+	// all of bytes, waits for room on a non-blocking socket
+	auto writeAll(BytesView bytes) const -> Error;
+	auto writev(const iovec* vectors, size_t count) const -> std::tuple<size_t, Error>;
+	auto shutdown() const -> void;
+	// bytes written but not yet acknowledged by the peer
+	auto unsentBytes() const -> size_t;
+	// CPU that processed the latest packet received on this socket, -1 if unknown
+	auto incomingCpu() const -> int;
+	auto close() -> void;
+	auto descriptor() const -> int;
+private:
+	int fd;
+};
@@ -12,6 +12,8 @@ public:
 	auto read(size_t howManyBytes) -> std::tuple<Bytes, Error>;
 	auto readUntil(Byte thisByte) -> std::tuple<Bytes, Error>;
 	auto write(const BytesView bytes) -> std::tuple<size_t, Error>;
+	auto close() -> void;
+	auto descriptor() const -> int;
 private:
 	int fd;
 };
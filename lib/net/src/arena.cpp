@@ -0,0 +1,70 @@
+#include "arena.hpp"
+
+#include <algorithm>
+#include <new>
+
+// largest block reset() keeps, relative to the first one
+constexpr size_t keepFactor = 16;
+
+Arena::Arena(size_t initialSize) : keepLimit(initialSize * keepFactor) {
+	grow(initialSize);
+}
+
+Arena::~Arena() {
+	for(auto& block : blocks) {
+		::operator delete(block.data);
+	}
+}
+
+auto Arena::reset() -> void {
+	// a packet that overflowed the first block is likely to come again, so
+	// fold all blocks into one that fits the whole of it, unless it was too big to keep around
+	if(blocks.size() > 1) {
+		size_t total = 0;
+		for(auto& block : blocks) {
+			total += block.size;
+			::operator delete(block.data);
+		}
+		blocks.clear();
+		grow(std::min(total, keepLimit));
+	}
+
+	cursor = blocks.front().data;
+	limit = cursor + blocks.front().size;
+}
+
+auto Arena::upstreamAllocations() const -> size_t {
+	return allocations;
+}
+
+auto Arena::do_allocate(size_t bytes, size_t alignment) -> void* {
+	void* pointer = cursor;
+	size_t space = limit - cursor;
+	if(std::align(alignment, bytes, pointer, space) == nullptr) {
+		grow(std::max(bytes + alignment, blocks.back().size * 2));
+		pointer = cursor;
+		space = limit - cursor;
+		std::align(alignment, bytes, pointer, space);
+	}
+
+	cursor = static_cast<std::byte*>(pointer) + bytes;
+	return pointer;
+}
+
+auto Arena::do_deallocate(void*, size_t, size_t) -> void {
+}
+
+auto Arena::do_is_equal(const std::pmr::memory_resource& other) const noexcept -> bool {
+	return this == &other;
+}
+
+auto Arena::grow(size_t atLeast) -> void {
+	Block block = {
+		.data = static_cast<std::byte*>(::operator new(atLeast)),
+		.size = atLeast,
+	};
+	allocations++;
+	blocks.push_back(block);
+	cursor = block.data;
+	limit = block.data + block.size;
+}
@@ -0,0 +1,247 @@
+#include "async_tcp_socket.hpp"
+
+#include "buffered_reader.hpp"
+
+#include <errno.h>
+#include <sys/epoll.h>
+#include <unistd.h>
+
+constexpr size_t readBlockSize = BufferedReader::defaultBlockSize;
+
+auto AsyncTcpSocket::attach(Reactor& reactor, UnixTcpSocket socket) -> std::tuple<AsyncTcpSocket, Error> {
+	AsyncTcpSocket attached;
+	if(auto err = socket.setNonBlocking(true); err) {
+		return {
+			std::move(attached),
+			err,
+		};
+	}
+
+	attached.state = std::make_unique<State>(State{
+		.reactor = &reactor,
+		.socket = socket,
+		.reader = nullptr,
+		.writer = nullptr,
+		.input = ByteBuffer(readBlockSize),
+	});
+
+	auto state = attached.state.get();
+	auto err = reactor.watch(socket.descriptor(), EPOLLIN | EPOLLOUT | EPOLLRDHUP | EPOLLET, [state](uint32_t events) {
+		std::coroutine_handle<> reader;
+		std::coroutine_handle<> writer;
+		if(events & (EPOLLIN | EPOLLRDHUP | EPOLLHUP | EPOLLERR)) {
+			reader = std::exchange(state->reader, nullptr);
+		}
+		if(events & (EPOLLOUT | EPOLLHUP | EPOLLERR)) {
+			writer = std::exchange(state->writer, nullptr);
+		}
+
+		// the state may be gone once either of them ran
+		if(reader) {
+			reader.resume();
+		}
+		if(writer) {
+			writer.resume();
+		}
+	});
+	if(err) {
+		attached.state.reset();
+	}
+
+	return {
+		std::move(attached),
+		err,
+	};
+}
+
+AsyncTcpSocket::~AsyncTcpSocket() {
+	close();
+}
+
+auto AsyncTcpSocket::operator=(AsyncTcpSocket&& other) -> AsyncTcpSocket& {
+	if(this != &other) {
+		close();
+		state = std::move(other.state);
+	}
+	return *this;
+}
+
+auto AsyncTcpSocket::acceptBatch(size_t maxCount) -> Task<std::tuple<std::vector<UnixTcpSocket>, Error>> {
+	while(true) {
+		auto [clients, err] = state->socket.acceptBatch(maxCount);
+		if(err || !clients.empty()) {
+			co_return {
+				std::move(clients),
+				err,
+			};
+		}
+		co_await Readiness{state.get(), false};
+	}
+}
+
+auto AsyncTcpSocket::read(Byte* destination, size_t howManyBytes) -> Task<std::tuple<size_t, Error>> {
+	// a block or more is not worth copying through the buffer
+	while(state->input.empty() && howManyBytes >= readBlockSize) {
+		auto result = ::read(state->socket.descriptor(), destination, howManyBytes);
+		if(result >= 0) {
+			co_return {
+				result,
+				nullptr,
+			};
+		} else if(errno != EAGAIN && errno != EINTR) {
+			co_return {
+				0,
+				"Reading from socket failed",
+			};
+		} else if(errno == EAGAIN) {
+			co_await Readiness{state.get(), false};
+		}
+	}
+
+	if(state->input.empty()) {
+		auto [count, err] = co_await fill();
+		if(err || count == 0) {
+			co_return {
+				0,
+				err,
+			};
+		}
+	}
+
+	auto available = std::min(howManyBytes, state->input.size());
+	std::memcpy(destination, state->input.readable().data(), available);
+	state->input.consume(available);
+	co_return {
+		available,
+		nullptr,
+	};
+}
+
+auto AsyncTcpSocket::read(size_t howManyBytes) -> Task<std::tuple<Bytes, Error>> {
+	Bytes bytes(howManyBytes);
+	auto [count, err] = co_await read(bytes.data(), bytes.size());
+	if(err) {
+		co_return {
+			{},
+			err,
+		};
+	}
+
+	bytes.resize(count);
+	co_return {
+		std::move(bytes),
+		nullptr,
+	};
+}
+
+auto AsyncTcpSocket::readExact(size_t howManyBytes) -> Task<std::tuple<Bytes, Error>> {
+	Bytes bytes(howManyBytes);
+	size_t offset = 0;
+	while(offset < howManyBytes) {
+		auto [count, err] = co_await read(bytes.data() + offset, howManyBytes - offset);
+		if(err) {
+			co_return {
+				{},
+				err,
+			};
+		} else if(count == 0) {
+			co_return {
+				{},
+				"Connection closed by peer",
+			};
+		}
+		offset += count;
+	}
+
+	co_return {
+		std::move(bytes),
+		nullptr,
+	};
+}
+
+auto AsyncTcpSocket::readUntil(Byte thisByte) -> Task<std::tuple<Bytes, Error>> {
+	size_t scanned = 0;
+	while(true) {
+		auto view = state->input.readable();
+		auto found = static_cast<const Byte*>(std::memchr(view.data() + scanned, thisByte, view.size() - scanned));
+		if(found != nullptr) {
+			auto length = static_cast<size_t>(found - view.data()) + 1;
+			Bytes bytes(view.begin(), view.begin() + length);
+			state->input.consume(length);
+			co_return {
+				std::move(bytes),
+				nullptr,
+			};
+		}
+		scanned = view.size();
+
+		auto [count, err] = co_await fill();
+		if(err) {
+			co_return {
+				{},
+				err,
+			};
+		} else if(count == 0) {
+			co_return {
+				{},
+				"Connection closed by peer",
+			};
+		}
+	}
+}
+
+auto AsyncTcpSocket::write(BytesView bytes) -> Task<std::tuple<size_t, Error>> {
+	size_t written = 0;
+	while(written < bytes.size()) {
+		auto result = ::write(state->socket.descriptor(), bytes.data() + written, bytes.size() - written);
+		if(result >= 0) {
+			written += result;
+		} else if(errno != EAGAIN && errno != EINTR) {
+			co_return {
+				written,
+				"Writing to socket failed",
+			};
+		} else if(errno == EAGAIN) {
+			co_await Readiness{state.get(), true};
+		}
+	}
+
+	co_return {
+		written,
+		nullptr,
+	};
+}
+
+auto AsyncTcpSocket::close() -> void {
+	if(!state) {
+		return;
+	}
+
+	state->reactor->unwatch(state->socket.descriptor());
+	state->socket.close();
+	state.reset();
+}
+
+auto AsyncTcpSocket::fill() -> Task<std::tuple<size_t, Error>> {
+	while(true) {
+		auto result = ::read(state->socket.descriptor(), state->input.prepare(readBlockSize), readBlockSize);
+		if(result >= 0) {
+			state->input.commit(result);
+			co_return {
+				result,
+				nullptr,
+			};
+		} else if(errno != EAGAIN && errno != EINTR) {
+			co_return {
+				0,
+				"Reading from socket failed",
+			};
+		} else if(errno == EAGAIN) {
+			co_await Readiness{state.get(), false};
+		}
+	}
+}
+
+auto AsyncTcpSocket::socket() const -> UnixTcpSocket {
+	return state->socket;
+}
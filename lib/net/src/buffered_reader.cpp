@@ -0,0 +1,181 @@
+#include "buffered_reader.hpp"
+
+#include <optional>
+
+#include <errno.h>
+#include <poll.h>
+#include <string.h>
+#include <unistd.h>
+
+BufferedReader::BufferedReader(UnixTcpSocket socket, size_t blockSize)
+	: connection(socket), input(blockSize), blockSize(blockSize) {}
+
+auto BufferedReader::readExact(Byte* destination, size_t howManyBytes) -> Error {
+	auto available = std::min(howManyBytes, input.size());
+	if(available > 0) {
+		std::memcpy(destination, input.readable().data(), available);
+		input.consume(available);
+		destination += available;
+		howManyBytes -= available;
+	}
+
+	while(howManyBytes > 0) {
+		// a remainder of a block or more goes straight to its destination
+		if(howManyBytes >= blockSize) {
+			auto [count, err] = receive(destination, howManyBytes);
+			if(err) {
+				return err;
+			}
+			destination += count;
+			howManyBytes -= count;
+			continue;
+		}
+
+		auto [count, err] = receive(input.prepare(blockSize), blockSize);
+		if(err) {
+			return err;
+		}
+		input.commit(count);
+
+		auto taken = std::min(howManyBytes, count);
+		std::memcpy(destination, input.readable().data(), taken);
+		input.consume(taken);
+		destination += taken;
+		howManyBytes -= taken;
+	}
+
+	return nullptr;
+}
+
+auto BufferedReader::readExact(size_t howManyBytes) -> std::tuple<Bytes, Error> {
+	Bytes bytes(howManyBytes);
+	if(auto err = readExact(bytes.data(), bytes.size()); err) {
+		return {
+			{},
+			err,
+		};
+	}
+
+	return {
+		std::move(bytes),
+		nullptr,
+	};
+}
+
+auto BufferedReader::readUntil(Byte thisByte) -> std::tuple<Bytes, Error> {
+	size_t scanned = 0;
+	while(true) {
+		auto view = input.readable();
+		auto found = static_cast<const Byte*>(std::memchr(view.data() + scanned, thisByte, view.size() - scanned));
+		if(found != nullptr) {
+			auto length = static_cast<size_t>(found - view.data()) + 1;
+			Bytes bytes(view.begin(), view.begin() + length);
+			input.consume(length);
+			return {
+				std::move(bytes),
+				nullptr,
+			};
+		}
+		scanned = view.size();
+
+		auto chunk = std::max<size_t>(blockSize, 1);
+		auto [count, err] = receive(input.prepare(chunk), chunk);
+		if(err) {
+			return {
+				{},
+				err,
+			};
+		}
+		input.commit(count);
+	}
+}
+
+auto BufferedReader::buffered() const -> BytesView {
+	return input.readable();
+}
+
+auto BufferedReader::consume(size_t count) -> void {
+	input.consume(count);
+}
+
+auto BufferedReader::setBlockSize(size_t bytes) -> void {
+	blockSize = bytes;
+}
+
+auto BufferedReader::interruptBy(int wakeFd, std::chrono::milliseconds grace) -> void {
+	this->wakeFd = wakeFd;
+	this->grace = grace;
+}
+
+auto BufferedReader::socket() const -> UnixTcpSocket {
+	return connection;
+}
+
+auto BufferedReader::receive(Byte* destination, size_t howManyBytes) -> std::tuple<size_t, Error> {
+	// set once the wake descriptor fired
+	std::optional<std::chrono::steady_clock::time_point> deadline;
+
+	while(true) {
+		// a blocking socket is only read once it has something, so the read cannot outlast the deadline
+		if(wakeFd >= 0) {
+			pollfd fds[] = {
+				{
+					.fd = connection.descriptor(),
+					.events = POLLIN,
+				},
+				{
+					.fd = wakeFd,
+					.events = POLLIN,
+				},
+			};
+
+			int timeout = -1;
+			if(deadline) {
+				auto remaining = std::chrono::ceil<std::chrono::milliseconds>(*deadline - std::chrono::steady_clock::now());
+				if(remaining.count() <= 0) {
+					return {
+						0,
+						"Peer went quiet while interrupted",
+					};
+				}
+				timeout = remaining.count();
+			}
+
+			// the wake descriptor stays readable, past the first time only the socket is watched
+			int result = poll(fds, deadline ? 1 : 2, timeout);
+			if(result <= 0) {
+				continue;
+			} else if(fds[0].revents == 0) {
+				deadline = std::chrono::steady_clock::now() + grace;
+				continue;
+			}
+		}
+
+		auto result = ::read(connection.descriptor(), destination, howManyBytes);
+		if(result > 0) {
+			return {
+				result,
+				nullptr,
+			};
+		} else if(result == 0) {
+			return {
+				0,
+				"Connection closed by peer",
+			};
+		} else if(errno == EAGAIN && wakeFd < 0) {
+			pollfd fd = {
+				.fd = connection.descriptor(),
+				.events = POLLIN,
+			};
+			poll(&fd, 1, -1);
+		} else if(errno == EAGAIN) {
+			// the poll at the top waits
+			continue;
+		} else if(errno != EINTR) {
+			return {
+				0,
+				"Reading from socket failed",
+			};
+		}
+	}
+}
@@ -0,0 +1,57 @@
+#include "byte_buffer.hpp"
+
+ByteBuffer::ByteBuffer(size_t capacity) : storage(capacity) {}
+
+auto ByteBuffer::readable() const -> BytesView {
+	return BytesView(storage.data() + begin, end - begin);
+}
+
+auto ByteBuffer::size() const -> size_t {
+	return end - begin;
+}
+
+auto ByteBuffer::empty() const -> bool {
+	return begin == end;
+}
+
+auto ByteBuffer::consume(size_t count) -> void {
+	begin += std::min(count, end - begin);
+	if(begin == end) {
+		begin = 0;
+		end = 0;
+	}
+}
+
+auto ByteBuffer::prepare(size_t count) -> Byte* {
+	if(storage.size() - end >= count) {
+		return storage.data() + end;
+	}
+
+	// moving the unread bytes down is only worth it if they are at most half the buffer
+	if(begin > 0 && (end - begin) * 2 <= storage.size() && storage.size() - (end - begin) >= count) {
+		std::memmove(storage.data(), storage.data() + begin, end - begin);
+		end -= begin;
+		begin = 0;
+		return storage.data() + end;
+	}
+
+	storage.resize(std::max(end + count, storage.size() * 2));
+	return storage.data() + end;
+}
+
+auto ByteBuffer::commit(size_t count) -> void {
+	end = std::min(end + count, storage.size());
+}
+
+auto ByteBuffer::append(BytesView bytes) -> void {
+	if(bytes.size() == 0) {
+		return;
+	}
+	std::memcpy(prepare(bytes.size()), bytes.data(), bytes.size());
+	commit(bytes.size());
+}
+
+auto ByteBuffer::clear() -> void {
+	begin = 0;
+	end = 0;
+}
@@ -0,0 +1,43 @@
+#include "notifier.hpp"
+
+#include <cstdint>
+
+#include <sys/eventfd.h>
+#include <unistd.h>
+
+Notifier::Notifier() {}
+
+Notifier::~Notifier() {
+	if(fd >= 0) {
+		::close(fd);
+	}
+}
+
+auto Notifier::open() -> Error {
+	fd = eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK);
+	if(fd < 0) {
+		return "Could not create wakeup descriptor";
+	}
+	// a notify before open had nothing to write to, the first one after it has to
+	pending.store(false);
+	return nullptr;
+}
+
+auto Notifier::notify() -> void {
+	// sequentially consistent, so either this sees the consumer's acknowledgement
+	// or the consumer's drain that follows it sees what was published before
+	if(!pending.exchange(true)) {
+		uint64_t one = 1;
+		::write(fd, &one, sizeof(one));
+	}
+}
+
+auto Notifier::acknowledge() -> void {
+	uint64_t value;
+	::read(fd, &value, sizeof(value));
+	pending.exchange(false);
+}
+
+auto Notifier::descriptor() const -> int {
+	return fd;
+}
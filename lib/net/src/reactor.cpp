@@ -0,0 +1,183 @@
+#include "reactor.hpp"
+
+#include <array>
+
+#include <errno.h>
+#include <sys/epoll.h>
+#include <unistd.h>
+
+constexpr size_t maxEvents = 64;
+// tasks waiting for the loop before posting spills into the locked list
+constexpr size_t postedCapacity = 4096;
+constexpr uint64_t wakeKey = ~uint64_t(0);
+
+static auto watchKey(int fd, uint32_t generation) -> uint64_t {
+	return static_cast<uint64_t>(generation) << 32 | static_cast<uint32_t>(fd);
+}
+
+Reactor::Reactor() : posted(postedCapacity) {}
+
+Reactor::~Reactor() {
+	if(epollFd >= 0) {
+		::close(epollFd);
+	}
+}
+
+auto Reactor::open() -> Error {
+	epollFd = epoll_create1(EPOLL_CLOEXEC);
+	if(epollFd < 0) {
+		return "Could not create epoll instance";
+	}
+
+	if(auto err = notifier.open(); err) {
+		return err;
+	}
+
+	epoll_event event = {
+		.events = EPOLLIN,
+		.data = {
+			.u64 = wakeKey,
+		},
+	};
+	if(epoll_ctl(epollFd, EPOLL_CTL_ADD, notifier.descriptor(), &event) != 0) {
+		return "Could not watch wakeup descriptor";
+	}
+
+	return nullptr;
+}
+
+auto Reactor::watch(int fd, uint32_t events, Handler handler) -> Error {
+	auto watchGeneration = ++generation;
+	epoll_event event = {
+		.events = events,
+		.data = {
+			.u64 = watchKey(fd, watchGeneration),
+		},
+	};
+	if(epoll_ctl(epollFd, EPOLL_CTL_ADD, fd, &event) != 0) {
+		return "Could not watch descriptor";
+	}
+
+	watches.insert_or_assign(fd, Watch{
+		.generation = watchGeneration,
+		.handler = std::make_shared<Handler>(std::move(handler)),
+	});
+	return nullptr;
+}
+
+auto Reactor::modify(int fd, uint32_t events) -> Error {
+	auto it = watches.find(fd);
+	if(it == watches.end()) {
+		return "Descriptor is not watched";
+	}
+
+	epoll_event event = {
+		.events = events,
+		.data = {
+			.u64 = watchKey(fd, it->second.generation),
+		},
+	};
+	if(epoll_ctl(epollFd, EPOLL_CTL_MOD, fd, &event) != 0) {
+		return "Could not change watched events";
+	}
+	return nullptr;
+}
+
+auto Reactor::unwatch(int fd) -> void {
+	if(watches.erase(fd) > 0) {
+		epoll_ctl(epollFd, EPOLL_CTL_DEL, fd, nullptr);
+	}
+}
+
+auto Reactor::schedule(Clock::duration delay, Callback task) -> TimerId {
+	return timers.add(Clock::now() + delay, std::move(task));
+}
+
+auto Reactor::cancel(TimerId id) -> void {
+	timers.cancel(id);
+}
+
+auto Reactor::sleep(Clock::duration delay) -> SleepAwaiter {
+	return {
+		.reactor = *this,
+		.delay = delay,
+	};
+}
+
+auto Reactor::post(Callback task) -> void {
+	// once anything spilled, later tasks follow it until the loop has caught up
+	if(spilled.load(std::memory_order_acquire) || !posted.tryPush(std::move(task))) {
+		std::lock_guard lock(spillMutex);
+		spill.push_back(std::move(task));
+		spilled.store(true, std::memory_order_release);
+	}
+	notifier.notify();
+}
+
+auto Reactor::stop() -> void {
+	stopping.store(true);
+	notifier.notify();
+}
+
+auto Reactor::run() -> Error {
+	std::array<epoll_event, maxEvents> events;
+
+	while(runPosted()) {
+		int timeout = -1;
+		if(auto deadline = timers.next(); deadline) {
+			auto remaining = std::chrono::ceil<std::chrono::milliseconds>(*deadline - Clock::now());
+			timeout = std::max<int>(remaining.count(), 0);
+		}
+
+		int count = epoll_wait(epollFd, events.data(), events.size(), timeout);
+		if(count < 0) {
+			if(errno == EINTR) {
+				continue;
+			}
+			return "Waiting for events failed";
+		}
+
+		for(int i = 0; i < count; i++) {
+			auto key = events[i].data.u64;
+			if(key == wakeKey) {
+				notifier.acknowledge();
+				continue;
+			}
+
+			// an earlier handler of this round may have unwatched the descriptor
+			auto it = watches.find(static_cast<int>(key & 0xffffffff));
+			if(it == watches.end() || it->second.generation != key >> 32) {
+				continue;
+			}
+
+			auto handler = it->second.handler;
+			(*handler)(events[i].events);
+		}
+
+		timers.expire(Clock::now());
+	}
+
+	return nullptr;
+}
+
+auto Reactor::runPosted() -> bool {
+	bool stopped = stopping.load();
+
+	// no more than a ring's worth, tasks posted from the loop itself wait for the next round
+	posted.popBatch([](Callback&& task) {
+		task();
+	}, posted.capacity());
+
+	if(spilled.load(std::memory_order_acquire)) {
+		std::vector<Callback> tasks;
+		{
+			std::lock_guard lock(spillMutex);
+			tasks.swap(spill);
+			spilled.store(false, std::memory_order_release);
+		}
+		for(auto& task : tasks) {
+			task();
+		}
+	}
+	return !stopped;
+}
@@ -0,0 +1,242 @@
+#include "slab_pool.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <mutex>
+#include <new>
+#include <vector>
+
+constexpr size_t slabSize = 64 * 1024;
+// blocks moved between a thread and the depot at once
+constexpr size_t batchBytes = 8 * 1024;
+constexpr size_t minBatch = 8;
+// a thread keeps at most this many batches of a class before handing one back
+constexpr size_t cachedBatches = 4;
+
+struct FreeBlock {
+	FreeBlock* next;
+};
+
+struct FreeList {
+	FreeBlock* head = nullptr;
+	size_t count = 0;
+};
+
+// written by its own thread only, read by whoever asks for stats
+struct Counter {
+	std::atomic<size_t> value = 0;
+
+	auto add(size_t count) -> void {
+		value.store(value.load(std::memory_order_relaxed) + count, std::memory_order_relaxed);
+	}
+
+	auto get() const -> size_t {
+		return value.load(std::memory_order_relaxed);
+	}
+};
+
+struct ThreadCache;
+
+struct Depot {
+	std::mutex mutex;
+	std::array<std::vector<FreeList>, SlabPool::classCount> batches;
+	std::vector<ThreadCache*> caches;
+	// counters of threads that are gone
+	std::array<size_t, SlabPool::classCount> allocations = {};
+	std::array<size_t, SlabPool::classCount> deallocations = {};
+	size_t upstreamAllocations = 0;
+	std::array<size_t, SlabPool::classCount> blocks = {};
+	size_t slabBytes = 0;
+};
+
+// never destroyed, blocks may be freed by static destructors that run after everything else
+static auto depot() -> Depot& {
+	static Depot* instance = new Depot();
+	return *instance;
+}
+
+static auto blockSize(size_t index) -> size_t {
+	return (index + 1) * SlabPool::granularity;
+}
+
+static auto classOf(size_t bytes) -> size_t {
+	return (std::max<size_t>(bytes, 1) + SlabPool::granularity - 1) / SlabPool::granularity - 1;
+}
+
+static auto batchSize(size_t index) -> size_t {
+	return std::max(minBatch, batchBytes / blockSize(index));
+}
+
+static auto push(FreeList& list, void* pointer) -> void {
+	auto block = static_cast<FreeBlock*>(pointer);
+	block->next = list.head;
+	list.head = block;
+	list.count++;
+}
+
+static auto pop(FreeList& list) -> void* {
+	auto block = list.head;
+	list.head = block->next;
+	list.count--;
+	return block;
+}
+
+// depot must be locked
+static auto refill(Depot& shared, size_t index, FreeList& list) -> void {
+	auto& batches = shared.batches[index];
+	if(!batches.empty()) {
+		list = batches.back();
+		batches.pop_back();
+		return;
+	}
+
+	auto slab = static_cast<std::byte*>(::operator new(slabSize));
+	auto size = blockSize(index);
+	auto count = slabSize / size;
+	for(size_t i = count; i > 0; i--) {
+		push(list, slab + (i - 1) * size);
+	}
+	shared.blocks[index] += count;
+	shared.slabBytes += slabSize;
+}
+
+struct ThreadCache {
+	ThreadCache();
+	~ThreadCache();
+
+	std::array<FreeList, SlabPool::classCount> lists;
+	std::array<Counter, SlabPool::classCount> allocations;
+	std::array<Counter, SlabPool::classCount> deallocations;
+	Counter upstreamAllocations;
+};
+
+static thread_local ThreadCache cache;
+// set once this thread's cache is destroyed, whatever is freed afterwards goes to the depot
+static thread_local bool exited = false;
+
+ThreadCache::ThreadCache() {
+	auto& shared = depot();
+	std::lock_guard lock(shared.mutex);
+	shared.caches.push_back(this);
+}
+
+ThreadCache::~ThreadCache() {
+	auto& shared = depot();
+	std::lock_guard lock(shared.mutex);
+	for(size_t i = 0; i < SlabPool::classCount; i++) {
+		if(lists[i].count > 0) {
+			shared.batches[i].push_back(lists[i]);
+		}
+		shared.allocations[i] += allocations[i].get();
+		shared.deallocations[i] += deallocations[i].get();
+	}
+	shared.upstreamAllocations += upstreamAllocations.get();
+	std::erase(shared.caches, this);
+	exited = true;
+}
+
+auto SlabPool::instance() -> SlabPool& {
+	static SlabPool* pool = new SlabPool();
+	return *pool;
+}
+
+auto SlabPool::stats() const -> Stats {
+	Stats stats = {};
+	auto& shared = depot();
+	std::lock_guard lock(shared.mutex);
+	for(size_t i = 0; i < classCount; i++) {
+		auto& entry = stats.classes[i];
+		entry.blockSize = blockSize(i);
+		entry.allocations = shared.allocations[i];
+		entry.deallocations = shared.deallocations[i];
+		entry.blocks = shared.blocks[i];
+		for(auto other : shared.caches) {
+			entry.allocations += other->allocations[i].get();
+			entry.deallocations += other->deallocations[i].get();
+		}
+	}
+
+	stats.upstreamAllocations = shared.upstreamAllocations;
+	for(auto other : shared.caches) {
+		stats.upstreamAllocations += other->upstreamAllocations.get();
+	}
+	stats.slabBytes = shared.slabBytes;
+	return stats;
+}
+
+auto SlabPool::do_allocate(size_t bytes, size_t alignment) -> void* {
+	if(bytes > maxBlockSize || alignment > granularity) {
+		if(!exited) {
+			cache.upstreamAllocations.add(1);
+		}
+		return std::pmr::new_delete_resource()->allocate(bytes, alignment);
+	}
+
+	auto index = classOf(bytes);
+	if(exited) {
+		auto& shared = depot();
+		std::lock_guard lock(shared.mutex);
+		FreeList list;
+		refill(shared, index, list);
+		auto pointer = pop(list);
+		if(list.count > 0) {
+			shared.batches[index].push_back(list);
+		}
+		return pointer;
+	}
+
+	auto& list = cache.lists[index];
+	if(list.head == nullptr) {
+		auto& shared = depot();
+		std::lock_guard lock(shared.mutex);
+		refill(shared, index, list);
+	}
+	cache.allocations[index].add(1);
+	return pop(list);
+}
+
+auto SlabPool::do_deallocate(void* pointer, size_t bytes, size_t alignment) -> void {
+	if(bytes > maxBlockSize || alignment > granularity) {
+		std::pmr::new_delete_resource()->deallocate(pointer, bytes, alignment);
+		return;
+	}
+
+	auto index = classOf(bytes);
+	if(exited) {
+		FreeList list;
+		push(list, pointer);
+		auto& shared = depot();
+		std::lock_guard lock(shared.mutex);
+		shared.batches[index].push_back(list);
+		return;
+	}
+
+	auto& list = cache.lists[index];
+	push(list, pointer);
+	cache.deallocations[index].add(1);
+
+	auto batch = batchSize(index);
+	if(list.count < batch * cachedBatches) {
+		return;
+	}
+
+	FreeList spilled = {
+		.head = list.head,
+		.count = batch,
+	};
+	auto last = list.head;
+	for(size_t i = 1; i < batch; i++) {
+		last = last->next;
+	}
+	list.head = last->next;
+	list.count -= batch;
+	last->next = nullptr;
+
+	auto& shared = depot();
+	std::lock_guard lock(shared.mutex);
+	shared.batches[index].push_back(spilled);
+}
+
+auto SlabPool::do_is_equal(const std::pmr::memory_resource& other) const noexcept -> bool {
+	return this == &other;
+}
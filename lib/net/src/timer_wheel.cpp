@@ -0,0 +1,216 @@
+#include "timer_wheel.hpp"
+
+#include <algorithm>
+#include <bit>
+
+constexpr uint64_t slotMask = 255;
+
+TimerWheel::TimerWheel() : origin(Clock::now()) {
+	heads.fill(none);
+}
+
+auto TimerWheel::add(Clock::time_point deadline, Callback task) -> Id {
+	uint32_t index;
+	if(!freeNodes.empty()) {
+		index = freeNodes.back();
+		freeNodes.pop_back();
+	} else {
+		index = nodes.size();
+		nodes.push_back({
+			.task = nullptr,
+			.deadline = 0,
+			.previous = none,
+			.next = none,
+			.generation = 1,
+			.slot = none,
+		});
+	}
+
+	auto& node = nodes[index];
+	node.task = std::move(task);
+	node.deadline = std::max(toTick(deadline, true), current);
+	file(index);
+	live++;
+	return static_cast<Id>(node.generation) << 32 | index;
+}
+
+auto TimerWheel::cancel(Id id) -> void {
+	auto index = static_cast<uint32_t>(id);
+	if(index >= nodes.size() || nodes[index].generation != id >> 32 || nodes[index].slot == none) {
+		return;
+	}
+
+	unlink(index);
+	release(index);
+}
+
+auto TimerWheel::next() const -> std::optional<Clock::time_point> {
+	auto tick = nextTick();
+	if(tick == ~uint64_t(0)) {
+		return std::nullopt;
+	}
+	return origin + std::chrono::milliseconds(tick);
+}
+
+auto TimerWheel::expire(Clock::time_point now) -> size_t {
+	auto target = toTick(now, false);
+	size_t count = 0;
+
+	while(current <= target) {
+		// ticks in which nothing runs or cascades are skipped
+		auto upcoming = nextTick();
+		if(upcoming > target) {
+			current = target + 1;
+			break;
+		}
+		current = upcoming;
+
+		auto index = current & slotMask;
+		if(index == 0) {
+			// higher levels wrap first, so what they pass down is cascaded again in the same tick
+			size_t top = 1;
+			while(top + 1 < levelCount && ((current >> (slotBits * top)) & slotMask) == 0) {
+				top++;
+			}
+			for(size_t level = top; level > 0; level--) {
+				cascade(level, (current >> (slotBits * level)) & slotMask);
+			}
+		}
+
+		// a task may add timers to the very slot that is running, they run in this pass
+		while(heads[index] != none) {
+			auto node = heads[index];
+			unlink(node);
+			auto task = std::move(nodes[node].task);
+			release(node);
+			task();
+			count++;
+		}
+		current++;
+	}
+
+	return count;
+}
+
+auto TimerWheel::size() const -> size_t {
+	return live;
+}
+
+auto TimerWheel::toTick(Clock::time_point time, bool roundUp) const -> uint64_t {
+	if(time <= origin) {
+		return 0;
+	}
+
+	auto elapsed = time - origin;
+	auto ticks = roundUp ? std::chrono::ceil<std::chrono::milliseconds>(elapsed)
+		: std::chrono::floor<std::chrono::milliseconds>(elapsed);
+	return ticks.count();
+}
+
+auto TimerWheel::file(uint32_t index) -> void {
+	auto& node = nodes[index];
+	auto delta = node.deadline > current ? node.deadline - current : 0;
+
+	size_t level = 0;
+	while(level + 1 < levelCount && delta >= uint64_t(1) << (slotBits * (level + 1))) {
+		level++;
+	}
+
+	// beyond the top level's reach the timer waits in its furthest slot
+	auto reach = (uint64_t(1) << (slotBits * levelCount)) - 1;
+	auto tick = current + std::min(delta, reach);
+	auto slot = static_cast<uint32_t>(level * slotCount + ((tick >> (slotBits * level)) & slotMask));
+
+	node.slot = slot;
+	node.previous = none;
+	node.next = heads[slot];
+	if(node.next != none) {
+		nodes[node.next].previous = index;
+	}
+	heads[slot] = index;
+	occupied[slot / 64] |= uint64_t(1) << (slot % 64);
+}
+
+auto TimerWheel::unlink(uint32_t index) -> void {
+	auto& node = nodes[index];
+	if(node.previous != none) {
+		nodes[node.previous].next = node.next;
+	} else {
+		heads[node.slot] = node.next;
+	}
+	if(node.next != none) {
+		nodes[node.next].previous = node.previous;
+	}
+
+	if(heads[node.slot] == none) {
+		occupied[node.slot / 64] &= ~(uint64_t(1) << (node.slot % 64));
+	}
+	node.slot = none;
+}
+
+auto TimerWheel::release(uint32_t index) -> void {
+	auto& node = nodes[index];
+	node.task = nullptr;
+	if(++node.generation == 0) {
+		node.generation = 1;
+	}
+	freeNodes.push_back(index);
+	live--;
+}
+
+auto TimerWheel::nextTick() const -> uint64_t {
+	auto earliest = ~uint64_t(0);
+	if(live == 0) {
+		return earliest;
+	}
+
+	for(size_t level = 0; level < levelCount; level++) {
+		auto shift = slotBits * level;
+		auto index = (current >> shift) & slotMask;
+		// a higher slot at the current index was cascaded already, unless the turn below starts right now
+		auto start = index;
+		if(level > 0 && (current & ((uint64_t(1) << shift) - 1)) != 0) {
+			start++;
+		}
+
+		uint64_t distance;
+		if(auto slot = start < slotCount ? firstOccupied(level, start) : slotCount; slot != slotCount) {
+			distance = slot - index;
+		} else if(slot = firstOccupied(level, 0); slot != slotCount) {
+			distance = slot + slotCount - index;
+		} else {
+			continue;
+		}
+
+		earliest = std::min(earliest, ((current >> shift) + distance) << shift);
+	}
+
+	return earliest;
+}
+
+auto TimerWheel::cascade(size_t level, size_t index) -> void {
+	auto slot = level * slotCount + index;
+	auto node = heads[slot];
+	heads[slot] = none;
+	occupied[slot / 64] &= ~(uint64_t(1) << (slot % 64));
+
+	while(node != none) {
+		auto next = nodes[node].next;
+		file(node);
+		node = next;
+	}
+}
+
+auto TimerWheel::firstOccupied(size_t level, size_t index) const -> size_t {
+	auto words = occupied.data() + level * slotCount / 64;
+	for(size_t word = index / 64; word < slotCount / 64; word++) {
+		auto bits = words[word];
+		if(word == index / 64) {
+			bits &= ~uint64_t(0) << (index % 64);
+		}
+		if(bits != 0) {
+			return word * 64 + std::countr_zero(bits);
+		}
+	}
+	return slotCount;
+}
@@ -0,0 +1,349 @@
+#include "unix_tcp_socket.hpp"
+
+#include "unix_dns_lookup.hpp"
+
+#include <array>
+
+#include <arpa/inet.h>
+#include <netdb.h>
+#include <netinet/tcp.h>
+#include <poll.h>
+#include <linux/sockios.h>
+#include <sys/ioctl.h>
+#include <sys/socket.h>
+#include <unistd.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <string.h>
+
+auto UnixTcpSocket::create() -> std::tuple<UnixTcpSocket, Error> {
+	UnixTcpSocket tcpSocket;
+	tcpSocket.fd = socket(AF_INET, SOCK_STREAM, 0);
+	if(tcpSocket.fd < 0) {
+		return {
+			tcpSocket,
+			"Could not create socket",
+		};
+	}
+
+	return {
+		tcpSocket, 
+		nullptr,
+	};
+}
+
+auto UnixTcpSocket::fromDescriptor(int fd) -> UnixTcpSocket {
+	UnixTcpSocket tcpSocket;
+	tcpSocket.fd = fd;
+	return tcpSocket;
+}
+
+auto UnixTcpSocket::operator==(UnixTcpSocket other) const -> bool {
+	return fd == other.fd;
+}
+
+auto UnixTcpSocket::operator<(UnixTcpSocket other) const -> bool {
+	return fd < other.fd;
+}
+
+auto UnixTcpSocket::connect(std::string_view address, uint16_t port) -> Error {
+	sockaddr_in hint;
+	hint.sin_family = AF_INET;
+	hint.sin_port = htons(port);
+
+	auto [addresses, err] = dnsLookup(address, port);
+	if(err) {
+		return err;
+	}
+
+	for(const std::string& ip : addresses) {
+		inet_pton(AF_INET, ip.c_str(), &hint.sin_addr);
+
+		const auto hintAsParam = reinterpret_cast<const sockaddr*>(&hint);
+		int result = ::connect(fd, hintAsParam, sizeof hint);
+		if(result >= 0) {
+			return nullptr;
+		}	
+	}
+
+	return "Could not connect to address/port combination";
+}
+
+auto UnixTcpSocket::startConnect(std::string_view ip, uint16_t port) -> Error {
+	sockaddr_in hint = {};
+	hint.sin_family = AF_INET;
+	hint.sin_port = htons(port);
+	if(inet_pton(AF_INET, std::string(ip).c_str(), &hint.sin_addr) != 1) {
+		return "Not an IPv4 address";
+	}
+
+	int result = ::connect(fd, reinterpret_cast<const sockaddr*>(&hint), sizeof hint);
+	if(result < 0 && errno != EINPROGRESS) {
+		return "Could not connect to address/port combination";
+	}
+
+	return nullptr;
+}
+
+auto UnixTcpSocket::listen(uint16_t port) -> Error {
+	
+	sockaddr_in hint;
+	hint.sin_family = AF_INET;
+	hint.sin_port = htons(port);
+	hint.sin_addr.s_addr = INADDR_ANY;
+
+	int opt = 1;
+
+	if (setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &opt, sizeof(opt)) < 0) {
+		return "Failed to set SO_REUSEADDR option";
+	}
+
+	if (setsockopt(fd, SOL_SOCKET, SO_REUSEPORT, &opt, sizeof(opt)) < 0) {
+		return "Error setting SO_REUSEPORT option";
+	}
+
+	int result = ::bind(fd, reinterpret_cast<const sockaddr*>(&hint), sizeof hint);
+	if(result != 0) {
+		return "Error binding port";
+	}
+
+	result = ::listen(fd, 256);
+
+	if(result != 0) {
+		return "Could not set socket into listening state";
+	}
+
+	return nullptr;
+}
+
+auto UnixTcpSocket::accept() -> std::tuple<UnixTcpSocket, Error> {
+
+	int cfd = ::accept(fd, nullptr, nullptr);
+	if(cfd == -1) {
+		return {
+			UnixTcpSocket(),
+			"Failed to accept incoming connection",
+		};
+	}
+
+	UnixTcpSocket client;
+	client.fd = cfd;
+
+	return {
+		client,
+		nullptr,
+	};
+}
+
+auto UnixTcpSocket::acceptBatch(size_t maxCount) -> std::tuple<std::vector<UnixTcpSocket>, Error> {
+	std::vector<UnixTcpSocket> clients;
+
+	// drains the backlog of a non-blocking listener, accepted sockets stay blocking
+	while(clients.size() < maxCount) {
+		int cfd = ::accept4(fd, nullptr, nullptr, SOCK_CLOEXEC);
+		if(cfd == -1) {
+			if(errno == EINTR || errno == ECONNABORTED) {
+				continue;
+			} else if(errno == EAGAIN || errno == EWOULDBLOCK) {
+				break;
+			}
+
+			return {
+				clients,
+				"Failed to accept incoming connection",
+			};
+		}
+
+		clients.push_back(fromDescriptor(cfd));
+	}
+
+	return {
+		clients,
+		nullptr,
+	};
+}
+
+auto UnixTcpSocket::setNonBlocking(bool nonBlocking) -> Error {
+	int flags = fcntl(fd, F_GETFL, 0);
+	if(flags < 0) {
+		return "Could not read socket flags";
+	}
+
+	flags = nonBlocking ? (flags | O_NONBLOCK) : (flags & ~O_NONBLOCK);
+	if(fcntl(fd, F_SETFL, flags) < 0) {
+		return "Could not set socket flags";
+	}
+
+	return nullptr;
+}
+
+auto UnixTcpSocket::incomingCpu() const -> int {
+	int cpu = -1;
+	socklen_t length = sizeof(cpu);
+	if(getsockopt(fd, SOL_SOCKET, SO_INCOMING_CPU, &cpu, &length) != 0) {
+		return -1;
+	}
+
+	return cpu;
+}
+
+auto UnixTcpSocket::setNotSentLowWatermark(size_t bytes) -> Error {
+	int value = static_cast<int>(bytes);
+	if(setsockopt(fd, IPPROTO_TCP, TCP_NOTSENT_LOWAT, &value, sizeof(value)) != 0) {
+		return "Could not set unsent low watermark";
+	}
+
+	return nullptr;
+}
+
+auto UnixTcpSocket::read(size_t howManyBytes) const -> std::tuple<Bytes, Error> {
+	Bytes bytes(howManyBytes);
+	auto [count, err] = read(bytes.data(), bytes.size());
+	if(err) {
+		return {
+			{},
+			err,
+		};
+	}
+
+	// a short read must not pass for a full one
+	bytes.resize(count);
+	return {
+		bytes,
+		nullptr,
+	};
+}
+
+auto UnixTcpSocket::read(Byte* destination, size_t howManyBytes) const -> std::tuple<size_t, Error> {
+	ssize_t result;
+	do {
+		result = ::read(fd, destination, howManyBytes);
+	} while(result < 0 && errno == EINTR);
+
+	if(result < 0) {
+		return {
+			0,
+			"Reading from socket failed",
+		};
+	}
+	return {
+		result,
+		nullptr,
+	};
+}
+
+auto UnixTcpSocket::readUntil(Byte thisByte) const -> std::tuple<Bytes, Error> {
+	Bytes bytes;
+	std::array<Byte, 512> peeked;
+
+	// nothing past thisByte may be taken from the socket, so each round peeks
+	// at what has arrived and then reads exactly up to thisByte or all of it
+	while(true) {
+		auto result = ::recv(fd, peeked.data(), peeked.size(), MSG_PEEK);
+		if(result < 0 && errno == EINTR) {
+			continue;
+		} else if(result < 0) {
+			return {
+				{},
+				"Reading from socket failed",
+			};
+		} else if(result == 0) {
+			return {
+				{},
+				"Connection closed by peer",
+			};
+		}
+
+		auto found = static_cast<const Byte*>(std::memchr(peeked.data(), thisByte, result));
+		size_t length = found != nullptr ? found - peeked.data() + 1 : result;
+
+		auto offset = bytes.size();
+		bytes.resize(offset + length);
+		auto [count, err] = read(bytes.data() + offset, length);
+		if(err) {
+			return {
+				{},
+				err,
+			};
+		}
+
+		if(found != nullptr) {
+			return {
+				bytes,
+				nullptr,
+			};
+		}
+	}
+}
+
+auto UnixTcpSocket::write(const BytesView bytes) const -> std::tuple<size_t, Error> {
+	auto result = ::write(fd, bytes.data(), bytes.size());
+	if(result < 0) {
+		return {
+			0,
+			"Writing to socket failed",
+		};
+	}
+	return {
+		result,
+		nullptr,
+	};
+}
+
+auto UnixTcpSocket::writeAll(BytesView bytes) const -> Error {
+	size_t offset = 0;
+	while(offset < bytes.size()) {
+		auto result = ::write(fd, bytes.data() + offset, bytes.size() - offset);
+		if(result >= 0) {
+			offset += result;
+		} else if(errno == EAGAIN) {
+			pollfd writable = {
+				.fd = fd,
+				.events = POLLOUT,
+			};
+			poll(&writable, 1, -1);
+		} else if(errno != EINTR) {
+			return "Writing to socket failed";
+		}
+	}
+
+	return nullptr;
+}
+
+auto UnixTcpSocket::writev(const iovec* vectors, size_t count) const -> std::tuple<size_t, Error> {
+	ssize_t result;
+	do {
+		result = ::writev(fd, vectors, count);
+	} while(result < 0 && errno == EINTR);
+
+	if(result < 0) {
+		return {
+			0,
+			"Writing to socket failed",
+		};
+	}
+	return {
+		result,
+		nullptr,
+	};
+}
+
+auto UnixTcpSocket::shutdown() const -> void {
+	::shutdown(fd, SHUT_RDWR);
+}
+
+auto UnixTcpSocket::close() -> void {
+	::close(fd);
+}
+
+auto UnixTcpSocket::unsentBytes() const -> size_t {
+	int value = 0;
+	if(ioctl(fd, SIOCOUTQ, &value) != 0 || value < 0) {
+		return 0;
+	}
+	return value;
+}
+
+auto UnixTcpSocket::descriptor() const -> int {
+	return fd;
+}
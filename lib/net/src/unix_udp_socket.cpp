@@ -102,3 +102,11 @@ auto UnixUdpSocket::write(const BytesView bytes) -> std::tuple<size_t, Error> {
 		nullptr,
 	};
 }
+
+auto UnixUdpSocket::close() -> void {
+	::close(fd);
+}
+
+auto UnixUdpSocket::descriptor() const -> int {
+	return fd;
+}
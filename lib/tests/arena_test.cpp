@@ -0,0 +1,140 @@
+#include "arena.hpp"
+#include "buffered_reader.hpp"
+#include "mqtt.hpp"
+#include "unix_tcp_socket.hpp"
+
+#include <iostream>
+#include <string_view>
+#include <vector>
+
+#include <sys/socket.h>
+#include <unistd.h>
+
+// Every check prints what failed and the test exits non-zero.
+static int failures = 0;
+
+static auto check(bool condition, const char* what) -> void {
+	if(!condition) {
+		std::cerr << "FAILED: " << what << '\n';
+		failures++;
+	}
+}
+
+// a connection's reader fed one packet at a time, as the broker's client threads read it
+struct Stream {
+	int fds[2] = {-1, -1};
+	BufferedReader reader;
+
+	Stream() : reader(open(fds)) {
+	}
+
+	~Stream() {
+		::close(fds[0]);
+		::close(fds[1]);
+	}
+
+	static auto open(int (&fds)[2]) -> UnixTcpSocket {
+		socketpair(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0, fds);
+		return UnixTcpSocket::fromDescriptor(fds[0]);
+	}
+
+	// decodes the next packet into arena after resetting it, the way every packet is handled
+	auto roundTrip(const Bytes& packet, Arena& arena) -> bool {
+		::write(fds[1], packet.data(), packet.size());
+		arena.reset();
+		auto [message, bytes, err] = Mqtt::decode(reader, &arena);
+		return !err;
+	}
+};
+
+static auto publish(std::string_view topic, size_t payloadLength) -> Bytes {
+	Mqtt::Message message = {
+		.type = Mqtt::Publish,
+		.level = Mqtt::Lv1,
+		.duplicate = false,
+		.retain = false,
+	};
+	auto& header = message.content.emplace<Mqtt::PublishHeader>();
+	header.topic = topic;
+	header.payload.assign(payloadLength, 'x');
+	header.id = 7;
+	return Mqtt::encode(message);
+}
+
+static auto subscribe(std::string_view filter) -> Bytes {
+	Mqtt::Message message = {
+		.type = Mqtt::Subscribe,
+		.level = Mqtt::Lv1,
+		.duplicate = false,
+		.retain = false,
+	};
+	auto& header = message.content.emplace<Mqtt::SubscribeHeader>();
+	header.topics.emplace_back(filter);
+	header.levels.push_back(Mqtt::Lv1);
+	header.id = 9;
+	return Mqtt::encode(message);
+}
+
+// a mix of packet types and sizes, the largest of which overflows the first block
+static auto traffic() -> std::vector<Bytes> {
+	std::vector<Bytes> packets;
+	for(size_t size : {0, 16, 200, 1500, 6000, 20'000, 64}) {
+		packets.push_back(publish("sensors/building-7/floor-3/room-12/temperature", size));
+	}
+	packets.push_back(subscribe("sensors/+/floor-3/#"));
+	return packets;
+}
+
+// once every packet size has been seen, decoding more of them never goes back to the heap
+static auto warmedUpStaysOffTheHeap() -> void {
+	Stream stream;
+	Arena arena;
+	auto packets = traffic();
+	bool decoded = true;
+
+	for(size_t round = 0; round < 2; round++) {
+		for(auto& packet : packets) {
+			decoded &= stream.roundTrip(packet, arena);
+		}
+	}
+
+	size_t warm = arena.upstreamAllocations();
+	for(size_t round = 0; round < 1000; round++) {
+		for(auto& packet : packets) {
+			decoded &= stream.roundTrip(packet, arena);
+		}
+	}
+
+	check(decoded, "every packet of the stream decodes");
+	check(arena.upstreamAllocations() == warm, "no upstream allocation after warm-up");
+}
+
+// a packet far beyond the cap is served, but the arena does not keep a block that size
+static auto oversizedIsNotKept() -> void {
+	Stream stream;
+	Arena arena;
+	auto small = publish("a/b", 100);
+	auto huge = publish("a/b", 150'000);
+
+	// the reset after the first one folds its blocks, which is an allocation of its own
+	bool decoded = stream.roundTrip(small, arena) && stream.roundTrip(huge, arena) && stream.roundTrip(huge, arena);
+	size_t before = arena.upstreamAllocations();
+	decoded &= stream.roundTrip(huge, arena);
+	check(decoded, "a packet beyond the cap decodes");
+	check(arena.upstreamAllocations() > before, "a packet beyond the cap allocates again rather than stay pinned");
+
+	for(size_t i = 0; i < 10; i++) {
+		decoded &= stream.roundTrip(small, arena);
+	}
+	before = arena.upstreamAllocations();
+	for(size_t i = 0; i < 100; i++) {
+		decoded &= stream.roundTrip(small, arena);
+	}
+	check(decoded && arena.upstreamAllocations() == before, "small packets settle back to no allocations");
+}
+
+auto main() -> int {
+	warmedUpStaysOffTheHeap();
+	oversizedIsNotKept();
+	return failures == 0 ? 0 : 1;
+}
@@ -0,0 +1,166 @@
+#include "mqtt_client.hpp"
+#include "unix_tcp_socket.hpp"
+
+#include <atomic>
+#include <cstdlib>
+#include <chrono>
+#include <iostream>
+#include <string>
+#include <thread>
+
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+// Every check prints what failed and the test exits non-zero.
+static int failures = 0;
+
+static auto check(bool condition, const char* what) -> void {
+	if(!condition) {
+		std::cerr << "FAILED: " << what << '\n';
+		failures++;
+	}
+}
+
+// accepts one connection, answers its CONNECT and swallows everything after it
+struct SinkBroker {
+	UnixTcpSocket listener;
+	uint16_t port = 0;
+	std::thread thread;
+
+	SinkBroker() {
+		auto [socket, err] = UnixTcpSocket::create();
+		validate(err);
+		listener = socket;
+		validate(listener.listen(0));
+
+		sockaddr_in address = {};
+		socklen_t length = sizeof address;
+		getsockname(listener.descriptor(), reinterpret_cast<sockaddr*>(&address), &length);
+		port = ntohs(address.sin_port);
+
+		thread = std::thread([this]() {
+			auto [client, err] = listener.accept();
+			validate(err);
+
+			Byte buffer[64 * 1024];
+			auto [count, readErr] = client.read(buffer, sizeof buffer);
+			if(!readErr && count > 0) {
+				const Byte connack[] = {0x20, 0x02, 0x00, 0x00};
+				client.writeAll(BytesView(connack, sizeof connack));
+			}
+			while(true) {
+				auto [count, readErr] = client.read(buffer, sizeof buffer);
+				if(readErr || count == 0) {
+					break;
+				}
+			}
+			client.close();
+		});
+	}
+
+	~SinkBroker() {
+		thread.join();
+		listener.close();
+	}
+};
+
+// a burst many times flushBytes used to stall after the first flush until something arrived
+static auto burstBeyondFlushBytes() -> void {
+	SinkBroker broker;
+	MqttClient client({
+		.address = "127.0.0.1",
+		.port = broker.port,
+		.identifier = "burst",
+		.flushBytes = 16 * 1024,
+	});
+
+	constexpr size_t count = 1000;
+	std::atomic<size_t> completed = 0;
+	std::string payload(1000, 'x');
+	for(size_t i = 0; i < count; i++) {
+		validate(client.publish("burst/topic", payload, Mqtt::Lv0, false, [&completed](Error err) {
+			if(!err) {
+				completed++;
+			}
+		}));
+	}
+
+	std::thread loop([&client]() {
+		client.run();
+	});
+
+	auto start = std::chrono::steady_clock::now();
+	while(completed < count && std::chrono::steady_clock::now() - start < std::chrono::seconds(3)) {
+		std::this_thread::sleep_for(std::chrono::milliseconds(1));
+	}
+	check(completed == count, "every publish of a burst beyond flushBytes completes");
+
+	client.stop();
+	loop.join();
+}
+
+// a listener whose accept queue is full drops further SYNs, so a connect to it never completes
+struct FullBacklog {
+	int listener = -1;
+	int filler = -1;
+	uint16_t port = 0;
+
+	FullBacklog() {
+		sockaddr_in address = {};
+		address.sin_family = AF_INET;
+		address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+		socklen_t length = sizeof address;
+
+		listener = socket(AF_INET, SOCK_STREAM | SOCK_CLOEXEC, 0);
+		bind(listener, reinterpret_cast<sockaddr*>(&address), sizeof address);
+		listen(listener, 0);
+		getsockname(listener, reinterpret_cast<sockaddr*>(&address), &length);
+		port = ntohs(address.sin_port);
+
+		filler = socket(AF_INET, SOCK_STREAM | SOCK_CLOEXEC, 0);
+		::connect(filler, reinterpret_cast<sockaddr*>(&address), sizeof address);
+	}
+
+	~FullBacklog() {
+		close(filler);
+		close(listener);
+	}
+};
+
+// the loop keeps serving while a connect hangs, stop() gets through to it
+static auto stopWhileConnecting() -> void {
+	FullBacklog backlog;
+	MqttClient client({
+		.address = "127.0.0.1",
+		.port = backlog.port,
+		.identifier = "stuck",
+	});
+
+	std::atomic<bool> returned = false;
+	std::thread loop([&client, &returned]() {
+		client.run();
+		returned = true;
+	});
+
+	std::this_thread::sleep_for(std::chrono::milliseconds(200));
+	client.stop();
+	auto start = std::chrono::steady_clock::now();
+	while(!returned && std::chrono::steady_clock::now() - start < std::chrono::seconds(2)) {
+		std::this_thread::sleep_for(std::chrono::milliseconds(1));
+	}
+
+	if(!returned) {
+		// the loop thread is stuck in the kernel, there is no clean way out of here
+		std::cerr << "FAILED: a connect that does not complete leaves the loop responsive\n";
+		std::_Exit(1);
+	}
+	loop.join();
+}
+
+auto main() -> int {
+	burstBeyondFlushBytes();
+	stopWhileConnecting();
+	return failures == 0 ? 0 : 1;
+}
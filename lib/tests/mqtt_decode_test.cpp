@@ -0,0 +1,125 @@
+#include "buffered_reader.hpp"
+#include "mqtt.hpp"
+#include "unix_tcp_socket.hpp"
+
+#include <algorithm>
+#include <iostream>
+#include <memory_resource>
+#include <string_view>
+
+#include <sys/socket.h>
+#include <unistd.h>
+
+// Every check prints what failed and the test exits non-zero.
+static int failures = 0;
+
+static auto check(bool condition, const char* what) -> void {
+	if(!condition) {
+		std::cerr << "FAILED: " << what << '\n';
+		failures++;
+	}
+}
+
+// remembers the largest single allocation made through it
+struct LargestAllocation : std::pmr::memory_resource {
+	size_t largest = 0;
+
+	auto do_allocate(size_t bytes, size_t alignment) -> void* override {
+		largest = std::max(largest, bytes);
+		return std::pmr::new_delete_resource()->allocate(bytes, alignment);
+	}
+
+	auto do_deallocate(void* pointer, size_t bytes, size_t alignment) -> void override {
+		std::pmr::new_delete_resource()->deallocate(pointer, bytes, alignment);
+	}
+
+	auto do_is_equal(const std::pmr::memory_resource& other) const noexcept -> bool override {
+		return this == &other;
+	}
+};
+
+// a reader over one end of a socket pair with bytes already written to the other,
+// which stays open so a decode that reads too far blocks instead of failing
+struct Feed {
+	int fds[2] = {-1, -1};
+	BufferedReader reader;
+
+	Feed(BytesView bytes) : reader(open(fds)) {
+		::write(fds[1], bytes.data(), bytes.size());
+	}
+
+	~Feed() {
+		::close(fds[0]);
+		::close(fds[1]);
+	}
+
+	static auto open(int (&fds)[2]) -> UnixTcpSocket {
+		socketpair(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0, fds);
+		return UnixTcpSocket::fromDescriptor(fds[0]);
+	}
+};
+
+// a PUBLISH to topic t whose remaining length claims payloadLength more bytes than follow
+static auto publishHeader(size_t payloadLength) -> Bytes {
+	size_t remaining = 3 + payloadLength;
+	Bytes bytes = {0x30};
+	do {
+		Byte byte = remaining % 128;
+		remaining /= 128;
+		bytes.push_back(remaining > 0 ? byte | 128 : byte);
+	} while(remaining > 0);
+
+	for(Byte byte : {Byte(0x00), Byte(0x01), Byte('t')}) {
+		bytes.push_back(byte);
+	}
+	return bytes;
+}
+
+static auto oversizedIsRefusedBeforeAllocating() -> void {
+	Feed feed(publishHeader(200 * 1024 * 1024));
+	LargestAllocation resource;
+
+	auto [message, bytes, err] = Mqtt::decode(feed.reader, &resource, 0, 1024 * 1024);
+	check(err && err.string() == "Packet exceeds the maximum size",
+		"a packet over the limit is refused");
+	check(resource.largest < 64, "nothing is allocated for the body of a refused packet");
+}
+
+static auto withinLimitDecodes() -> void {
+	auto packet = publishHeader(5);
+	for(char c : std::string_view("hello")) {
+		packet.push_back(c);
+	}
+	Feed feed(BytesView(packet.data(), packet.size()));
+
+	auto [message, bytes, err] = Mqtt::decode(feed.reader, std::pmr::get_default_resource(), 0, packet.size());
+	auto publish = std::get_if<Mqtt::PublishHeader>(&message.content);
+	check(!err, "a packet of exactly the limit decodes");
+	check(publish != nullptr && publish->topic == "t", "its topic survives the decode");
+}
+
+// a streamed payload stays in the socket, the limit only applies to what is read
+static auto streamedPayloadIsExempt() -> void {
+	Feed feed(publishHeader(4096));
+
+	auto [message, bytes, err] = Mqtt::decode(feed.reader, std::pmr::get_default_resource(), 1024, 64);
+	auto publish = std::get_if<Mqtt::PublishHeader>(&message.content);
+	check(!err, "a streamed publish over the limit decodes its header");
+	check(publish != nullptr && publish->pendingPayload == 4096, "its payload is left pending");
+}
+
+static auto emptyTopicIsRefused() -> void {
+	const Byte packet[] = {0x30, 0x03, 0x00, 0x00, 'x'};
+	Feed feed(BytesView(packet, sizeof packet));
+
+	auto [message, bytes, err] = Mqtt::decode(feed.reader);
+	check(err && err.string() == "Topic is empty", "a publish with a zero-length topic is a protocol error");
+}
+
+auto main() -> int {
+	oversizedIsRefusedBeforeAllocating();
+	withinLimitDecodes();
+	streamedPayloadIsExempt();
+	emptyTopicIsRefused();
+	return failures == 0 ? 0 : 1;
+}
@@ -0,0 +1,102 @@
+#include "reactor.hpp"
+
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <iostream>
+#include <thread>
+#include <vector>
+
+#include <sys/epoll.h>
+#include <unistd.h>
+
+// Every check prints what failed and the test exits non-zero.
+static int failures = 0;
+
+static auto check(bool condition, const char* what) -> void {
+	if(!condition) {
+		std::cerr << "FAILED: " << what << '\n';
+		failures++;
+	}
+}
+
+// a task posted before open used to leave the wakeup flag set, so later posts never woke the loop
+static auto postBeforeOpen() -> void {
+	Reactor reactor;
+	bool early = false;
+	reactor.post([&early]() {
+		early = true;
+	});
+	validate(reactor.open());
+
+	// with no timers the loop sleeps until a descriptor wakes it, this one only if the check failed
+	int rescue[2];
+	check(pipe(rescue) == 0, "pipe for the rescue wakeup");
+	validate(reactor.watch(rescue[0], EPOLLIN, [](uint32_t events) {}));
+
+	std::thread loop([&reactor]() {
+		validate(reactor.run());
+	});
+	std::this_thread::sleep_for(std::chrono::milliseconds(100));
+
+	std::atomic<bool> late = false;
+	auto posted = std::chrono::steady_clock::now();
+	reactor.post([&late]() {
+		late = true;
+	});
+	while(!late && std::chrono::steady_clock::now() - posted < std::chrono::seconds(2)) {
+		std::this_thread::sleep_for(std::chrono::milliseconds(1));
+	}
+	check(late, "task posted from another thread wakes the loop");
+
+	reactor.stop();
+	if(!late) {
+		Byte byte = 0;
+		check(write(rescue[1], &byte, 1) == 1, "rescue wakeup");
+	}
+	loop.join();
+	close(rescue[0]);
+	close(rescue[1]);
+	check(early, "task posted before open runs");
+}
+
+// tasks from several threads all run, also once the ring is full and they spill
+static auto postFromManyThreads() -> void {
+	Reactor reactor;
+	validate(reactor.open());
+
+	constexpr size_t threads = 4;
+	constexpr size_t perThread = 100000;
+	std::array<size_t, threads> counts = {};
+
+	std::vector<std::thread> producers;
+	for(size_t t = 0; t < threads; t++) {
+		producers.emplace_back([&, t]() {
+			for(size_t i = 0; i < perThread; i++) {
+				reactor.post([&counts, t]() {
+					counts[t]++;
+				});
+			}
+		});
+	}
+	std::thread closer([&]() {
+		for(auto& producer : producers) {
+			producer.join();
+		}
+		reactor.post([&reactor]() {
+			reactor.stop();
+		});
+	});
+
+	validate(reactor.run());
+	closer.join();
+	for(size_t t = 0; t < threads; t++) {
+		check(counts[t] == perThread, "every posted task runs");
+	}
+}
+
+auto main() -> int {
+	postBeforeOpen();
+	postFromManyThreads();
+	return failures == 0 ? 0 : 1;
+}
@@ -0,0 +1,147 @@
+#include "timer_wheel.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <functional>
+#include <iostream>
+#include <random>
+#include <vector>
+
+using namespace std::chrono;
+
+// Every check prints what failed and the test exits non-zero.
+static int failures = 0;
+
+static auto check(bool condition, const char* what) -> void {
+	if(!condition) {
+		std::cerr << "FAILED: " << what << '\n';
+		failures++;
+	}
+}
+
+// every timer ever added, the wheel's callbacks mark them as they run
+struct ModelTimer {
+	TimerWheel::Clock::time_point deadline;
+	TimerWheel::Id id = 0;
+	bool ran = false;
+	bool cancelled = false;
+};
+
+// random adds, cancels, re-arms from inside callbacks and clock jumps of
+// up to several months, checked against a brute-force walk over every timer
+static auto matchesBruteForce() -> void {
+	TimerWheel wheel;
+	std::mt19937_64 rng(42);
+	std::vector<ModelTimer> timers;
+	auto now = TimerWheel::Clock::now();
+	size_t early = 0;
+	size_t late = 0;
+	size_t twice = 0;
+	size_t afterCancel = 0;
+
+	// from within a tick to beyond what the top level reaches
+	auto delay = [&rng]() -> milliseconds {
+		switch(rng() % 6) {
+			case 0:
+				return milliseconds(rng() % 5);
+			case 1:
+				return milliseconds(rng() % 300);
+			case 2:
+				return milliseconds(rng() % 70'000);
+			case 3:
+				return milliseconds(rng() % 20'000'000);
+			case 4:
+				return milliseconds(rng() % 6'000'000'000);
+			default:
+				return milliseconds(rng() % 1000);
+		}
+	};
+
+	std::function<void(TimerWheel::Clock::time_point)> arm = [&](TimerWheel::Clock::time_point deadline) {
+		size_t index = timers.size();
+		timers.push_back({
+			.deadline = deadline,
+		});
+		timers[index].id = wheel.add(deadline, [&, index]() {
+			auto& timer = timers[index];
+			early += now < timer.deadline;
+			twice += timer.ran;
+			afterCancel += timer.cancelled;
+			timer.ran = true;
+			if(rng() % 4 == 0) {
+				arm(now + delay());
+			}
+		});
+	};
+
+	for(size_t round = 0; round < 50'000; round++) {
+		auto operation = rng() % 10;
+		if(operation < 5) {
+			arm(now + delay() + microseconds(rng() % 1000));
+		} else if(operation < 7 && !timers.empty()) {
+			auto& timer = timers[rng() % timers.size()];
+			timer.cancelled = !timer.ran;
+			wheel.cancel(timer.id);
+		} else {
+			auto target = now + (rng() % 50 == 0 ? delay() * 3 : milliseconds(rng() % 40));
+			// the reactor sleeps until next() and expires from there
+			while(auto next = wheel.next()) {
+				if(*next > target) {
+					break;
+				}
+				now = std::max(now, *next);
+				wheel.expire(now);
+				if(auto after = wheel.next(); after && *after <= now) {
+					now += milliseconds(1);
+				}
+			}
+			now = target;
+			wheel.expire(now);
+
+			for(auto& timer : timers) {
+				if(!timer.ran && !timer.cancelled && now >= timer.deadline + milliseconds(2)) {
+					late++;
+					timer.cancelled = true;
+				}
+			}
+		}
+	}
+
+	size_t pending = std::count_if(timers.begin(), timers.end(), [](const auto& timer) {
+		return !timer.ran && !timer.cancelled;
+	});
+
+	check(early == 0, "no timer runs before its deadline");
+	check(late == 0, "every timer runs within a tick of its deadline");
+	check(twice == 0, "no timer runs twice");
+	check(afterCancel == 0, "no cancelled timer runs");
+	check(wheel.size() == pending, "size counts the timers still pending");
+}
+
+// ids stay unique per node, one that ran already must not cancel its successor
+static auto staleIdsMiss() -> void {
+	TimerWheel wheel;
+	auto now = TimerWheel::Clock::now();
+	bool first = false;
+	bool second = false;
+
+	auto id = wheel.add(now + milliseconds(5), [&first]() {
+		first = true;
+	});
+	wheel.expire(now + milliseconds(10));
+	check(first, "timer runs once its deadline passed");
+
+	wheel.add(now + milliseconds(20), [&second]() {
+		second = true;
+	});
+	wheel.cancel(id);
+	wheel.expire(now + milliseconds(30));
+	check(second, "cancelling a stale id leaves the node's new timer alone");
+	check(wheel.size() == 0, "wheel is empty once everything ran");
+}
+
+auto main() -> int {
+	matchesBruteForce();
+	staleIdsMiss();
+	return failures == 0 ? 0 : 1;
+}
@@ -1,4 +0,0 @@
-#pragma once
-
-class TcpSocket {
-};
@@ -1,55 +1,9 @@
 #include <iostream>
 #include <iomanip>
-#include <map>
+#include <thread>
 
-#include "boilerplate.hpp"
-#include "coap.hpp"
-#include "unix_udp_socket.hpp"
-
-auto get(const std::string& uri) -> std::string {
-	static uint32_t id = 0;
-	auto [socket, err] = UnixUdpSocket::create();
-	validate(err);
-	err = socket.connect("127.0.0.1", 5683);
-	validate(err);
-
-	auto message = Coap::Message {
-		.type = Coap::Type::Confirmable,
-		.code = Coap::Code::Get,
-		.id = id++,
-		.tokens = {},
-		.options = {
-			{
-				.string = uri,
-				.type = Coap::OptionType::UriPath,
-			}
-		},
-		.payload = {},
-	};
-
-	auto bytes = Coap::encode(message);
-	uint32_t len;
-
-	std::tie(len, err) = socket.write(bytes);
-	validate(err);
-	std::tie(bytes, err) = socket.read(1024);
-	validate(err);
-
-	auto [response, decodeError] = Coap::decode(bytes);
-	validate(decodeError);
-
-	auto view = std::string(response.payload.begin(),
-			response.payload.end());
-	return view;
-}
-
-auto getCpu() -> std::string {
-	return get("cpu");
-}
-
-auto getMem() -> std::string {
-	return get("mem");
-}
+#include "coap_client.hpp"
+#include "mqtt_client.hpp"
 
 int main(int argc, char** argv) {
     if (argc != 3) {
@@ -57,25 +11,46 @@ int main(int argc, char** argv) {
         return -1;
     }
 
-	MqttClient::setAddressAndPort(argv[1], argv[2]);
+	MqttClient client({
+		.address = argv[1],
+		.port = static_cast<uint16_t>(std::stoi(argv[2])),
+		.identifier = "coap-mqtt-bridge",
+	});
+
+	// lost datagrams are retransmitted on the CoAP client's own thread, the MQTT one never waits
+	CoapClient coap({
+		.address = "127.0.0.1",
+		.port = 5683,
+	});
+	validate(coap.open());
+	auto coapThread = std::thread([&]() {
+		validate(coap.run());
+	});
+	coapThread.detach();
+
+	// answers the request with the resource of the same name
+	auto forward = [&](std::string resource) {
+		coap.get(resource, [&, resource](const Coap::Message& response, Error err) {
+			if(err) {
+				std::cerr << "CoAP " << resource << ": " << err << '\n';
+				return;
+			}
+
+			auto payload = std::string(response.payload.begin(), response.payload.end());
+			validate(client.publish("res/" + resource, payload));
+		});
+	};
 
-	MqttClient::publishHandler = [](const std::string& topic) {
+	client.onPublish([&](std::string_view topic, std::string_view payload) {
 		std::cout << "Publish to topic: " << topic << '\n';
-		MqttClient::PublishResponse response;
-		response.send = false;
 		if(topic == "req/cpu") {
-			std::cerr << "Fredde moment\n";
-			response.send = true;
-			response.topic = "res/cpu";
-			response.response = getCpu();
+			forward("cpu");
 		} else if(topic == "req/mem") {
-			response.send = true;
-			response.topic = "res/mem";
-			response.response = getMem();
+			forward("mem");
 		}
-		std::cerr << "Sending response...\n";
-		return response;
-	};
+	});
 
-	MqttClient::serve();
+	validate(client.subscribe("req/mem"));
+	validate(client.subscribe("req/cpu"));
+	client.run();
 }
@@ -1 +0,0 @@
-#include "socket.hpp"
@@ -1,10 +1,13 @@
 #pragma once
 
-#include "tcp_socket.hpp"
+#include "async_tcp_socket.hpp"
+#include "task.hpp"
+#include "unix_tcp_socket.hpp"
 
 #include <functional>
 #include <string>
 #include <string_view>
+#include <tuple>
 #include <unordered_map>
 
 struct Http {
@@ -23,16 +26,17 @@ struct Http {
 		auto setMethod(std::string_view view) -> void;
 	};
 
-	static auto parseMessage(TcpSocket client) -> Result<Message>;
+	static auto parseMessage(UnixTcpSocket client) -> std::tuple<Message, Error>;
+	static auto readMessage(AsyncTcpSocket& client) -> Task<std::tuple<Message, Error>>;
 
 	class Server {
 	public:
-		using Handler = std::function<void(const Message& request, TcpSocket client)>;
-		auto listen() -> Result<void>;
+		using Handler = std::function<void(const Message& request, UnixTcpSocket client)>;
+		auto listen() -> Error;
 		auto endpoint(std::string_view path, Handler callback) -> void;
 		auto fallbackEndpoint(Handler callback) -> void;
 	private:
-		auto handleClient(TcpSocket client) -> void;
+		auto handleClient(UnixTcpSocket client) -> void;
 		std::unordered_map<std::string, Handler> handlers;
 		Handler fallbackHandler;
 	};
@@ -1,13 +1,15 @@
 #pragma once
 
-#include "result.hpp"
-#include "tcp_socket.hpp"
-#include "utils.hpp"
+#include "async_tcp_socket.hpp"
+#include "reactor.hpp"
+#include "slab_pool.hpp"
+#include "task.hpp"
 
 #include <cstdint>
+#include <memory>
 #include <set>
 #include <thread>
-#include <mutex>
+#include <tuple>
 #include <vector>
 
 struct ws {
@@ -22,25 +24,46 @@ struct ws {
 			Pong = 0xA,
 		};
 
-		std::vector<Byte> payload;
+		// control frames and most messages fit a slab block
+		std::vector<Byte, SlabAllocator<Byte>> payload;
 		Opcode op;
 		bool fin;
 	};
 
-	static auto decode(TcpSocket client) -> Result<Frame>;
+	static auto decode(AsyncTcpSocket& client) -> Task<std::tuple<Frame, Error>>;
 	static auto encode(const Frame& frame) -> std::vector<Byte>;
 
+	// Serves every client from one thread: the handshake and the frames of a
+	// client are read by a coroutine of its own, all on the server's reactor.
+	// Each client is pinged on a timer and dropped if it stays silent until
+	// the next one is due.
 	class Server {
 	public:
-		auto listen(uint16_t port) -> Result<void>;
+		~Server();
+		auto listen(uint16_t port) -> Error;
+		// may be called from any thread
 		auto sendToAll(std::string_view message) -> void;
 	private:
-		auto listenThread() -> void;
-		auto handleClient(TcpSocket client) -> void;
-		TcpSocket socket;
+		struct Client {
+			AsyncTcpSocket socket;
+			// frames waiting for the one coroutine that writes to this client
+			Bytes outgoing;
+			bool sending = false;
+			// anything arrived since the last ping
+			bool answered = true;
+		};
+
+		auto acceptClients() -> Task<>;
+		auto handleClient(std::shared_ptr<Client> client) -> Task<>;
+		auto sendQueued(std::shared_ptr<Client> client) -> Task<>;
+		auto queue(const std::shared_ptr<Client>& client, BytesView bytes) -> void;
+		auto heartbeat(std::weak_ptr<Client> client) -> void;
 
-		std::set<TcpSocket> clients;
-		std::mutex clientsMutex;
+		Reactor reactor;
+		AsyncTcpSocket listener;
+		// touched by the reactor thread only, walked for every message sent to all
+		std::set<std::shared_ptr<Client>, std::less<std::shared_ptr<Client>>, SlabAllocator<std::shared_ptr<Client>>> clients;
+		std::thread thread;
 	};
 
 };
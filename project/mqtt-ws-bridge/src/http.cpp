@@ -14,69 +14,105 @@ auto Http::Message::setMethod(std::string_view view) -> void {
 	}
 }
 
-auto Http::parseMessage(TcpSocket client) -> Result<Message> {
-	Result<Message> result;
-	auto protocol = client.readUntil('\n');
+// a line without its line break, empty if reading failed
+static auto toLine(std::tuple<Bytes, Error> read) -> std::string {
+	auto& [line, err] = read;
+	if(err || line.empty()) {
+		return std::string();
+	}
+	return std::string(line.begin(), line.end() - 1);
+}
 
-	auto pathBegin = protocol.value.find(' ');
-	auto pathEnd = protocol.value.find_last_of(' ');
+static auto parseRequestLine(const std::string& protocol, Http::Message& message) -> Error {
+	auto pathBegin = protocol.find(' ');
+	auto pathEnd = protocol.find_last_of(' ');
 	if(pathBegin == -1) {
-		return result.set("No protocol found in header");
+		return "No protocol found in header";
 	}
 
-	auto method = std::string_view(protocol.value.begin(),
-			protocol.value.begin() + pathBegin);
+	auto method = std::string_view(protocol.begin(),
+			protocol.begin() + pathBegin);
 
-	auto path = std::string_view(protocol.value.begin() + pathBegin + 1,
-			protocol.value.begin() + pathEnd);
+	auto path = std::string_view(protocol.begin() + pathBegin + 1,
+			protocol.begin() + pathEnd);
 
-	result.value.setMethod(method);
-	result.value.path = path;
+	message.setMethod(method);
+	message.path = path;
+	return nullptr;
+}
 
-	while(true) {
-		auto header = client.readUntil('\n');
-		auto split = header.value.find(':');
-		if(split == -1 || header.value.empty()) {
-			break;
-		}
+// false once the headers are over
+static auto parseHeader(std::string header, Http::Message& message) -> bool {
+	auto split = header.find(':');
+	if(split == -1 || header.empty()) {
+		return false;
+	}
 
-		if(header.value.back() == '\r') {
-			header.value.pop_back();
-		}
+	if(header.back() == '\r') {
+		header.pop_back();
+	}
 
-		auto key = std::string_view(header.value.begin(), header.value.begin() + split);
+	auto key = std::string_view(header.begin(), header.begin() + split);
+	split++;
+	while(!std::isgraph(header[split])) {
 		split++;
-		while(!std::isgraph(header.value[split])) {
-			split++;
-		}
-		auto value = std::string_view(header.value.begin() + split, header.value.end());
+	}
+	auto value = std::string_view(header.begin() + split, header.end());
 
-		result.value.headers.emplace(key, value);
+	message.headers.emplace(key, value);
+	return true;
+}
+
+auto Http::parseMessage(UnixTcpSocket client) -> std::tuple<Message, Error> {
+	Message message;
+	if(auto err = parseRequestLine(toLine(client.readUntil('\n')), message); err) {
+		return {
+			message,
+			err,
+		};
+	}
+
+	while(parseHeader(toLine(client.readUntil('\n')), message)) {}
+
+	return {
+		message,
+		nullptr,
+	};
+}
+
+auto Http::readMessage(AsyncTcpSocket& client) -> Task<std::tuple<Message, Error>> {
+	Message message;
+	if(auto err = parseRequestLine(toLine(co_await client.readUntil('\n')), message); err) {
+		co_return {
+			message,
+			err,
+		};
 	}
 
-	return result;
+	while(parseHeader(toLine(co_await client.readUntil('\n')), message)) {}
+
+	co_return {
+		message,
+		nullptr,
+	};
 }
 
-auto Http::Server::listen() -> Result<void> {
-	Result<void> toReturn;
-	auto result = TcpSocket::create();
-	
-	if(result.fail()) {
-		return toReturn.set(result.reason());
+auto Http::Server::listen() -> Error {
+	auto [socket, err] = UnixTcpSocket::create();
+	if(err) {
+		return err;
 	}
 
-	auto socket = result.value;
-	auto voidRes = socket.listen(3500);
-	if(voidRes.fail()) {
-		return toReturn.set(voidRes.reason());
+	if(err = socket.listen(3500); err) {
+		return err;
 	}
 
 	while(true) {
-		auto client = socket.accept();
-		if(client.fail()) {
-			std::cerr << client.reason() << '\n';
+		auto [client, err] = socket.accept();
+		if(err) {
+			std::cerr << err << '\n';
 		} else {
-			handleClient(client.value);
+			handleClient(client);
 		}
 	}
 }
@@ -88,17 +124,14 @@ auto Http::Server::fallbackEndpoint(Handler callback) -> void {
 	fallbackHandler = callback;
 }
 
-auto Http::Server::handleClient(TcpSocket client) -> void {
-	auto result = parseMessage(client);
-	if(result.fail()) {
-		std::cerr << result.reason() << '\n';
+auto Http::Server::handleClient(UnixTcpSocket client) -> void {
+	auto [message, err] = parseMessage(client);
+	if(err) {
+		std::cerr << err << '\n';
 		client.close();
 		return;
 	}
 
-
-	auto message = std::move(result.value);
-
 	auto handler = handlers.find(message.path);
 	if(handler != handlers.end()) {
 		handler->second(message, client);
@@ -1,7 +1,9 @@
 #include "websocket.hpp"
 
-#include "boilerplate.hpp"
+#include "mqtt_client.hpp"
+#include "reactor.hpp"
 
+#include <functional>
 #include <iostream>
 #include <thread>
 
@@ -11,18 +13,28 @@ auto main(int argc, char** argv) -> int {
         return -1;
     }
 
-	MqttClient::setAddressAndPort(argv[1], argv[2]);
+	MqttClient client({
+		.address = argv[1],
+		.port = static_cast<uint16_t>(std::stoi(argv[2])),
+		.identifier = "mqtt-ws-bridge",
+	});
 	ws::Server server;
-	server.listen(8001);
-
-	float cpu = 0.f;
-	float mem = 0.f;
-	bool justGotCpu = false;
-	bool justGotMem = false;
-	auto askedForCpu = std::chrono::high_resolution_clock::now();
-	auto askedForMem = std::chrono::high_resolution_clock::now();
-	auto recievedCpu = std::chrono::high_resolution_clock::now();
-	auto recievedMem = std::chrono::high_resolution_clock::now();
+	validate(server.listen(8001));
+
+	// requests, answers and their timeouts are all handled on this thread's reactor
+	Reactor loop;
+	validate(loop.open());
+
+	// one round asks for both values and waits for both answers
+	struct Probe {
+		float value = 0.f;
+		Reactor::Clock::time_point asked;
+		Reactor::Clock::time_point received;
+		bool answered = false;
+	};
+	Probe cpu;
+	Probe mem;
+	Reactor::TimerId timeout = 0;
 
 	auto sendWsMessage = [&](float cpu, float mem, float rtt) {
 		std::string message;
@@ -37,72 +49,72 @@ auto main(int argc, char** argv) -> int {
 		server.sendToAll(message);
 	};
 
-	MqttClient::publishHandler = [&](const std::string& topic, const std::string& content) {
-		std::cout << "Publish to topic: " << topic << '\n';
-		MqttClient::PublishResponse response;
-		response.send = false;
-		if(topic == "res/cpu") {
-			recievedCpu = std::chrono::high_resolution_clock::now();
-			cpu = std::stof(content);
-			justGotCpu = true;
-
-		} else if(topic == "res/mem") {
-			recievedMem = std::chrono::high_resolution_clock::now();
-			mem = std::stof(content);
-			justGotMem = true;
-		}
+	std::function<void()> request = [&]() {
+		using namespace std::chrono_literals;
 
-		std::cerr << "Sending response...\n";
-		return response;
+		cpu.answered = false;
+		mem.answered = false;
+
+		// both requests leave in the same write, each is timed from when it was written
+		std::cerr << "Sending publishes to req/cpu and req/mem\n";
+		validate(client.publish("req/cpu", " ", Mqtt::Lv0, false, [&](Error err) {
+			loop.post([&, now = Reactor::Clock::now()]() {
+				cpu.asked = now;
+			});
+		}));
+		validate(client.publish("req/mem", " ", Mqtt::Lv0, false, [&](Error err) {
+			loop.post([&, now = Reactor::Clock::now()]() {
+				mem.asked = now;
+			});
+		}));
+
+		timeout = loop.schedule(5s, [&]() {
+			std::cerr << "No response to req/cpu and req/mem\n";
+			request();
+		});
 	};
 
-	auto mqttThread = std::thread(MqttClient::serve);
-	mqttThread.detach();
-
-	while(true) {
+	auto answer = [&](Probe& probe, float value, Reactor::Clock::time_point now) {
 		using namespace std::chrono_literals;
-		float rtt = 0.f;
-
-		auto askForCpu = std::thread([&]() {
-			justGotCpu = false;
-			askedForCpu = std::chrono::high_resolution_clock::now();
-			std::cerr << "Sending publish to req/cpu\n";
-			MqttClient::lock.lock();
-			MqttClient::c->publish("req/cpu", " ");
-			MqttClient::lock.unlock();
-			MqttClient::c->publish("req/cpu", " ");
-			std::cerr << "Publish sent!\n";
-			while(!justGotCpu) {
-				std::this_thread::sleep_for(1s);
-			}
-			
-			auto diff = recievedCpu - askedForCpu;
-			auto diffAsMs = std::chrono::duration_cast<std::chrono::milliseconds>(diff).count();
-			std::cerr << "(CPU) Time Difference: " << diffAsMs << '\n';
-			rtt += diffAsMs;
-		});
 
-		askForCpu.join();
-
-		auto askForMem = std::thread([&]() {
-			justGotMem = false;
-			askedForMem = std::chrono::high_resolution_clock::now();
-			std::cerr << "Sending publish to req/mem\n";
-			MqttClient::c->publish("req/mem", " "); 
-			while(!justGotMem) {
-				std::this_thread::sleep_for(1s);
-			}
-			
-			auto diff = recievedMem - askedForMem;
-			auto diffAsMs = std::chrono::duration_cast<std::chrono::milliseconds>(diff).count();
-			std::cerr << "(MEM) Time Difference: " << diffAsMs << '\n';
-			rtt += diffAsMs;
-		});
+		probe.value = value;
+		probe.received = now;
+		probe.answered = true;
+		if(!cpu.answered || !mem.answered) {
+			return;
+		}
+		loop.cancel(timeout);
 
-		askForMem.join();
+		auto cpuDiff = std::chrono::duration_cast<std::chrono::milliseconds>(cpu.received - cpu.asked).count();
+		auto memDiff = std::chrono::duration_cast<std::chrono::milliseconds>(mem.received - mem.asked).count();
+		std::cerr << "(CPU) Time Difference: " << cpuDiff << '\n';
+		std::cerr << "(MEM) Time Difference: " << memDiff << '\n';
+		float rtt = (cpuDiff + memDiff) / 2.f;
 
-		sendWsMessage(cpu, mem, rtt / 2.f);
+		sendWsMessage(cpu.value, mem.value, rtt);
+		timeout = loop.schedule(1s, request);
+	};
+
+	// the handler runs on the client's thread and hands the answer over to the loop
+	client.onPublish([&](std::string_view topic, std::string_view content) {
+		std::cout << "Publish to topic: " << topic << '\n';
+		auto now = Reactor::Clock::now();
+		if(topic == "res/cpu") {
+			loop.post([&, value = std::stof(std::string(content)), now]() {
+				answer(cpu, value, now);
+			});
+		} else if(topic == "res/mem") {
+			loop.post([&, value = std::stof(std::string(content)), now]() {
+				answer(mem, value, now);
+			});
+		}
+	});
+
+	validate(client.subscribe("res/mem"));
+	validate(client.subscribe("res/cpu"));
+	auto mqttThread = std::thread(&MqttClient::run, &client);
+	mqttThread.detach();
 
-		std::this_thread::sleep_for(1s);
-	}
+	loop.post(request);
+	validate(loop.run());
 }
@@ -1,3 +0,0 @@
-#include "result_base.hpp"
-
-thread_local std::string ResultBase::error;
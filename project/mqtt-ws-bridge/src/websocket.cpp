@@ -7,21 +7,24 @@
 #include <bitset>
 #include <iostream>
 
-auto ws::decode(TcpSocket client) -> Result<Frame> {
-	Result<Frame> result;
-	
-	auto readHeader = client.readBytes(2);
-	if(readHeader.fail()) {
-		return result.set(readHeader.reason());
-	}
+constexpr auto heartbeatInterval = std::chrono::seconds(30);
 
-	auto header = std::move(readHeader.value);
+auto ws::decode(AsyncTcpSocket& client) -> Task<std::tuple<Frame, Error>> {
+	Frame frame;
+
+	auto [header, err] = co_await client.readExact(2);
+	if(err) {
+		co_return {
+			frame,
+			err,
+		};
+	}
 
 	auto b0 = header[0];
 	auto b1 = header[1];
 
-	result.value.fin = (b0 & 0x1);
-	result.value.op = static_cast<Frame::Opcode>(b0 & 0x0F);
+	frame.fin = (b0 & 0x1);
+	frame.op = static_cast<Frame::Opcode>(b0 & 0x0F);
 
 	bool hasMask = b1 & 0x80;
 
@@ -31,27 +34,33 @@ auto ws::decode(TcpSocket client) -> Result<Frame> {
 	}
 
 	if(payloadLength == 126) {
-		auto readExtendedLength = client.readBytes(2);
-		if(readExtendedLength.fail()) {
-			return result.set(readExtendedLength.reason());
+		auto [extended, err] = co_await client.readExact(2);
+		if(err) {
+			co_return {
+				frame,
+				err,
+			};
 		}
 
-		uint32_t extendedLength = readExtendedLength.value[1];
-		extendedLength += readExtendedLength.value[0] << 8;
+		uint32_t extendedLength = extended[1];
+		extendedLength += extended[0] << 8;
 		payloadLength += extendedLength;
 
 		goto FULL_LENGTH_AQUIRED;
 	}
 
 	if(payloadLength == 127) {
-		auto readExtendedLength = client.readBytes(8);
-		if(readExtendedLength.fail()) {
-			return result.set(readExtendedLength.reason());
+		auto [extended, err] = co_await client.readExact(8);
+		if(err) {
+			co_return {
+				frame,
+				err,
+			};
 		}
 
 		uint64_t extendedLength = 0;
 		for(int i = 0; i < 8; i++) {
-			extendedLength |= readExtendedLength.value[i] << (i * 8);
+			extendedLength |= extended[i] << (i * 8);
 		}
 		payloadLength += extendedLength;
 
@@ -60,23 +69,26 @@ auto ws::decode(TcpSocket client) -> Result<Frame> {
 
 FULL_LENGTH_AQUIRED:
 
-	std::vector<Byte> mask;
+	Bytes mask;
 	if(hasMask) {
-		auto readMaskingKey = client.readBytes(4);
-		if(readMaskingKey.fail()) {
-			return result.set(readMaskingKey.reason());
+		std::tie(mask, err) = co_await client.readExact(4);
+		if(err) {
+			co_return {
+				frame,
+				err,
+			};
 		}
-
-		mask = std::move(readMaskingKey.value);
 	}
 
-	auto readRemainder = client.readBytes(payloadLength);
-	if(readRemainder.fail()) {
-		return result.set(readRemainder.reason());
+	auto [remainder, remainderErr] = co_await client.readExact(payloadLength);
+	if(remainderErr) {
+		co_return {
+			frame,
+			remainderErr,
+		};
 	}
 
-	auto remainder = std::move(readRemainder.value);
-	auto& decoded = result.value.payload;
+	auto& decoded = frame.payload;
 	decoded.resize(remainder.size());
 
 	if(hasMask) {
@@ -87,7 +99,10 @@ FULL_LENGTH_AQUIRED:
 		std::copy(remainder.begin(), remainder.end(), decoded.begin());
 	}
 
-	return result;
+	co_return {
+		frame,
+		nullptr,
+	};
 }
 
 auto ws::encode(const Frame& frame) -> std::vector<Byte> {
@@ -107,23 +122,40 @@ auto ws::encode(const Frame& frame) -> std::vector<Byte> {
 	return bytes;
 }
 
-auto ws::Server::listen(uint16_t port) -> Result<void> {
-	Result<void> toReturn;
-	auto result = TcpSocket::create();
-	
-	if(result.fail()) {
-		return toReturn.set(result.reason());;
+ws::Server::~Server() {
+	reactor.stop();
+	if(thread.joinable()) {
+		thread.join();
+	}
+}
+
+auto ws::Server::listen(uint16_t port) -> Error {
+	auto [socket, err] = UnixTcpSocket::create();
+	if(err) {
+		return err;
 	}
 
-	socket = result.value;
-	toReturn = socket.listen(port);
-	if(toReturn.fail()) {
-		return toReturn;
+	if(err = socket.listen(port); err) {
+		socket.close();
+		return err;
+	} else if(err = reactor.open(); err) {
+		socket.close();
+		return err;
 	}
 
-	std::thread doListen(&ws::Server::listenThread, this);
-	doListen.detach();
-	return toReturn;
+	std::tie(listener, err) = AsyncTcpSocket::attach(reactor, socket);
+	if(err) {
+		socket.close();
+		return err;
+	}
+
+	spawn(acceptClients());
+	thread = std::thread([this]() {
+		if(auto err = reactor.run(); err) {
+			std::cerr << err << '\n';
+		}
+	});
+	return nullptr;
 }
 
 auto ws::Server::sendToAll(std::string_view message) -> void {
@@ -133,38 +165,48 @@ auto ws::Server::sendToAll(std::string_view message) -> void {
 		.fin = true,
 	};
 
-	auto bytes = encode(frame);
-
-	clientsMutex.lock();
-	for(auto client : clients) {
-		client.write(bytes);
-	}
-	clientsMutex.unlock();
+	reactor.post([this, bytes = encode(frame)]() {
+		for(const auto& client : clients) {
+			queue(client, bytes);
+		}
+	});
 }
 
-auto ws::Server::listenThread() -> void {
+auto ws::Server::acceptClients() -> Task<> {
 	while(true) {
-		auto client = socket.accept();
-		if(client.fail()) {
-			std::cerr << client.reason() << '\n';
-		} else {
-			auto thread = std::thread(&ws::Server::handleClient, this, client.value);
-			thread.detach();
+		auto [accepted, err] = co_await listener.acceptBatch(64);
+		if(err) {
+			std::cerr << err << '\n';
+			co_await reactor.sleep(std::chrono::milliseconds(100));
+			continue;
+		}
+
+		for(auto socket : accepted) {
+			auto [attached, err] = AsyncTcpSocket::attach(reactor, socket);
+			if(err) {
+				std::cerr << err << '\n';
+				socket.close();
+				continue;
+			}
+
+			auto client = std::allocate_shared<Client>(SlabAllocator<Client>());
+			client->socket = std::move(attached);
+			spawn(handleClient(client));
 		}
 	}
 }
 
-auto ws::Server::handleClient(TcpSocket client) -> void {
-	auto result = Http::parseMessage(client);
-	if(result.fail()) {
-		std::cerr << result.reason() << '\n';
-		return;
+auto ws::Server::handleClient(std::shared_ptr<Client> client) -> Task<> {
+	auto [request, err] = co_await Http::readMessage(client->socket);
+	if(err) {
+		std::cerr << err << '\n';
+		co_return;
 	}
 
-	auto it = result.value.headers.find("Sec-WebSocket-Key");
-	if(it == result.value.headers.end()) {
+	auto it = request.headers.find("Sec-WebSocket-Key");
+	if(it == request.headers.end()) {
 		std::cerr << "Nu-uh\n";
-		return;
+		co_return;
 	}
 
 	const std::string magic = "258EAFA5-E914-47DA-95CA-C5AB0DC85B11";
@@ -176,40 +218,90 @@ auto ws::Server::handleClient(TcpSocket client) -> void {
 
 	std::string response = "HTTP/1.1 101 Switching Protocols\r\nUpgrade: websocket\r\nConnection: Upgrade\r\n";
 	response += "Sec-Websocket-Accept: " + base64Hash + "\n\n";
-	client.write(response);
 
-	clientsMutex.lock();
+	// frames for this client queue up behind the handshake, the socket closes once
+	// neither this coroutine nor the writing one holds the client any more
 	clients.insert(client);
-	clientsMutex.unlock();
+	client->outgoing.assign(response.begin(), response.end());
+	client->sending = true;
+	spawn(sendQueued(client));
+	reactor.schedule(heartbeatInterval, [this, weak = std::weak_ptr(client)]() {
+		heartbeat(weak);
+	});
 
 	while(true) {
-		auto readFrame = decode(client);
-		if(readFrame.fail()) {
-			client.close();
-			clientsMutex.lock();
+		auto [frame, err] = co_await decode(client->socket);
+		if(err) {
 			clients.erase(client);
-			clientsMutex.unlock();
-			break;
+			co_return;
 		}
+		client->answered = true;
 
-		switch(readFrame.value.op) {
+		switch(frame.op) {
 			case Frame::Opcode::Close:
-				client.close();
-				clientsMutex.lock();
 				clients.erase(client);
-				clientsMutex.unlock();
-				return;
+				co_return;
+			case Frame::Opcode::Ping:
+				queue(client, encode({
+					.payload = std::move(frame.payload),
+					.op = Frame::Pong,
+					.fin = true,
+				}));
+				break;
+			case Frame::Opcode::Pong:
+				break;
 			default:
-				auto view = std::string_view(reinterpret_cast<const char*>(readFrame.value.payload.data()),
-						readFrame.value.payload.size());
-				std::cerr << "Unhandled op: " << (int)readFrame.value.op << '\n';
-				std::cerr << "Payload (length: " << readFrame.value.payload.size()
+				auto view = std::string_view(reinterpret_cast<const char*>(frame.payload.data()),
+						frame.payload.size());
+				std::cerr << "Unhandled op: " << (int)frame.op << '\n';
+				std::cerr << "Payload (length: " << frame.payload.size()
 					<< "): " << view << '\n';
-				client.close();
-				clientsMutex.lock();
 				clients.erase(client);
-				clientsMutex.unlock();
-				return;
+				co_return;
+		}
+	}
+}
+
+auto ws::Server::sendQueued(std::shared_ptr<Client> client) -> Task<> {
+	while(!client->outgoing.empty() && clients.contains(client)) {
+		auto bytes = std::move(client->outgoing);
+		client->outgoing.clear();
+
+		if(auto [count, err] = co_await client->socket.write(bytes); err) {
+			break;
 		}
 	}
+	client->sending = false;
+}
+
+auto ws::Server::queue(const std::shared_ptr<Client>& client, BytesView bytes) -> void {
+	client->outgoing.insert(client->outgoing.end(), bytes.begin(), bytes.end());
+	if(!client->sending) {
+		client->sending = true;
+		spawn(sendQueued(client));
+	}
+}
+
+auto ws::Server::heartbeat(std::weak_ptr<Client> weak) -> void {
+	auto client = weak.lock();
+	if(!client || !clients.contains(client)) {
+		return;
+	}
+
+	if(!client->answered) {
+		// the reading coroutine fails on the shut down socket and drops the client
+		std::cerr << "WebSocket client missed its heartbeat\n";
+		client->socket.socket().shutdown();
+		return;
+	}
+
+	client->answered = false;
+	queue(client, encode({
+		.payload = {},
+		.op = Frame::Ping,
+		.fin = true,
+	}));
+	reactor.schedule(heartbeatInterval, [this, weak]() {
+		heartbeat(weak);
+	});
 }